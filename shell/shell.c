@@ -18,6 +18,7 @@
 
 #include "../sqlite/sqlite.h"
 #include "../sqlite/mem_riscos.h"
+#include "../sqlite/tokenize.h"
 
 /* Configuration constants */
 #define MAX_SQL_BUFFER      10000
@@ -26,6 +27,11 @@
 #define PROMPT              "sqlite> "
 #define CONTINUE_PROMPT     "   ...> "
 
+/* How the SQL read so far ends (see sql_input_state) */
+#define SQL_INPUT_EMPTY     0       /* Only whitespace and comments */
+#define SQL_INPUT_MORE      1       /* A statement is still open */
+#define SQL_INPUT_COMPLETE  2       /* The last token is a ';' */
+
 /* Global state */
 typedef struct {
     sqlite *db;                     /* Current database */
@@ -43,6 +49,7 @@ static shell_state_t shell = {NULL, "", 0, 0, 0, 1};
 */
 static int exec_dot_command(const char *line);
 static int exec_sql(const char *sql);
+static int sql_input_state(const char *sql);
 static void print_banner(void);
 static void print_help(void);
 
@@ -188,6 +195,36 @@ static int cmd_schema(const char *table)
     return 0;
 }
 
+/*
+** Show page and statement cache statistics
+*/
+static int cmd_stats(void)
+{
+    int hits, misses, evictions;
+
+    if (!shell.db) {
+        fprintf(stderr, "No database open\n");
+        return -1;
+    }
+
+    if (sqlite_get_cache_stats(shell.db, &hits, &misses, &evictions) != SQLITE_OK) {
+        fprintf(stderr, "Cache statistics not available\n");
+        return -1;
+    }
+
+    printf("Page cache:\n");
+    printf("  Hits:       %d\n", hits);
+    printf("  Misses:     %d\n", misses);
+    printf("  Evictions:  %d\n", evictions);
+
+    if (sqlite_get_stmt_cache_stats(shell.db, &hits, &misses) == SQLITE_OK) {
+        printf("Statement cache:\n");
+        printf("  Hits:       %d\n", hits);
+        printf("  Misses:     %d\n", misses);
+    }
+    return 0;
+}
+
 /*
 ** Execute a dot command
 */
@@ -223,6 +260,8 @@ static int exec_dot_command(const char *line)
         return cmd_tables();
     } else if (strcmp(cmd_buf, "schema") == 0) {
         return cmd_schema(args);
+    } else if (strcmp(cmd_buf, "stats") == 0) {
+        return cmd_stats();
     } else if (strcmp(cmd_buf, "verbose") == 0) {
         if (strlen(args) > 0) {
             if (strcasecmp(args, "on") == 0) {
@@ -292,6 +331,29 @@ static int exec_sql(const char *sql)
     return 0;
 }
 
+/*
+** Classify the SQL read so far
+** Lines are kept apart by newlines, so a -- comment ends with its line;
+** a block comment still open at the end keeps the input going.
+*/
+static int sql_input_state(const char *sql)
+{
+    const char *z = sql;
+    int last = TK_EOF, type, n;
+
+    while ((n = sql_get_token(z, &type)) > 0) {
+        if (type != TK_SPACE) {
+            last = type;
+        } else if (z[0] == '/' && z[n] == '\0' &&
+                   (n < 4 || z[n - 2] != '*' || z[n - 1] != '/')) {
+            return SQL_INPUT_MORE;
+        }
+        z += n;
+    }
+    if (last == TK_EOF) return SQL_INPUT_EMPTY;
+    return last == TK_SEMI ? SQL_INPUT_COMPLETE : SQL_INPUT_MORE;
+}
+
 /*
 ** Print welcome banner
 */
@@ -314,6 +376,7 @@ static void print_help(void)
     printf("  .open <file>         - Open database file\n");
     printf("  .tables              - List all tables\n");
     printf("  .schema [table]      - Show table schema\n");
+    printf("  .stats               - Show cache statistics\n");
     printf("  .verbose on|off      - Toggle verbose mode\n");
     printf("  .headers on|off      - Toggle result headers\n");
     printf("\n");
@@ -344,6 +407,7 @@ int sqlite_shell_main(int argc, char **argv)
     const char *db_file = ":memory:";
     char *errmsg = NULL;
     int exit_requested = 0;
+    int state;
 
     print_banner();
 
@@ -396,10 +460,10 @@ int sqlite_shell_main(int argc, char **argv)
             continue;
         }
 
-        /* Accumulate SQL statement */
+        /* Accumulate SQL statement, a line at a time */
         if (shell.sql_length + len + 2 < MAX_SQL_BUFFER) {
             if (shell.sql_length > 0) {
-                shell.sql_buffer[shell.sql_length++] = ' ';
+                shell.sql_buffer[shell.sql_length++] = '\n';
             }
             strcpy(shell.sql_buffer + shell.sql_length, line_buffer);
             shell.sql_length += len;
@@ -410,19 +474,19 @@ int sqlite_shell_main(int argc, char **argv)
             continue;
         }
 
-        /* Check for statement terminator (semicolon) */
-        if (shell.sql_buffer[shell.sql_length - 1] == ';') {
-            shell.sql_buffer[shell.sql_length - 1] = '\0';  /* Remove semicolon */
-
-            /* Execute SQL */
-            exec_sql(shell.sql_buffer);
-
-            /* Reset for next statement */
-            shell.sql_length = 0;
-            shell.in_statement = 0;
-        } else {
+        /* Run once a semicolon ends the input; comments alone are dropped */
+        state = sql_input_state(shell.sql_buffer);
+        if (state == SQL_INPUT_MORE) {
             shell.in_statement = 1;
+            continue;
+        }
+        if (state == SQL_INPUT_COMPLETE) {
+            exec_sql(shell.sql_buffer);
         }
+
+        /* Reset for next statement */
+        shell.sql_length = 0;
+        shell.in_statement = 0;
     }
 
     /* Cleanup */
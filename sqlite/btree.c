@@ -0,0 +1,437 @@
+/*
+** SQLite B-tree Implementation for RISC OS
+**
+** A B+tree keyed by 64-bit rowid that holds a table's rows in memory.
+** Insert and lookup are O(log n) and growth never copies existing rows:
+** a full node is split into two and only the separator moves up a level.
+**
+** Rowids are normally allocated in increasing order, so inserting past the
+** last key of a full node splits it unevenly: the old node stays full and
+** the new right-hand node starts with the new key. Sequential loads then
+** leave every node packed instead of half empty.
+**
+** An interior node has nkeys separators and nkeys + 1 children; child j
+** holds keys in [keys[j-1], keys[j]). Leaves hold the payloads.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "sqlite.h"
+#include "btree.h"
+#include "mem_riscos.h"
+
+struct bt_node {
+    int leaf;                       /* Non-zero for leaf nodes */
+    int nkeys;                      /* Keys in use */
+    btree_key_t keys[BTREE_ORDER];
+    void *ptrs[BTREE_ORDER + 1];    /* Children (interior) or payloads (leaf) */
+    bt_node_t *next;                /* Next leaf in key order */
+};
+
+struct btree {
+    bt_node_t *root;
+    int count;                      /* Number of entries */
+};
+
+/*
+** Allocate an empty node
+*/
+static bt_node_t *new_node(int leaf)
+{
+    bt_node_t *node = (bt_node_t *)riscos_calloc(1, sizeof(bt_node_t));
+    if (node) node->leaf = leaf;
+    return node;
+}
+
+/*
+** First index in a leaf whose key is >= key
+*/
+static int lower_bound(bt_node_t *node, btree_key_t key)
+{
+    int lo = 0, hi = node->nkeys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (node->keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/*
+** Child of an interior node that covers key
+*/
+static int child_index(bt_node_t *node, btree_key_t key)
+{
+    int lo = 0, hi = node->nkeys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (node->keys[mid] <= key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/*
+** Create an empty tree
+*/
+btree_t *btree_create(void)
+{
+    btree_t *tree = (btree_t *)riscos_calloc(1, sizeof(btree_t));
+    if (!tree) return NULL;
+
+    tree->root = new_node(1);
+    if (!tree->root) {
+        riscos_free(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+/*
+** Free a subtree, handing each payload to free_payload
+** Returns the number of entries it held.
+*/
+static int destroy_node(bt_node_t *node,
+                        void (*free_payload)(void *payload, void *arg), void *arg)
+{
+    int i, count = 0;
+
+    if (node->leaf) {
+        if (free_payload) {
+            for (i = 0; i < node->nkeys; i++) free_payload(node->ptrs[i], arg);
+        }
+        count = node->nkeys;
+    } else {
+        for (i = 0; i <= node->nkeys; i++) {
+            count += destroy_node(node->ptrs[i], free_payload, arg);
+        }
+    }
+    riscos_free(node);
+    return count;
+}
+
+/*
+** Free a tree and all its payloads
+*/
+void btree_destroy(btree_t *tree, void (*free_payload)(void *payload, void *arg),
+                   void *arg)
+{
+    if (!tree) return;
+    destroy_node(tree->root, free_payload, arg);
+    riscos_free(tree);
+}
+
+/*
+** Remove every key above key from a subtree
+** Returns the number of entries removed; *pempty is set if none are left,
+** in which case the caller frees the node.
+*/
+static int truncate_node(bt_node_t *node, btree_key_t key,
+                         void (*free_payload)(void *payload, void *arg), void *arg,
+                         int *pempty)
+{
+    int i, j, empty, count = 0;
+
+    if (node->leaf) {
+        i = lower_bound(node, key);
+        if (i < node->nkeys && node->keys[i] == key) i++;
+        for (j = i; j < node->nkeys; j++) {
+            if (free_payload) free_payload(node->ptrs[j], arg);
+            count++;
+        }
+        node->nkeys = i;
+        *pempty = i == 0;
+        return count;
+    }
+
+    /* Children right of the one covering key hold only larger keys */
+    i = child_index(node, key);
+    for (j = i + 1; j <= node->nkeys; j++) {
+        count += destroy_node(node->ptrs[j], free_payload, arg);
+    }
+    count += truncate_node(node->ptrs[i], key, free_payload, arg, &empty);
+    if (empty) {
+        riscos_free(node->ptrs[i]);
+        if (i == 0) {
+            *pempty = 1;
+            return count;
+        }
+        i--;
+    }
+    node->nkeys = i;
+    *pempty = 0;
+    return count;
+}
+
+/*
+** Remove every entry whose key is above key, handing each payload to
+** free_payload
+** Used to undo appends, so the tree is cut back along its right edge.
+*/
+void btree_truncate(btree_t *tree, btree_key_t key,
+                    void (*free_payload)(void *payload, void *arg), void *arg)
+{
+    bt_node_t *node;
+    int empty;
+
+    tree->count -= truncate_node(tree->root, key, free_payload, arg, &empty);
+    if (empty && !tree->root->leaf) {
+        memset(tree->root, 0, sizeof(bt_node_t));
+        tree->root->leaf = 1;
+    }
+
+    /* Drop levels left with a single child */
+    while (!tree->root->leaf && tree->root->nkeys == 0) {
+        node = tree->root;
+        tree->root = node->ptrs[0];
+        riscos_free(node);
+    }
+
+    /* The last leaf left linked to leaves that are gone */
+    node = tree->root;
+    while (!node->leaf) node = node->ptrs[node->nkeys];
+    node->next = NULL;
+}
+
+/*
+** Insert into a leaf, splitting it if full
+** On a split, *psplit receives the new right-hand node and *psep its first key.
+*/
+static int leaf_insert(bt_node_t *leaf, btree_key_t key, void *payload,
+                       bt_node_t **psplit, btree_key_t *psep)
+{
+    bt_node_t *right;
+    int pos = lower_bound(leaf, key);
+    int mid;
+
+    if (pos < leaf->nkeys && leaf->keys[pos] == key) return SQLITE_CONSTRAINT;
+
+    if (leaf->nkeys < BTREE_ORDER) {
+        memmove(&leaf->keys[pos + 1], &leaf->keys[pos],
+                (leaf->nkeys - pos) * sizeof(btree_key_t));
+        memmove(&leaf->ptrs[pos + 1], &leaf->ptrs[pos],
+                (leaf->nkeys - pos) * sizeof(void *));
+        leaf->keys[pos] = key;
+        leaf->ptrs[pos] = payload;
+        leaf->nkeys++;
+        return SQLITE_OK;
+    }
+
+    right = new_node(1);
+    if (!right) return SQLITE_NOMEM;
+
+    /* Appending: leave this leaf full and start a new one */
+    mid = pos == BTREE_ORDER ? BTREE_ORDER : BTREE_ORDER / 2;
+
+    right->nkeys = leaf->nkeys - mid;
+    memcpy(right->keys, &leaf->keys[mid], right->nkeys * sizeof(btree_key_t));
+    memcpy(right->ptrs, &leaf->ptrs[mid], right->nkeys * sizeof(void *));
+    leaf->nkeys = mid;
+    right->next = leaf->next;
+    leaf->next = right;
+
+    if (pos <= mid && pos < BTREE_ORDER) {
+        leaf_insert(leaf, key, payload, NULL, NULL);
+    } else {
+        leaf_insert(right, key, payload, NULL, NULL);
+    }
+
+    *psplit = right;
+    *psep = right->keys[0];
+    return SQLITE_OK;
+}
+
+/*
+** Insert into the subtree rooted at node
+** On a split, *psplit receives the new right-hand sibling and *psep the
+** separator key to insert into the parent.
+*/
+static int node_insert(bt_node_t *node, btree_key_t key, void *payload,
+                       bt_node_t **psplit, btree_key_t *psep)
+{
+    btree_key_t keys[BTREE_ORDER + 1];
+    void *ptrs[BTREE_ORDER + 2];
+    bt_node_t *child_split = NULL;
+    btree_key_t child_sep;
+    bt_node_t *right;
+    int i, mid, n;
+    int rc;
+
+    *psplit = NULL;
+    if (node->leaf) return leaf_insert(node, key, payload, psplit, psep);
+
+    i = child_index(node, key);
+    rc = node_insert(node->ptrs[i], key, payload, &child_split, &child_sep);
+    if (rc != SQLITE_OK || !child_split) return rc;
+
+    /* Room for the new separator */
+    if (node->nkeys < BTREE_ORDER) {
+        memmove(&node->keys[i + 1], &node->keys[i],
+                (node->nkeys - i) * sizeof(btree_key_t));
+        memmove(&node->ptrs[i + 2], &node->ptrs[i + 1],
+                (node->nkeys - i) * sizeof(void *));
+        node->keys[i] = child_sep;
+        node->ptrs[i + 1] = child_split;
+        node->nkeys++;
+        return SQLITE_OK;
+    }
+
+    /* Split a full interior node: merge into scratch arrays, then divide */
+    right = new_node(0);
+    if (!right) return SQLITE_NOMEM;
+
+    n = node->nkeys;
+    memcpy(keys, node->keys, i * sizeof(btree_key_t));
+    keys[i] = child_sep;
+    memcpy(&keys[i + 1], &node->keys[i], (n - i) * sizeof(btree_key_t));
+    memcpy(ptrs, node->ptrs, (i + 1) * sizeof(void *));
+    ptrs[i + 1] = child_split;
+    memcpy(&ptrs[i + 2], &node->ptrs[i + 1], (n - i) * sizeof(void *));
+    n++;
+
+    /* Appending: keep this node full and push only the new key up */
+    mid = i == BTREE_ORDER ? BTREE_ORDER : n / 2;
+
+    node->nkeys = mid;
+    memcpy(node->keys, keys, mid * sizeof(btree_key_t));
+    memcpy(node->ptrs, ptrs, (mid + 1) * sizeof(void *));
+
+    right->nkeys = n - mid - 1;
+    memcpy(right->keys, &keys[mid + 1], right->nkeys * sizeof(btree_key_t));
+    memcpy(right->ptrs, &ptrs[mid + 1], (right->nkeys + 1) * sizeof(void *));
+
+    *psplit = right;
+    *psep = keys[mid];
+    return SQLITE_OK;
+}
+
+/*
+** Insert a payload under key
+** Returns SQLITE_CONSTRAINT if the key is already present.
+*/
+int btree_insert(btree_t *tree, btree_key_t key, void *payload)
+{
+    bt_node_t *root = NULL;
+    bt_node_t *split;
+    btree_key_t sep;
+    int rc;
+
+    /* A full root may split; allocate its new parent up front */
+    if (tree->root->nkeys == BTREE_ORDER) {
+        root = new_node(0);
+        if (!root) return SQLITE_NOMEM;
+    }
+
+    rc = node_insert(tree->root, key, payload, &split, &sep);
+    if (rc != SQLITE_OK) {
+        if (root) riscos_free(root);
+        return rc;
+    }
+
+    if (split) {
+        /* Root split: grow the tree by one level */
+        root->nkeys = 1;
+        root->keys[0] = sep;
+        root->ptrs[0] = tree->root;
+        root->ptrs[1] = split;
+        tree->root = root;
+    } else if (root) {
+        riscos_free(root);
+    }
+
+    tree->count++;
+    return SQLITE_OK;
+}
+
+/*
+** Descend to the leaf that would hold key
+*/
+static bt_node_t *find_leaf(btree_t *tree, btree_key_t key)
+{
+    bt_node_t *node = tree->root;
+    while (!node->leaf) {
+        node = node->ptrs[child_index(node, key)];
+    }
+    return node;
+}
+
+/*
+** Find the payload stored under key, or NULL
+*/
+void *btree_lookup(btree_t *tree, btree_key_t key)
+{
+    bt_node_t *leaf = find_leaf(tree, key);
+    int pos = lower_bound(leaf, key);
+
+    if (pos < leaf->nkeys && leaf->keys[pos] == key) return leaf->ptrs[pos];
+    return NULL;
+}
+
+/*
+** Number of entries in the tree
+*/
+int btree_count(btree_t *tree)
+{
+    return tree->count;
+}
+
+/*
+** Position a cursor on the smallest key
+** Returns non-zero if the cursor points at an entry.
+*/
+int btree_first(btree_t *tree, btree_cursor_t *cur)
+{
+    bt_node_t *node = tree->root;
+    while (!node->leaf) node = node->ptrs[0];
+
+    cur->leaf = node;
+    cur->idx = 0;
+    if (node->nkeys == 0) cur->leaf = NULL;
+    return cur->leaf != NULL;
+}
+
+/*
+** Position a cursor on the first key >= key
+** Returns non-zero if the cursor points at an entry.
+*/
+int btree_seek(btree_t *tree, btree_key_t key, btree_cursor_t *cur)
+{
+    bt_node_t *leaf = find_leaf(tree, key);
+
+    cur->leaf = leaf;
+    cur->idx = lower_bound(leaf, key);
+    if (cur->idx >= leaf->nkeys) {
+        cur->leaf = leaf->next;
+        cur->idx = 0;
+    }
+    return cur->leaf != NULL;
+}
+
+/*
+** Advance to the next key
+** Returns non-zero if the cursor still points at an entry.
+*/
+int btree_next(btree_cursor_t *cur)
+{
+    if (!cur->leaf) return 0;
+    if (++cur->idx >= cur->leaf->nkeys) {
+        cur->leaf = cur->leaf->next;
+        cur->idx = 0;
+    }
+    return cur->leaf != NULL;
+}
+
+int btree_cursor_valid(btree_cursor_t *cur)
+{
+    return cur->leaf != NULL;
+}
+
+btree_key_t btree_cursor_key(btree_cursor_t *cur)
+{
+    return cur->leaf->keys[cur->idx];
+}
+
+void *btree_cursor_payload(btree_cursor_t *cur)
+{
+    return cur->leaf->ptrs[cur->idx];
+}
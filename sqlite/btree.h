@@ -0,0 +1,47 @@
+/*
+** SQLite B-tree for RISC OS
+** In-memory B+tree mapping 64-bit rowids to row payloads
+**
+** Interior nodes hold separator keys only; every row lives in a leaf and
+** the leaves are linked left to right, so a scan walks the rows in rowid
+** order without revisiting interior nodes.
+*/
+
+#ifndef _BTREE_H_
+#define _BTREE_H_
+
+/* Keys per node (interior and leaf) */
+#define BTREE_ORDER 32
+
+typedef long long btree_key_t;
+
+typedef struct btree btree_t;
+typedef struct bt_node bt_node_t;
+
+/* Cursor for ordered traversal */
+typedef struct {
+    bt_node_t *leaf;                /* Current leaf, NULL when past the end */
+    int idx;                        /* Entry within the leaf */
+} btree_cursor_t;
+
+/* Tree lifecycle */
+btree_t *btree_create(void);
+void btree_destroy(btree_t *tree, void (*free_payload)(void *payload, void *arg),
+                   void *arg);
+
+/* Access by key */
+int btree_insert(btree_t *tree, btree_key_t key, void *payload);
+void *btree_lookup(btree_t *tree, btree_key_t key);
+int btree_count(btree_t *tree);
+void btree_truncate(btree_t *tree, btree_key_t key,
+                    void (*free_payload)(void *payload, void *arg), void *arg);
+
+/* Ordered traversal */
+int btree_first(btree_t *tree, btree_cursor_t *cur);
+int btree_seek(btree_t *tree, btree_key_t key, btree_cursor_t *cur);
+int btree_next(btree_cursor_t *cur);
+int btree_cursor_valid(btree_cursor_t *cur);
+btree_key_t btree_cursor_key(btree_cursor_t *cur);
+void *btree_cursor_payload(btree_cursor_t *cur);
+
+#endif /* _BTREE_H_ */
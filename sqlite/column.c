@@ -0,0 +1,276 @@
+/*
+** SQLite Column Store for RISC OS
+**
+** Vectors grow by doubling. An append reserves room in every column
+** before storing anything, so running out of memory leaves the store
+** exactly as it was.
+*/
+
+#include <string.h>
+#include "sqlite.h"
+#include "column.h"
+#include "mem_riscos.h"
+
+/* Rows allocated on the first append */
+#define COLSTORE_INITIAL_ROWS 64
+
+/* Fixed-size cell: a number, or the location of text in the heap */
+typedef union {
+    long long i;
+    double r;
+    struct {
+        unsigned int off;
+        unsigned int len;
+    } t;
+} col_cell_t;
+
+/* One column */
+typedef struct {
+    value_type_t home;              /* Class of the first non-NULL value */
+    col_cell_t *cells;
+    unsigned char *nulls;           /* Bit set for each NULL row */
+    unsigned char *types;           /* Per-row class, once classes are mixed */
+    char *heap;                     /* TEXT/BLOB bytes, each NUL-terminated */
+    unsigned int heap_used;
+    unsigned int heap_cap;
+} col_vector_t;
+
+struct colstore {
+    int num_columns;
+    int count;                      /* Rows stored */
+    int capacity;                   /* Rows allocated in every column */
+    col_vector_t *cols;
+};
+
+/*
+** Create an empty store
+*/
+colstore_t *colstore_create(int num_columns)
+{
+    colstore_t *cs = (colstore_t *)riscos_calloc(1, sizeof(colstore_t));
+    if (!cs) return NULL;
+
+    cs->num_columns = num_columns;
+    if (num_columns > 0) {
+        cs->cols = (col_vector_t *)riscos_calloc(num_columns, sizeof(col_vector_t));
+        if (!cs->cols) {
+            riscos_free(cs);
+            return NULL;
+        }
+    }
+    return cs;
+}
+
+/*
+** Free a store and all its data
+*/
+void colstore_destroy(colstore_t *cs)
+{
+    int c;
+
+    if (!cs) return;
+    for (c = 0; c < cs->num_columns; c++) {
+        col_vector_t *col = &cs->cols[c];
+        if (col->cells) riscos_free(col->cells);
+        if (col->nulls) riscos_free(col->nulls);
+        if (col->types) riscos_free(col->types);
+        if (col->heap) riscos_free(col->heap);
+    }
+    if (cs->cols) riscos_free(cs->cols);
+    riscos_free(cs);
+}
+
+/*
+** Grow every column to hold capacity rows
+*/
+static int grow_rows(colstore_t *cs, int capacity)
+{
+    int old_bytes = (cs->capacity + 7) / 8;
+    int new_bytes = (capacity + 7) / 8;
+    int c;
+
+    for (c = 0; c < cs->num_columns; c++) {
+        col_vector_t *col = &cs->cols[c];
+        void *p;
+
+        p = riscos_realloc(col->cells, capacity * sizeof(col_cell_t));
+        if (!p) return SQLITE_NOMEM;
+        col->cells = (col_cell_t *)p;
+
+        p = riscos_realloc(col->nulls, new_bytes);
+        if (!p) return SQLITE_NOMEM;
+        col->nulls = (unsigned char *)p;
+        memset(col->nulls + old_bytes, 0, new_bytes - old_bytes);
+
+        if (col->types) {
+            p = riscos_realloc(col->types, capacity);
+            if (!p) return SQLITE_NOMEM;
+            col->types = (unsigned char *)p;
+        }
+    }
+
+    cs->capacity = capacity;
+    return SQLITE_OK;
+}
+
+/*
+** Make room in a column for one more value
+*/
+static int reserve_value(colstore_t *cs, col_vector_t *col, const value_t *v)
+{
+    if (v->type == VALUE_NULL) return SQLITE_OK;
+
+    /* First value of another class: start recording classes per row */
+    if (col->home != VALUE_NULL && v->type != col->home && !col->types) {
+        col->types = (unsigned char *)riscos_malloc(cs->capacity);
+        if (!col->types) return SQLITE_NOMEM;
+        memset(col->types, col->home, cs->capacity);
+    }
+
+    if (v->type == VALUE_TEXT || v->type == VALUE_BLOB) {
+        unsigned int need = col->heap_used + v->u.s.n + 1;
+        if (need > col->heap_cap) {
+            unsigned int cap = col->heap_cap ? col->heap_cap : 256;
+            char *heap;
+            while (cap < need) cap *= 2;
+            heap = (char *)riscos_realloc(col->heap, cap);
+            if (!heap) return SQLITE_NOMEM;
+            col->heap = heap;
+            col->heap_cap = cap;
+        }
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Make room for rows more rows in one step, so a batch of appends does
+** not grow the vectors a doubling at a time
+*/
+int colstore_reserve(colstore_t *cs, int rows)
+{
+    if (cs->count + rows <= cs->capacity) return SQLITE_OK;
+    return grow_rows(cs, cs->count + rows);
+}
+
+/*
+** Append a row of num_columns values
+** Text is copied into the store.
+*/
+int colstore_append(colstore_t *cs, const value_t *values)
+{
+    int row = cs->count;
+    int c;
+    int rc;
+
+    if (row == cs->capacity) {
+        rc = grow_rows(cs, cs->capacity ? cs->capacity * 2 : COLSTORE_INITIAL_ROWS);
+        if (rc != SQLITE_OK) return rc;
+    }
+    for (c = 0; c < cs->num_columns; c++) {
+        rc = reserve_value(cs, &cs->cols[c], &values[c]);
+        if (rc != SQLITE_OK) return rc;
+    }
+
+    for (c = 0; c < cs->num_columns; c++) {
+        col_vector_t *col = &cs->cols[c];
+        const value_t *v = &values[c];
+        col_cell_t *cell = &col->cells[row];
+
+        if (col->types) col->types[row] = (unsigned char)v->type;
+        switch (v->type) {
+            case VALUE_NULL:
+                col->nulls[row >> 3] |= (unsigned char)(1 << (row & 7));
+                continue;
+            case VALUE_INTEGER:
+                cell->i = v->u.i;
+                break;
+            case VALUE_REAL:
+                cell->r = v->u.r;
+                break;
+            default:
+                cell->t.off = col->heap_used;
+                cell->t.len = (unsigned int)v->u.s.n;
+                memcpy(col->heap + col->heap_used, v->u.s.z, v->u.s.n);
+                col->heap[col->heap_used + v->u.s.n] = '\0';
+                col->heap_used += v->u.s.n + 1;
+                break;
+        }
+        if (col->home == VALUE_NULL) col->home = v->type;
+    }
+
+    cs->count++;
+    return SQLITE_OK;
+}
+
+/*
+** Drop every row from rows onward
+** Used to undo appends; text of the dropped rows is given back to each
+** column's heap, which only ever grows at the end.
+*/
+void colstore_truncate(colstore_t *cs, int rows)
+{
+    int c, row;
+
+    if (rows >= cs->count) return;
+    for (c = 0; c < cs->num_columns; c++) {
+        col_vector_t *col = &cs->cols[c];
+
+        for (row = rows; row < cs->count; row++) {
+            value_type_t type;
+
+            if (col->nulls[row >> 3] & (1 << (row & 7))) {
+                col->nulls[row >> 3] &= (unsigned char)~(1 << (row & 7));
+                continue;
+            }
+            type = col->types ? (value_type_t)col->types[row] : col->home;
+            if ((type == VALUE_TEXT || type == VALUE_BLOB) &&
+                col->cells[row].t.off < col->heap_used) {
+                col->heap_used = col->cells[row].t.off;
+            }
+        }
+    }
+    cs->count = rows;
+}
+
+/*
+** Number of rows stored
+*/
+int colstore_count(colstore_t *cs)
+{
+    return cs->count;
+}
+
+/*
+** Fetch a run of values from one column
+*/
+void colstore_fetch(colstore_t *cs, int col_index, int first, int count,
+                    value_t *out, int stride)
+{
+    col_vector_t *col = &cs->cols[col_index];
+    int k;
+
+    for (k = 0; k < count; k++, out += stride) {
+        int row = first + k;
+        col_cell_t *cell = &col->cells[row];
+        value_type_t type;
+
+        if (col->nulls[row >> 3] & (1 << (row & 7))) {
+            out->type = VALUE_NULL;
+            continue;
+        }
+        type = col->types ? (value_type_t)col->types[row] : col->home;
+        out->type = type;
+        switch (type) {
+            case VALUE_INTEGER:
+                out->u.i = cell->i;
+                break;
+            case VALUE_REAL:
+                out->u.r = cell->r;
+                break;
+            default:
+                out->u.s.z = col->heap + cell->t.off;
+                out->u.s.n = (int)cell->t.len;
+                break;
+        }
+    }
+}
@@ -0,0 +1,40 @@
+/*
+** SQLite Column Store for RISC OS
+** Columnar row storage for tables created WITH (columnar)
+**
+** Each column is a contiguous vector of 8-byte cells plus a null bitmap.
+** INTEGER and REAL cells hold the number itself; TEXT and BLOB cells hold
+** an offset and length into the column's own text heap. A column whose
+** values all share one storage class needs nothing else, so a scan over
+** it reads two dense arrays. Only a column that mixes classes (text in an
+** INTEGER column, say) grows a per-row class array.
+**
+** Rows are numbered from 0 in insertion order.
+*/
+
+#ifndef _COLUMN_H_
+#define _COLUMN_H_
+
+#include "value.h"
+
+typedef struct colstore colstore_t;
+
+/* Store lifecycle */
+colstore_t *colstore_create(int num_columns);
+void colstore_destroy(colstore_t *cs);
+
+/* Rows */
+int colstore_reserve(colstore_t *cs, int rows);
+int colstore_append(colstore_t *cs, const value_t *values);
+int colstore_count(colstore_t *cs);
+void colstore_truncate(colstore_t *cs, int rows);
+
+/*
+** Fetch count values of one column starting at row first, writing each to
+** out[k * stride]. Text values point into the store and remain valid until
+** the next append.
+*/
+void colstore_fetch(colstore_t *cs, int col, int first, int count,
+                    value_t *out, int stride);
+
+#endif /* _COLUMN_H_ */
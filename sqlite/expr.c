@@ -0,0 +1,624 @@
+/*
+** SQLite Expressions for RISC OS
+**
+** Recursive descent over tokens, lowest precedence first: OR, AND, NOT, then a
+** predicate (comparison, IS NULL, LIKE, BETWEEN) over operands (column,
+** literal or parenthesised expression). Nodes refer to their operands by
+** position in the tree's node array, so the array can grow while parsing
+** and the whole tree is freed in one go. BETWEEN becomes an AND of two
+** comparisons sharing the tested operand.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "sqlite.h"
+#include "expr.h"
+#include "tokenize.h"
+#include "mem_riscos.h"
+
+/* Nodes allocated for a new tree */
+#define EXPR_INITIAL_NODES 16
+
+typedef struct {
+    int op;                         /* EXPR_LITERAL ... EXPR_LIKE */
+    int left;                       /* Operand nodes, -1 if none */
+    int right;
+    int column;                     /* EXPR_COLUMN: column number */
+                                    /* EXPR_VARIABLE: parameter number */
+    value_affinity_t affinity;      /* EXPR_COLUMN: affinity of the column */
+                                    /* EXPR_VARIABLE: affinity to apply */
+    value_t value;                  /* EXPR_LITERAL: value */
+    const char *text;               /* EXPR_LITERAL: source text, for affinity */
+    int len;
+    int quoted;
+} expr_node_t;
+
+struct expr_tree {
+    expr_node_t *nodes;
+    int num_nodes;
+    int capacity;
+    int root;
+    int num_params;
+    char *text;                     /* Unquoted literal text */
+};
+
+typedef struct {
+    sql_lexer_t *lx;
+    expr_tree_t *tree;
+    char *lits;                     /* Next free byte of tree->text */
+    expr_resolve_t resolve;
+    void *arg;
+    int rc;
+    const char *error;
+} expr_parser_t;
+
+/*
+** Utility: Consume the current token if it has the given type
+*/
+#define ACCEPT(ps, type) sql_lexer_accept((ps)->lx, (type))
+
+/*
+** Record the first error
+*/
+static int parse_error(expr_parser_t *ps, int rc, const char *error)
+{
+    if (ps->rc == SQLITE_OK) {
+        ps->rc = rc;
+        ps->error = error;
+    }
+    return -1;
+}
+
+/*
+** Append a node, returning its position or -1
+*/
+static int new_node(expr_parser_t *ps, int op, int left, int right)
+{
+    expr_tree_t *tree = ps->tree;
+    expr_node_t *node;
+
+    if (ps->rc != SQLITE_OK) return -1;
+    if (tree->num_nodes == tree->capacity) {
+        int capacity = tree->capacity * 2;
+        expr_node_t *nodes = (expr_node_t *)riscos_realloc(tree->nodes,
+                                capacity * sizeof(expr_node_t));
+        if (!nodes) return parse_error(ps, SQLITE_NOMEM, "Out of memory");
+        tree->nodes = nodes;
+        tree->capacity = capacity;
+    }
+
+    node = &tree->nodes[tree->num_nodes];
+    memset(node, 0, sizeof(*node));
+    node->op = op;
+    node->left = left;
+    node->right = right;
+    return tree->num_nodes++;
+}
+
+/*
+** Add a literal node for text already copied into the tree
+*/
+static int literal_node(expr_parser_t *ps, const char *text, int len, int quoted)
+{
+    int n = new_node(ps, EXPR_LITERAL, -1, -1);
+    if (n >= 0) {
+        expr_node_t *node = &ps->tree->nodes[n];
+        node->text = text;
+        node->len = len;
+        node->quoted = quoted;
+        if (text) {
+            value_from_literal(&node->value, text, len, quoted, AFFINITY_NONE);
+        } else {
+            node->value.type = VALUE_NULL;
+        }
+    }
+    return n;
+}
+
+/*
+** Add a column node for a name, or return -1 if there is no such column
+*/
+static int column_node(expr_parser_t *ps, const char *name, int len)
+{
+    value_affinity_t affinity;
+    int c = ps->resolve(ps->arg, name, len, &affinity);
+    int n;
+
+    if (c < 0) return -1;
+    n = new_node(ps, EXPR_COLUMN, -1, -1);
+    if (n >= 0) {
+        ps->tree->nodes[n].column = c;
+        ps->tree->nodes[n].affinity = affinity;
+    }
+    return n;
+}
+
+/*
+** Convert a literal compared with a column using the column's affinity
+** (for a parameter, when its value is loaded)
+*/
+static void apply_affinity(expr_tree_t *tree, int column, int literal)
+{
+    expr_node_t *c = &tree->nodes[column];
+    expr_node_t *l = &tree->nodes[literal];
+
+    if (c->op != EXPR_COLUMN) return;
+    if (l->op == EXPR_LITERAL && l->text) {
+        value_from_literal(&l->value, l->text, l->len, l->quoted, c->affinity);
+    } else if (l->op == EXPR_VARIABLE) {
+        l->affinity = c->affinity;
+    }
+}
+
+/*
+** Add a comparison node
+*/
+static int compare_node(expr_parser_t *ps, int op, int left, int right)
+{
+    if (left < 0 || right < 0) return -1;
+    apply_affinity(ps->tree, left, right);
+    apply_affinity(ps->tree, right, left);
+    return new_node(ps, op, left, right);
+}
+
+static int parse_or(expr_parser_t *ps);
+
+/*
+** operand: column | literal | NULL | ? | ( expr )
+*/
+static int parse_operand(expr_parser_t *ps)
+{
+    sql_lexer_t *lx = ps->lx;
+    const char *z = SQL_TOKEN_TEXT(lx);
+    char *start = ps->lits;
+    int len, n;
+
+    switch (lx->token.type) {
+        case TK_LP:
+            sql_lexer_next(lx);
+            n = parse_or(ps);
+            if (!ACCEPT(ps, TK_RP)) return parse_error(ps, SQLITE_ERROR, "Expected ) in expression");
+            return n;
+
+        case TK_NULL:
+            sql_lexer_next(lx);
+            return literal_node(ps, NULL, 0, 0);
+
+        case TK_VARIABLE:
+            sql_lexer_next(lx);
+            n = new_node(ps, EXPR_VARIABLE, -1, -1);
+            if (n >= 0) ps->tree->nodes[n].column = ++ps->tree->num_params;
+            return n;
+
+        case TK_STRING:
+            /* "x" names a column if there is one */
+            len = sql_dequote(z, lx->token.length, start, lx->token.length);
+            sql_lexer_next(lx);
+            if (*z == '"') {
+                n = column_node(ps, start, len);
+                if (n >= 0 || ps->rc != SQLITE_OK) return n;
+            }
+            ps->lits += len + 1;
+            return literal_node(ps, start, len, 1);
+
+        case TK_PLUS:
+        case TK_MINUS:
+            /* Signed number */
+            sql_lexer_next(lx);
+            if (lx->token.type != TK_INTEGER && lx->token.type != TK_FLOAT) break;
+            *ps->lits++ = *z;
+            z = SQL_TOKEN_TEXT(lx);
+            /* fall through */
+        case TK_INTEGER:
+        case TK_FLOAT:
+            memcpy(ps->lits, z, lx->token.length);
+            ps->lits += lx->token.length;
+            *ps->lits++ = '\0';
+            sql_lexer_next(lx);
+            return literal_node(ps, start, (int)(ps->lits - start - 1), 0);
+
+        case TK_ILLEGAL:
+            if (*z == '\'' || *z == '"') {
+                return parse_error(ps, SQLITE_ERROR, "Unterminated string");
+            }
+            break;
+
+        default:
+            /* Column name; keywords other than NULL and NOT may name columns */
+            if (!TK_IS_NAME(lx->token.type)) break;
+            len = lx->token.length;
+            if (*z == '`' || *z == '[') {
+                len = sql_dequote(z, len, start, len);
+                z = start;
+            }
+            sql_lexer_next(lx);
+            n = column_node(ps, z, len);
+            if (n < 0 && ps->rc == SQLITE_OK) {
+                return parse_error(ps, SQLITE_ERROR, "No such column");
+            }
+            return n;
+    }
+
+    return parse_error(ps, SQLITE_ERROR, "Syntax error in expression");
+}
+
+/*
+** predicate: operand [cmp operand | IS [NOT] NULL | ISNULL | NOTNULL |
+**            [NOT] LIKE operand | [NOT] BETWEEN operand AND operand]
+*/
+static int parse_predicate(expr_parser_t *ps)
+{
+    int left = parse_operand(ps);
+    int negate = 0;
+    int op, n;
+
+    if (left < 0) return -1;
+
+    /* Comparison operators */
+    switch (ps->lx->token.type) {
+        case TK_EQ: op = EXPR_EQ; break;
+        case TK_NE: op = EXPR_NE; break;
+        case TK_LT: op = EXPR_LT; break;
+        case TK_LE: op = EXPR_LE; break;
+        case TK_GT: op = EXPR_GT; break;
+        case TK_GE: op = EXPR_GE; break;
+        default: op = -1; break;
+    }
+    if (op >= 0) {
+        sql_lexer_next(ps->lx);
+        return compare_node(ps, op, left, parse_operand(ps));
+    }
+
+    if (ACCEPT(ps, TK_ISNULL)) return new_node(ps, EXPR_ISNULL, left, -1);
+    if (ACCEPT(ps, TK_NOTNULL)) return new_node(ps, EXPR_NOTNULL, left, -1);
+    if (ACCEPT(ps, TK_IS)) {
+        op = ACCEPT(ps, TK_NOT) ? EXPR_NOTNULL : EXPR_ISNULL;
+        if (!ACCEPT(ps, TK_NULL)) {
+            return parse_error(ps, SQLITE_ERROR, "Expected NULL after IS");
+        }
+        return new_node(ps, op, left, -1);
+    }
+
+    if (ACCEPT(ps, TK_NOT)) {
+        if (ACCEPT(ps, TK_NULL)) return new_node(ps, EXPR_NOTNULL, left, -1);
+        negate = 1;
+    }
+    if (ACCEPT(ps, TK_LIKE)) {
+        int right = parse_operand(ps);
+        n = right < 0 ? -1 : new_node(ps, EXPR_LIKE, left, right);
+    } else if (ACCEPT(ps, TK_BETWEEN)) {
+        int low = compare_node(ps, EXPR_GE, left, parse_operand(ps));
+        if (!ACCEPT(ps, TK_AND)) {
+            return parse_error(ps, SQLITE_ERROR, "Expected AND in BETWEEN");
+        }
+        n = new_node(ps, EXPR_AND, low, compare_node(ps, EXPR_LE, left, parse_operand(ps)));
+    } else if (negate) {
+        return parse_error(ps, SQLITE_ERROR, "Syntax error after NOT");
+    } else {
+        return left;
+    }
+
+    if (n >= 0 && negate) n = new_node(ps, EXPR_NOT, n, -1);
+    return n;
+}
+
+/*
+** not_expr: NOT not_expr | predicate
+*/
+static int parse_not(expr_parser_t *ps)
+{
+    if (ACCEPT(ps, TK_NOT)) {
+        int n = parse_not(ps);
+        return n < 0 ? -1 : new_node(ps, EXPR_NOT, n, -1);
+    }
+    return parse_predicate(ps);
+}
+
+/*
+** and_expr: not_expr [AND not_expr ...]
+*/
+static int parse_and(expr_parser_t *ps)
+{
+    int n = parse_not(ps);
+    while (n >= 0 && ACCEPT(ps, TK_AND)) {
+        int right = parse_not(ps);
+        n = right < 0 ? -1 : new_node(ps, EXPR_AND, n, right);
+    }
+    return n;
+}
+
+/*
+** expr: and_expr [OR and_expr ...]
+*/
+static int parse_or(expr_parser_t *ps)
+{
+    int n = parse_and(ps);
+    while (n >= 0 && ACCEPT(ps, TK_OR)) {
+        int right = parse_and(ps);
+        n = right < 0 ? -1 : new_node(ps, EXPR_OR, n, right);
+    }
+    return n;
+}
+
+/*
+** Compile the expression starting at the lexer's current token
+** Stops at the first token that cannot continue the expression.
+*/
+int expr_compile(sql_lexer_t *lx, expr_resolve_t resolve, void *arg,
+                 expr_tree_t **ptree, char **errmsg)
+{
+    expr_parser_t ps;
+    expr_tree_t *tree;
+
+    *ptree = NULL;
+    tree = (expr_tree_t *)riscos_calloc(1, sizeof(expr_tree_t));
+    if (!tree) {
+        if (errmsg) *errmsg = "Out of memory";
+        return SQLITE_NOMEM;
+    }
+    tree->capacity = EXPR_INITIAL_NODES;
+    tree->nodes = (expr_node_t *)riscos_malloc(tree->capacity * sizeof(expr_node_t));
+    tree->text = (char *)riscos_malloc(strlen(SQL_TOKEN_TEXT(lx)) + 1);
+    if (!tree->nodes || !tree->text) {
+        expr_free(tree);
+        if (errmsg) *errmsg = "Out of memory";
+        return SQLITE_NOMEM;
+    }
+
+    memset(&ps, 0, sizeof(ps));
+    ps.lx = lx;
+    ps.tree = tree;
+    ps.lits = tree->text;
+    ps.resolve = resolve;
+    ps.arg = arg;
+    ps.rc = SQLITE_OK;
+
+    tree->root = parse_or(&ps);
+    if (ps.rc != SQLITE_OK) {
+        expr_free(tree);
+        if (errmsg) *errmsg = (char *)ps.error;
+        return ps.rc;
+    }
+
+    *ptree = tree;
+    return SQLITE_OK;
+}
+
+/*
+** Free a compiled expression
+*/
+void expr_free(expr_tree_t *tree)
+{
+    if (!tree) return;
+    riscos_free(tree->nodes);
+    riscos_free(tree->text);
+    riscos_free(tree);
+}
+
+/*
+** Code generation
+** Conditions compile to jumps: code_if_true() branches to dest when the
+** condition holds, code_if_false() when it does not, and an unknown result
+** branches only if jump_if_null is set. Columns are loaded from the cursor
+** into registers and literals become program constants.
+*/
+typedef struct {
+    const expr_tree_t *tree;
+    vdbe_t *v;
+    int cursor;
+} expr_coder_t;
+
+static void code_if_true(expr_coder_t *ec, int n, int dest, int jump_if_null);
+static void code_if_false(expr_coder_t *ec, int n, int dest, int jump_if_null);
+
+/*
+** Load an operand into a register; conditions give 1, 0 or NULL
+*/
+static int code_operand(expr_coder_t *ec, int n)
+{
+    const expr_node_t *node = &ec->tree->nodes[n];
+    vdbe_t *v = ec->v;
+    int reg = vdbe_alloc_regs(v, 1);
+    int is_false, is_true, done;
+
+    switch (node->op) {
+        case EXPR_COLUMN:
+            vdbe_add_op(v, OP_Column, ec->cursor, node->column, reg);
+            break;
+        case EXPR_LITERAL:
+            vdbe_set_constant(v, reg, &node->value);
+            break;
+        case EXPR_VARIABLE:
+            vdbe_add_op(v, OP_Variable, node->column, reg, node->affinity);
+            break;
+        default:
+            is_false = vdbe_make_label(v);
+            is_true = vdbe_make_label(v);
+            done = vdbe_make_label(v);
+            vdbe_add_op(v, OP_Null, 0, reg, 0);
+            code_if_false(ec, n, is_false, 0);
+            code_if_true(ec, n, is_true, 0);
+            vdbe_add_op(v, OP_Goto, 0, done, 0);
+            vdbe_resolve_label(v, is_false);
+            vdbe_add_op(v, OP_Integer, 0, reg, 0);
+            vdbe_add_op(v, OP_Goto, 0, done, 0);
+            vdbe_resolve_label(v, is_true);
+            vdbe_add_op(v, OP_Integer, 1, reg, 0);
+            vdbe_resolve_label(v, done);
+            break;
+    }
+    return reg;
+}
+
+/*
+** Emit a jump taken when a comparison, LIKE or bare value holds
+** (or, with negate, when it does not)
+*/
+static void code_test(expr_coder_t *ec, int n, int dest, int jump_if_null, int negate)
+{
+    /* Comparison opcodes, and those testing the opposite condition */
+    static const int opcodes[] = { OP_Eq, OP_Ne, OP_Lt, OP_Le, OP_Gt, OP_Ge };
+    static const int inverse[] = { OP_Ne, OP_Eq, OP_Ge, OP_Gt, OP_Le, OP_Lt };
+    const expr_node_t *node = &ec->tree->nodes[n];
+    int a, b;
+
+    switch (node->op) {
+        case EXPR_ISNULL:
+        case EXPR_NOTNULL:
+            a = code_operand(ec, node->left);
+            vdbe_add_op(ec->v, (node->op == EXPR_ISNULL) != negate ? OP_IsNull : OP_NotNull,
+                        a, dest, 0);
+            return;
+
+        case EXPR_LIKE:
+            a = code_operand(ec, node->left);
+            b = code_operand(ec, node->right);
+            vdbe_add_op(ec->v, OP_Like, a, dest, b);
+            vdbe_set_p5(ec->v, (jump_if_null ? VDBE_JUMPIFNULL : 0) |
+                               (negate ? VDBE_NEGATE : 0));
+            return;
+
+        case EXPR_COLUMN:
+        case EXPR_LITERAL:
+        case EXPR_VARIABLE:
+            /* A bare value holds when it is a non-zero number */
+            a = code_operand(ec, n);
+            vdbe_add_op(ec->v, negate ? OP_IfNot : OP_If, a, dest, 0);
+            break;
+
+        default:
+            a = code_operand(ec, node->left);
+            b = code_operand(ec, node->right);
+            vdbe_add_op(ec->v, negate ? inverse[node->op - EXPR_EQ]
+                                      : opcodes[node->op - EXPR_EQ], a, dest, b);
+            break;
+    }
+    if (jump_if_null) vdbe_set_p5(ec->v, VDBE_JUMPIFNULL);
+}
+
+static void code_if_true(expr_coder_t *ec, int n, int dest, int jump_if_null)
+{
+    const expr_node_t *node = &ec->tree->nodes[n];
+    int skip;
+
+    switch (node->op) {
+        case EXPR_AND:
+            skip = vdbe_make_label(ec->v);
+            code_if_false(ec, node->left, skip, !jump_if_null);
+            code_if_true(ec, node->right, dest, jump_if_null);
+            vdbe_resolve_label(ec->v, skip);
+            break;
+        case EXPR_OR:
+            code_if_true(ec, node->left, dest, jump_if_null);
+            code_if_true(ec, node->right, dest, jump_if_null);
+            break;
+        case EXPR_NOT:
+            code_if_false(ec, node->left, dest, jump_if_null);
+            break;
+        default:
+            code_test(ec, n, dest, jump_if_null, 0);
+            break;
+    }
+}
+
+static void code_if_false(expr_coder_t *ec, int n, int dest, int jump_if_null)
+{
+    const expr_node_t *node = &ec->tree->nodes[n];
+    int skip;
+
+    switch (node->op) {
+        case EXPR_AND:
+            code_if_false(ec, node->left, dest, jump_if_null);
+            code_if_false(ec, node->right, dest, jump_if_null);
+            break;
+        case EXPR_OR:
+            skip = vdbe_make_label(ec->v);
+            code_if_true(ec, node->left, skip, !jump_if_null);
+            code_if_false(ec, node->right, dest, jump_if_null);
+            vdbe_resolve_label(ec->v, skip);
+            break;
+        case EXPR_NOT:
+            code_if_true(ec, node->left, dest, jump_if_null);
+            break;
+        default:
+            code_test(ec, n, dest, jump_if_null, 1);
+            break;
+    }
+}
+
+/*
+** Emit code that jumps to label unless the expression is true for the
+** current row of cursor (false and unknown both jump)
+*/
+void expr_code_if_false(const expr_tree_t *tree, vdbe_t *v, int cursor, int label)
+{
+    expr_coder_t ec;
+
+    ec.tree = tree;
+    ec.v = v;
+    ec.cursor = cursor;
+    code_if_false(&ec, tree->root, label, 1);
+}
+
+/*
+** Columns the expression reads, one bit per column
+*/
+unsigned int expr_columns(const expr_tree_t *tree)
+{
+    unsigned int mask = 0;
+    int n;
+
+    for (n = 0; n < tree->num_nodes; n++) {
+        if (tree->nodes[n].op == EXPR_COLUMN) mask |= 1u << tree->nodes[n].column;
+    }
+    return mask;
+}
+
+/*
+** Collect conditions from the AND terms at the top of a subtree
+*/
+static int collect_terms(const expr_tree_t *tree, int n, expr_term_t *terms,
+                         int count, int max_terms)
+{
+    const expr_node_t *node = &tree->nodes[n];
+    const expr_node_t *l, *r;
+
+    if (node->op == EXPR_AND) {
+        count = collect_terms(tree, node->left, terms, count, max_terms);
+        return collect_terms(tree, node->right, terms, count, max_terms);
+    }
+    if (node->op < EXPR_EQ || node->op > EXPR_GE || node->op == EXPR_NE ||
+        count == max_terms) {
+        return count;
+    }
+
+    l = &tree->nodes[node->left];
+    r = &tree->nodes[node->right];
+    if (l->op == EXPR_COLUMN && (r->op == EXPR_LITERAL || r->op == EXPR_VARIABLE)) {
+        terms[count].column = l->column;
+        terms[count].op = node->op;
+        terms[count].value = r->value;
+        terms[count].param = r->op == EXPR_VARIABLE ? r->column : 0;
+        count++;
+    } else if ((l->op == EXPR_LITERAL || l->op == EXPR_VARIABLE) && r->op == EXPR_COLUMN) {
+        /* literal op column: turn it around */
+        static const int flipped[] = { 0, 0, EXPR_EQ, EXPR_NE, EXPR_GT, EXPR_GE,
+                                       EXPR_LT, EXPR_LE };
+        terms[count].column = r->column;
+        terms[count].op = flipped[node->op];
+        terms[count].value = l->value;
+        terms[count].param = l->op == EXPR_VARIABLE ? l->column : 0;
+        count++;
+    }
+    return count;
+}
+
+/*
+** Extract the "column op literal" terms ANDed at the top of the expression
+** Every row that satisfies the expression satisfies each term, so the
+** planner may use them to pick rows through an index.
+*/
+int expr_terms(const expr_tree_t *tree, expr_term_t *terms, int max_terms)
+{
+    return collect_terms(tree, tree->root, terms, 0, max_terms);
+}
@@ -0,0 +1,70 @@
+/*
+** SQLite Expressions for RISC OS
+** WHERE clauses compiled once per statement and tested against each row
+**
+** A clause is parsed into a tree of nodes held in one array, with column
+** names already resolved to column numbers and each literal converted
+** with the affinity of the column it is compared against. The tree is
+** then compiled into VM jumps with SQL's three-valued logic: a comparison
+** involving NULL is unknown, and only rows for which the clause is true
+** match.
+**
+** Supported: = == != <> < <= > >=, AND, OR, NOT, IS [NOT] NULL, ISNULL,
+** NOTNULL, [NOT] LIKE, [NOT] BETWEEN, parentheses and ? parameters, which
+** are numbered from 1 in order of appearance.
+*/
+
+#ifndef _EXPR_H_
+#define _EXPR_H_
+
+#include "value.h"
+#include "vdbe.h"
+#include "tokenize.h"
+
+/* Node operators */
+#define EXPR_LITERAL    0
+#define EXPR_COLUMN     1
+#define EXPR_EQ         2
+#define EXPR_NE         3
+#define EXPR_LT         4
+#define EXPR_LE         5
+#define EXPR_GT         6
+#define EXPR_GE         7
+#define EXPR_AND        8
+#define EXPR_OR         9
+#define EXPR_NOT        10
+#define EXPR_ISNULL     11
+#define EXPR_NOTNULL    12
+#define EXPR_LIKE       13
+#define EXPR_VARIABLE   14
+
+typedef struct expr_tree expr_tree_t;
+
+/*
+** Resolve a column name (len bytes, not NUL-terminated)
+** Returns the column number and sets *paffinity, or returns -1.
+*/
+typedef int (*expr_resolve_t)(void *arg, const char *name, int len,
+                              value_affinity_t *paffinity);
+
+/* A "column op literal" condition every matching row satisfies */
+typedef struct {
+    int column;
+    int op;                         /* EXPR_EQ, EXPR_LT ... EXPR_GE */
+    value_t value;
+    int param;                      /* Parameter giving the value at run time, or 0 */
+} expr_term_t;
+
+/* Compilation (leaves the lexer on the token after the expression) */
+int expr_compile(sql_lexer_t *lx, expr_resolve_t resolve, void *arg,
+                 expr_tree_t **ptree, char **errmsg);
+void expr_free(expr_tree_t *tree);
+
+/* Code generation and analysis */
+void expr_code_if_false(const expr_tree_t *tree, vdbe_t *v, int cursor, int label);
+unsigned int expr_columns(const expr_tree_t *tree);
+
+/* Conditions for the planner: top-level AND terms comparing a column with a literal */
+int expr_terms(const expr_tree_t *tree, expr_term_t *terms, int max_terms);
+
+#endif /* _EXPR_H_ */
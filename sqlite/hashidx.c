@@ -0,0 +1,174 @@
+/*
+** SQLite Hash Index for RISC OS
+**
+** Linear probing over a power-of-two slot array kept at most half full.
+** An empty slot has rowid 0. Removal shifts later entries of the probe
+** run back instead of leaving tombstones, so lookups never slow down as
+** rows come and go.
+*/
+
+#include <stdlib.h>
+#include "sqlite.h"
+#include "hashidx.h"
+#include "mem_riscos.h"
+
+/* Slots allocated for a new index */
+#define HASHIDX_INITIAL_SLOTS 32
+
+typedef struct {
+    unsigned int hash;
+    btree_key_t rowid;              /* 0 for an empty slot */
+} hash_slot_t;
+
+struct hashidx {
+    hash_slot_t *slots;
+    unsigned int mask;              /* Slot count - 1 */
+    int count;                      /* Entries in use */
+};
+
+/*
+** Create an empty index
+*/
+hashidx_t *hashidx_create(void)
+{
+    hashidx_t *idx = (hashidx_t *)riscos_calloc(1, sizeof(hashidx_t));
+    if (!idx) return NULL;
+
+    idx->slots = (hash_slot_t *)riscos_calloc(HASHIDX_INITIAL_SLOTS, sizeof(hash_slot_t));
+    if (!idx->slots) {
+        riscos_free(idx);
+        return NULL;
+    }
+    idx->mask = HASHIDX_INITIAL_SLOTS - 1;
+    return idx;
+}
+
+/*
+** Free an index
+*/
+void hashidx_destroy(hashidx_t *idx)
+{
+    if (!idx) return;
+    riscos_free(idx->slots);
+    riscos_free(idx);
+}
+
+/*
+** Place an entry in a slot array known to have room
+*/
+static void place(hash_slot_t *slots, unsigned int mask,
+                  unsigned int hash, btree_key_t rowid)
+{
+    unsigned int i = hash & mask;
+    while (slots[i].rowid != 0) i = (i + 1) & mask;
+    slots[i].hash = hash;
+    slots[i].rowid = rowid;
+}
+
+/*
+** Make sure count entries fit without exceeding half the slots
+** Once this succeeds, inserting up to count entries cannot fail.
+*/
+int hashidx_reserve(hashidx_t *idx, int count)
+{
+    hash_slot_t *slots;
+    unsigned int size = idx->mask + 1;
+    unsigned int i;
+
+    if ((unsigned int)count * 2 <= size) return SQLITE_OK;
+    while ((unsigned int)count * 2 > size) size *= 2;
+
+    slots = (hash_slot_t *)riscos_calloc(size, sizeof(hash_slot_t));
+    if (!slots) return SQLITE_NOMEM;
+
+    for (i = 0; i <= idx->mask; i++) {
+        if (idx->slots[i].rowid != 0) {
+            place(slots, size - 1, idx->slots[i].hash, idx->slots[i].rowid);
+        }
+    }
+    riscos_free(idx->slots);
+    idx->slots = slots;
+    idx->mask = size - 1;
+    return SQLITE_OK;
+}
+
+/*
+** Add a rowid under a key hash
+*/
+int hashidx_insert(hashidx_t *idx, unsigned int hash, btree_key_t rowid)
+{
+    int rc = hashidx_reserve(idx, idx->count + 1);
+    if (rc != SQLITE_OK) return rc;
+
+    place(idx->slots, idx->mask, hash, rowid);
+    idx->count++;
+    return SQLITE_OK;
+}
+
+/*
+** Remove the entry for a rowid
+** Returns SQLITE_NOTFOUND if it is not in the index.
+*/
+int hashidx_remove(hashidx_t *idx, unsigned int hash, btree_key_t rowid)
+{
+    hash_slot_t *slots = idx->slots;
+    unsigned int mask = idx->mask;
+    unsigned int i = hash & mask;
+    unsigned int j;
+
+    while (slots[i].rowid != rowid || slots[i].hash != hash) {
+        if (slots[i].rowid == 0) return SQLITE_NOTFOUND;
+        i = (i + 1) & mask;
+    }
+
+    /* Shift back any later entry whose home slot does not lie in (i, j] */
+    for (j = (i + 1) & mask; slots[j].rowid != 0; j = (j + 1) & mask) {
+        unsigned int home = slots[j].hash & mask;
+        int stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (!stays) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i].rowid = 0;
+    idx->count--;
+    return SQLITE_OK;
+}
+
+/*
+** Number of entries
+*/
+int hashidx_count(hashidx_t *idx)
+{
+    return idx->count;
+}
+
+/*
+** Start iterating the rowids stored under hash
+*/
+void hashidx_probe(hashidx_t *idx, unsigned int hash, hashidx_probe_t *probe)
+{
+    probe->idx = idx;
+    probe->hash = hash;
+    probe->slot = hash & idx->mask;
+}
+
+/*
+** Next rowid stored under the probe's hash
+** Returns 0 when there are no more.
+*/
+int hashidx_next(hashidx_probe_t *probe, btree_key_t *prowid)
+{
+    hash_slot_t *slots = probe->idx->slots;
+    unsigned int mask = probe->idx->mask;
+
+    while (slots[probe->slot].rowid != 0) {
+        hash_slot_t *slot = &slots[probe->slot];
+        probe->slot = (probe->slot + 1) & mask;
+        if (slot->hash == probe->hash) {
+            *prowid = slot->rowid;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+/*
+** SQLite Hash Index for RISC OS
+** Open-addressing hash table mapping key hashes to rowids
+**
+** The index stores only a 32-bit key hash and the rowid of each row, so
+** it stays small whatever the key columns hold. A probe returns every
+** rowid whose key hashes the same; the caller fetches the row and checks
+** the actual key values. Several rows may share a key.
+*/
+
+#ifndef _HASHIDX_H_
+#define _HASHIDX_H_
+
+#include "btree.h"
+
+typedef struct hashidx hashidx_t;
+
+/* Probe state for iterating the rowids stored under one hash */
+typedef struct {
+    hashidx_t *idx;
+    unsigned int hash;
+    unsigned int slot;              /* Next slot to examine */
+} hashidx_probe_t;
+
+/* Index lifecycle */
+hashidx_t *hashidx_create(void);
+void hashidx_destroy(hashidx_t *idx);
+
+/* Maintenance (rowids must be non-zero) */
+int hashidx_reserve(hashidx_t *idx, int count);
+int hashidx_insert(hashidx_t *idx, unsigned int hash, btree_key_t rowid);
+int hashidx_remove(hashidx_t *idx, unsigned int hash, btree_key_t rowid);
+int hashidx_count(hashidx_t *idx);
+
+/* Lookup */
+void hashidx_probe(hashidx_t *idx, unsigned int hash, hashidx_probe_t *probe);
+int hashidx_next(hashidx_probe_t *probe, btree_key_t *prowid);
+
+#endif /* _HASHIDX_H_ */
@@ -0,0 +1,517 @@
+/*
+** SQLite Ordered Index for RISC OS
+**
+** The tree has the same shape as the rowid B-tree (btree.c): separators
+** in interior nodes, every entry in a leaf, full nodes split in two. Here
+** the entries are rowids ordered by (key of the row, rowid), and the leaves
+** also link backwards so descending scans need no stack.
+**
+** A separator is a copy of the first entry of the subtree to its right.
+** Comparisons go through the caller's function, which reads the key from
+** the row; the search key itself is never stored.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "sqlite.h"
+#include "ordidx.h"
+#include "mem_riscos.h"
+
+/* Entries per node (interior and leaf) */
+#define ORDIDX_ORDER 32
+
+struct ord_node {
+    int leaf;                       /* Non-zero for leaf nodes */
+    int nkeys;                      /* Entries or separators in use */
+    btree_key_t keys[ORDIDX_ORDER]; /* Rowids */
+    ord_node_t *ptrs[ORDIDX_ORDER + 1]; /* Children (interior only) */
+    ord_node_t *next;               /* Leaf links, in key order */
+    ord_node_t *prev;
+};
+
+struct ordidx {
+    ord_node_t *root;
+    int count;                      /* Number of entries */
+    int height;                     /* Levels, 1 when the root is a leaf */
+    ord_node_t *spare;              /* Nodes set aside by ordidx_reserve() */
+    int num_spare;
+    ordidx_compare_t compare;
+    void *arg;
+};
+
+/* A position being searched for: a key plus a rowid or a bias */
+typedef struct {
+    const void *key;
+    btree_key_t rowid;
+    int bias;                       /* -1 before all equal keys, +1 after, 0 use rowid */
+} ord_search_t;
+
+/*
+** Compare a search position with an entry
+*/
+static int compare_entry(ordidx_t *idx, const ord_search_t *s, btree_key_t entry)
+{
+    int c = idx->compare(idx->arg, s->key, entry);
+    if (c != 0) return c;
+    if (s->bias != 0) return s->bias;
+    return s->rowid < entry ? -1 : s->rowid > entry;
+}
+
+/*
+** First index in a leaf whose entry is >= the search position
+*/
+static int lower_bound(ordidx_t *idx, ord_node_t *node, const ord_search_t *s)
+{
+    int lo = 0, hi = node->nkeys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (compare_entry(idx, s, node->keys[mid]) > 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/*
+** Child of an interior node that covers the search position
+*/
+static int child_index(ordidx_t *idx, ord_node_t *node, const ord_search_t *s)
+{
+    int lo = 0, hi = node->nkeys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (compare_entry(idx, s, node->keys[mid]) >= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/*
+** Allocate an empty node, from the reserve if there is one
+*/
+static ord_node_t *new_node(ordidx_t *idx, int leaf)
+{
+    ord_node_t *node = idx->spare;
+
+    if (node) {
+        idx->spare = node->next;
+        idx->num_spare--;
+        memset(node, 0, sizeof(ord_node_t));
+    } else {
+        node = (ord_node_t *)riscos_calloc(1, sizeof(ord_node_t));
+        if (!node) return NULL;
+    }
+    node->leaf = leaf;
+    return node;
+}
+
+/*
+** Create an empty index
+*/
+ordidx_t *ordidx_create(ordidx_compare_t compare, void *arg)
+{
+    ordidx_t *idx = (ordidx_t *)riscos_calloc(1, sizeof(ordidx_t));
+    if (!idx) return NULL;
+
+    idx->compare = compare;
+    idx->arg = arg;
+    idx->height = 1;
+    idx->root = new_node(idx, 1);
+    if (!idx->root) {
+        riscos_free(idx);
+        return NULL;
+    }
+    return idx;
+}
+
+/*
+** Free a subtree
+*/
+static void destroy_node(ord_node_t *node)
+{
+    int i;
+
+    if (!node->leaf) {
+        for (i = 0; i <= node->nkeys; i++) destroy_node(node->ptrs[i]);
+    }
+    riscos_free(node);
+}
+
+/*
+** Free an index
+*/
+void ordidx_destroy(ordidx_t *idx)
+{
+    if (!idx) return;
+    destroy_node(idx->root);
+    while (idx->spare) {
+        ord_node_t *next = idx->spare->next;
+        riscos_free(idx->spare);
+        idx->spare = next;
+    }
+    riscos_free(idx);
+}
+
+/*
+** Set aside enough nodes for one insert to split every level
+** Once this succeeds, the next ordidx_insert() cannot fail.
+*/
+int ordidx_reserve(ordidx_t *idx)
+{
+    while (idx->num_spare < idx->height + 1) {
+        ord_node_t *node = (ord_node_t *)riscos_calloc(1, sizeof(ord_node_t));
+        if (!node) return SQLITE_NOMEM;
+        node->next = idx->spare;
+        idx->spare = node;
+        idx->num_spare++;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Insert into a leaf, splitting it if full
+** On a split, *psplit receives the new right-hand node and *psep its first entry.
+*/
+static int leaf_insert(ordidx_t *idx, ord_node_t *leaf, const ord_search_t *s,
+                       ord_node_t **psplit, btree_key_t *psep)
+{
+    ord_node_t *right;
+    int pos = lower_bound(idx, leaf, s);
+    int mid;
+
+    if (pos < leaf->nkeys && leaf->keys[pos] == s->rowid) return SQLITE_CONSTRAINT;
+
+    if (leaf->nkeys < ORDIDX_ORDER) {
+        memmove(&leaf->keys[pos + 1], &leaf->keys[pos],
+                (leaf->nkeys - pos) * sizeof(btree_key_t));
+        leaf->keys[pos] = s->rowid;
+        leaf->nkeys++;
+        return SQLITE_OK;
+    }
+
+    right = new_node(idx, 1);
+    if (!right) return SQLITE_NOMEM;
+
+    /* Appending: leave this leaf full and start a new one */
+    mid = pos == ORDIDX_ORDER ? ORDIDX_ORDER : ORDIDX_ORDER / 2;
+
+    right->nkeys = leaf->nkeys - mid;
+    memcpy(right->keys, &leaf->keys[mid], right->nkeys * sizeof(btree_key_t));
+    leaf->nkeys = mid;
+    right->next = leaf->next;
+    right->prev = leaf;
+    if (leaf->next) leaf->next->prev = right;
+    leaf->next = right;
+
+    if (pos <= mid && pos < ORDIDX_ORDER) {
+        memmove(&leaf->keys[pos + 1], &leaf->keys[pos],
+                (leaf->nkeys - pos) * sizeof(btree_key_t));
+        leaf->keys[pos] = s->rowid;
+        leaf->nkeys++;
+    } else {
+        pos -= mid;
+        memmove(&right->keys[pos + 1], &right->keys[pos],
+                (right->nkeys - pos) * sizeof(btree_key_t));
+        right->keys[pos] = s->rowid;
+        right->nkeys++;
+    }
+
+    *psplit = right;
+    *psep = right->keys[0];
+    return SQLITE_OK;
+}
+
+/*
+** Insert into the subtree rooted at node
+** On a split, *psplit receives the new right-hand sibling and *psep the
+** separator to insert into the parent.
+*/
+static int node_insert(ordidx_t *idx, ord_node_t *node, const ord_search_t *s,
+                       ord_node_t **psplit, btree_key_t *psep)
+{
+    btree_key_t keys[ORDIDX_ORDER + 1];
+    ord_node_t *ptrs[ORDIDX_ORDER + 2];
+    ord_node_t *child_split = NULL;
+    btree_key_t child_sep;
+    ord_node_t *right;
+    int i, mid, n;
+    int rc;
+
+    *psplit = NULL;
+    if (node->leaf) return leaf_insert(idx, node, s, psplit, psep);
+
+    i = child_index(idx, node, s);
+    rc = node_insert(idx, node->ptrs[i], s, &child_split, &child_sep);
+    if (rc != SQLITE_OK || !child_split) return rc;
+
+    /* Room for the new separator */
+    if (node->nkeys < ORDIDX_ORDER) {
+        memmove(&node->keys[i + 1], &node->keys[i],
+                (node->nkeys - i) * sizeof(btree_key_t));
+        memmove(&node->ptrs[i + 2], &node->ptrs[i + 1],
+                (node->nkeys - i) * sizeof(ord_node_t *));
+        node->keys[i] = child_sep;
+        node->ptrs[i + 1] = child_split;
+        node->nkeys++;
+        return SQLITE_OK;
+    }
+
+    /* Split a full interior node: merge into scratch arrays, then divide */
+    right = new_node(idx, 0);
+    if (!right) return SQLITE_NOMEM;
+
+    n = node->nkeys;
+    memcpy(keys, node->keys, i * sizeof(btree_key_t));
+    keys[i] = child_sep;
+    memcpy(&keys[i + 1], &node->keys[i], (n - i) * sizeof(btree_key_t));
+    memcpy(ptrs, node->ptrs, (i + 1) * sizeof(ord_node_t *));
+    ptrs[i + 1] = child_split;
+    memcpy(&ptrs[i + 2], &node->ptrs[i + 1], (n - i) * sizeof(ord_node_t *));
+    n++;
+
+    /* Appending: keep this node full and push only the new entry up */
+    mid = i == ORDIDX_ORDER ? ORDIDX_ORDER : n / 2;
+
+    node->nkeys = mid;
+    memcpy(node->keys, keys, mid * sizeof(btree_key_t));
+    memcpy(node->ptrs, ptrs, (mid + 1) * sizeof(ord_node_t *));
+
+    right->nkeys = n - mid - 1;
+    memcpy(right->keys, &keys[mid + 1], right->nkeys * sizeof(btree_key_t));
+    memcpy(right->ptrs, &ptrs[mid + 1], (right->nkeys + 1) * sizeof(ord_node_t *));
+
+    *psplit = right;
+    *psep = keys[mid];
+    return SQLITE_OK;
+}
+
+/*
+** Add a row under its key
+** Returns SQLITE_CONSTRAINT if the rowid is already present.
+*/
+int ordidx_insert(ordidx_t *idx, const void *key, btree_key_t rowid)
+{
+    ord_node_t *root = NULL;
+    ord_node_t *split;
+    btree_key_t sep;
+    ord_search_t s;
+    int rc;
+
+    s.key = key;
+    s.rowid = rowid;
+    s.bias = 0;
+
+    /* A full root may split; allocate its new parent up front */
+    if (idx->root->nkeys == ORDIDX_ORDER) {
+        root = new_node(idx, 0);
+        if (!root) return SQLITE_NOMEM;
+    }
+
+    rc = node_insert(idx, idx->root, &s, &split, &sep);
+    if (rc != SQLITE_OK) {
+        if (root) riscos_free(root);
+        return rc;
+    }
+
+    if (split) {
+        /* Root split: grow the tree by one level */
+        root->nkeys = 1;
+        root->keys[0] = sep;
+        root->ptrs[0] = idx->root;
+        root->ptrs[1] = split;
+        idx->root = root;
+        idx->height++;
+    } else if (root) {
+        root->next = idx->spare;
+        idx->spare = root;
+        idx->num_spare++;
+    }
+
+    idx->count++;
+    return SQLITE_OK;
+}
+
+/*
+** First entry of a subtree
+*/
+static btree_key_t first_entry(ord_node_t *node)
+{
+    while (!node->leaf) node = node->ptrs[0];
+    return node->keys[0];
+}
+
+/*
+** Remove an entry from the subtree rooted at node
+** Returns non-zero if the node is left empty, in which case the caller
+** frees it. A separator naming the entry is replaced by the new first
+** entry of its subtree, since comparing with it would read a row that
+** may be gone.
+*/
+static int node_remove(ordidx_t *idx, ord_node_t *node, const ord_search_t *s,
+                       int *pfound)
+{
+    ord_node_t *child;
+    int i;
+
+    if (node->leaf) {
+        i = lower_bound(idx, node, s);
+        if (i >= node->nkeys || node->keys[i] != s->rowid) return 0;
+        memmove(&node->keys[i], &node->keys[i + 1],
+                (node->nkeys - i - 1) * sizeof(btree_key_t));
+        node->nkeys--;
+        *pfound = 1;
+        return node->nkeys == 0;
+    }
+
+    i = child_index(idx, node, s);
+    child = node->ptrs[i];
+    if (node_remove(idx, child, s, pfound)) {
+        if (child->leaf) {
+            if (child->prev) child->prev->next = child->next;
+            if (child->next) child->next->prev = child->prev;
+        }
+        riscos_free(child);
+        if (node->nkeys == 0) return 1;
+
+        /* Drop the child and the separator on its left (or right, if first) */
+        if (i > 0) {
+            memmove(&node->keys[i - 1], &node->keys[i],
+                    (node->nkeys - i) * sizeof(btree_key_t));
+        } else {
+            memmove(&node->keys[0], &node->keys[1],
+                    (node->nkeys - 1) * sizeof(btree_key_t));
+        }
+        memmove(&node->ptrs[i], &node->ptrs[i + 1],
+                (node->nkeys - i) * sizeof(ord_node_t *));
+        node->nkeys--;
+    } else if (i > 0 && *pfound && node->keys[i - 1] == s->rowid) {
+        node->keys[i - 1] = first_entry(child);
+    }
+    return 0;
+}
+
+/*
+** Remove a row (key is the key of the row, which must still be readable)
+** Returns SQLITE_NOTFOUND if the row is not in the index.
+*/
+int ordidx_remove(ordidx_t *idx, const void *key, btree_key_t rowid)
+{
+    ord_node_t *root;
+    ord_search_t s;
+    int found = 0;
+
+    s.key = key;
+    s.rowid = rowid;
+    s.bias = 0;
+
+    if (node_remove(idx, idx->root, &s, &found) && !idx->root->leaf) {
+        memset(idx->root, 0, sizeof(ord_node_t));
+        idx->root->leaf = 1;
+        idx->height = 1;
+    }
+
+    /* Drop levels left with a single child */
+    while (!idx->root->leaf && idx->root->nkeys == 0) {
+        root = idx->root;
+        idx->root = root->ptrs[0];
+        riscos_free(root);
+        idx->height--;
+    }
+
+    if (!found) return SQLITE_NOTFOUND;
+    idx->count--;
+    return SQLITE_OK;
+}
+
+/*
+** Number of entries
+*/
+int ordidx_count(ordidx_t *idx)
+{
+    return idx->count;
+}
+
+/*
+** Position a cursor on the first entry
+** Returns non-zero if the cursor points at an entry.
+*/
+int ordidx_first(ordidx_t *idx, ordidx_cursor_t *cur)
+{
+    ord_node_t *node = idx->root;
+    while (!node->leaf) node = node->ptrs[0];
+
+    cur->leaf = node->nkeys ? node : NULL;
+    cur->idx = 0;
+    return cur->leaf != NULL;
+}
+
+/*
+** Position a cursor on the last entry
+** Returns non-zero if the cursor points at an entry.
+*/
+int ordidx_last(ordidx_t *idx, ordidx_cursor_t *cur)
+{
+    ord_node_t *node = idx->root;
+    while (!node->leaf) node = node->ptrs[node->nkeys];
+
+    cur->leaf = node->nkeys ? node : NULL;
+    cur->idx = node->nkeys - 1;
+    return cur->leaf != NULL;
+}
+
+/*
+** Position a cursor on the first entry whose key is >= key, or > key
+** if after is set
+** Returns non-zero if the cursor points at an entry.
+*/
+int ordidx_seek(ordidx_t *idx, const void *key, int after, ordidx_cursor_t *cur)
+{
+    ord_node_t *node = idx->root;
+    ord_search_t s;
+
+    s.key = key;
+    s.rowid = 0;
+    s.bias = after ? 1 : -1;
+
+    while (!node->leaf) node = node->ptrs[child_index(idx, node, &s)];
+
+    cur->leaf = node;
+    cur->idx = lower_bound(idx, node, &s);
+    if (cur->idx >= node->nkeys) {
+        cur->leaf = node->next;
+        cur->idx = 0;
+    }
+    return cur->leaf != NULL;
+}
+
+/*
+** Advance to the next entry
+** Returns non-zero if the cursor still points at an entry.
+*/
+int ordidx_next(ordidx_cursor_t *cur)
+{
+    if (!cur->leaf) return 0;
+    if (++cur->idx >= cur->leaf->nkeys) {
+        cur->leaf = cur->leaf->next;
+        cur->idx = 0;
+    }
+    return cur->leaf != NULL;
+}
+
+/*
+** Step back to the previous entry
+** Returns non-zero if the cursor still points at an entry.
+*/
+int ordidx_prev(ordidx_cursor_t *cur)
+{
+    if (!cur->leaf) return 0;
+    if (--cur->idx < 0) {
+        cur->leaf = cur->leaf->prev;
+        cur->idx = cur->leaf ? cur->leaf->nkeys - 1 : 0;
+    }
+    return cur->leaf != NULL;
+}
+
+btree_key_t ordidx_cursor_rowid(ordidx_cursor_t *cur)
+{
+    return cur->leaf->keys[cur->idx];
+}
@@ -0,0 +1,49 @@
+/*
+** SQLite Ordered Index for RISC OS
+** B+tree of rowids kept in key order, with leaves linked both ways
+**
+** Like the hash index, the tree stores only rowids: the key of an entry is
+** read back from its row through a comparison function supplied by the
+** caller, so an entry costs eight bytes whatever the key columns hold.
+** Entries with equal keys are kept in rowid order.
+*/
+
+#ifndef _ORDIDX_H_
+#define _ORDIDX_H_
+
+#include "btree.h"
+
+typedef struct ordidx ordidx_t;
+typedef struct ord_node ord_node_t;
+
+/*
+** Compare a search key with the key of the row stored under rowid
+** Returns <0, 0 or >0 as the search key sorts before, with or after it.
+*/
+typedef int (*ordidx_compare_t)(void *arg, const void *key, btree_key_t rowid);
+
+/* Cursor for traversal in either direction */
+typedef struct {
+    ord_node_t *leaf;               /* Current leaf, NULL when off either end */
+    int idx;                        /* Entry within the leaf */
+} ordidx_cursor_t;
+
+/* Index lifecycle */
+ordidx_t *ordidx_create(ordidx_compare_t compare, void *arg);
+void ordidx_destroy(ordidx_t *idx);
+
+/* Maintenance (key is the key of the row being added) */
+int ordidx_reserve(ordidx_t *idx);
+int ordidx_insert(ordidx_t *idx, const void *key, btree_key_t rowid);
+int ordidx_remove(ordidx_t *idx, const void *key, btree_key_t rowid);
+int ordidx_count(ordidx_t *idx);
+
+/* Traversal */
+int ordidx_first(ordidx_t *idx, ordidx_cursor_t *cur);
+int ordidx_last(ordidx_t *idx, ordidx_cursor_t *cur);
+int ordidx_seek(ordidx_t *idx, const void *key, int after, ordidx_cursor_t *cur);
+int ordidx_next(ordidx_cursor_t *cur);
+int ordidx_prev(ordidx_cursor_t *cur);
+btree_key_t ordidx_cursor_rowid(ordidx_cursor_t *cur);
+
+#endif /* _ORDIDX_H_ */
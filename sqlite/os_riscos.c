@@ -4,6 +4,13 @@
 ** Provides file I/O access using RISC OS SWI calls instead of standard C I/O.
 ** This allows SQLite to work within the RISC OS environment on ARM2 with 4MB RAM.
 **
+** The SWIs are one backend behind the riscos_vfs_t table (see os_riscos.h).
+** Built without RISCOS (Linux and other hosts), the native backend uses
+** POSIX file descriptors instead: pread and pwrite at the position kept
+** in riscos_file_t, so a seek costs no system call, and fdatasync. The
+** "memory" backend is always present and keeps each file in one heap
+** block; it backs ":memory:" databases.
+**
 ** Build flags: -DRISCOS -D__riscos__
 ** ARM2 flags: -march=armv2 -mapcs-26
 */
@@ -17,9 +24,17 @@
 #ifdef RISCOS
 #include <kernel.h>
 #include <swis.h>
+#else
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/uio.h>
+#endif
 #endif
 
 #include "os_riscos.h"
+#include "mem_riscos.h"
 
 /*
 ** Translation from Unix paths to RISC OS format
@@ -93,21 +108,54 @@ void riscos_free_path(char *path)
     if (path) free(path);
 }
 
+#ifdef RISCOS
 /*
-** Open a file on RISC OS using OS_Find SWI
-**
-** flags: O_RDONLY, O_WRONLY, O_RDWR from fcntl.h equivalents
-** Returns: 0 on success, -1 on error
+** RISC OS backend
 */
-int riscos_vfs_open(const char *path, int flags, riscos_file_t *file)
+
+/*
+** Call OS_Find to open a file; returns the handle, or 0 on failure
+*/
+static int riscos_find(const char *riscos_path, int reason_code)
+{
+    _kernel_swi_regs regs;
+
+    regs.r[0] = reason_code;
+    regs.r[1] = (int)riscos_path;
+    if (_kernel_swi(OS_Find, &regs, &regs)) return 0;
+    return regs.r[0];
+}
+
+/*
+** Read the type of the object at a path with OS_File 17
+** Returns 0 if nothing is there, 1 for a file, 2 for a directory, or -1
+** if it cannot be read.
+*/
+static int riscos_object_type(const char *riscos_path)
+{
+    _kernel_swi_regs regs;
+
+    regs.r[0] = 17;
+    regs.r[1] = (int)riscos_path;
+    if (_kernel_swi(OS_File, &regs, &regs)) return -1;
+    return regs.r[0];
+}
+
+/*
+** Open a file using OS_Find
+** flags: O_RDONLY, O_WRONLY, O_RDWR from fcntl.h equivalents, and O_CREAT
+** OS_Find only creates files when opening them for output, which also
+** truncates them. A file opened with O_CREAT is created that way, closed
+** and opened again, but only once OS_File has confirmed it is missing; any
+** other failure is returned as it is.
+*/
+static int riscos_open(riscos_vfs_t *vfs, const char *path, int flags,
+                       riscos_file_t *file)
 {
-#ifdef RISCOS
     _kernel_swi_regs regs;
-    _kernel_oserror *err;
     char *riscos_path;
     int reason_code = OSFIND_OPENREAD;
-
-    if (!path || !file) return -1;
+    int handle;
 
     /* Translate Unix path to RISC OS format */
     riscos_path = riscos_translate_path(path);
@@ -120,127 +168,803 @@ int riscos_vfs_open(const char *path, int flags, riscos_file_t *file)
         reason_code = OSFIND_OPENUPDATE;
     }
 
-    /* Call OS_Find */
-    regs.r[0] = reason_code;
-    regs.r[1] = (int)riscos_path;
-
-    err = _kernel_swi(OS_Find, &regs, &regs);
+    handle = riscos_find(riscos_path, reason_code);
+    if (handle == 0 && (flags & O_CREAT) && reason_code != OSFIND_OPENWRITE &&
+        riscos_object_type(riscos_path) == 0) {
+        handle = riscos_find(riscos_path, OSFIND_OPENWRITE);
+        if (handle != 0) {
+            regs.r[0] = OSFIND_CLOSE;
+            regs.r[1] = handle;
+            _kernel_swi(OS_Find, &regs, &regs);
+            handle = riscos_find(riscos_path, reason_code);
+        }
+    }
 
     riscos_free_path(riscos_path);
 
-    if (err || regs.r[0] == 0) {
+    if (handle == 0) {
         return -1;  /* Failed to open */
     }
 
-    file->handle = regs.r[0];
-    file->file_pos = 0;
-    file->file_size = 0;
-
+    file->handle = handle;
     return 0;
-#else
-    /* Stub for non-RISC OS systems */
-    return -1;
-#endif
 }
 
 /*
-** Close a file on RISC OS
+** Close a file with OS_Find 0
 */
-int riscos_vfs_close(riscos_file_t *file)
+static int riscos_close(riscos_file_t *file)
 {
-#ifdef RISCOS
     _kernel_swi_regs regs;
-    _kernel_oserror *err;
 
-    if (!file || file->handle == 0) return -1;
-
-    /* Call OS_Find with reason code 0 (close) */
     regs.r[0] = OSFIND_CLOSE;
     regs.r[1] = file->handle;
-
-    err = _kernel_swi(OS_Find, &regs, &regs);
-
-    file->handle = 0;
-    return err ? -1 : 0;
-#else
-    return -1;
-#endif
+    return _kernel_swi(OS_Find, &regs, &regs) ? -1 : 0;
 }
 
 /*
-** Read bytes from file using OS_GBPB SWI
-** Returns number of bytes read, -1 on error
+** Read or write at an offset with OS_GBPB 3 or 1, which take the file
+** pointer in r4, so no OS_Args call is needed to move it first
 */
-int riscos_vfs_read(riscos_file_t *file, void *buf, int count)
+static int riscos_transfer(riscos_file_t *file, void *buf, int count, int offset,
+                           int reason)
 {
-#ifdef RISCOS
     _kernel_swi_regs regs;
-    _kernel_oserror *err;
-
-    if (!file || !buf || file->handle == 0) return -1;
 
-    /* Call OS_GBPB 4 (read from file pointer) */
-    regs.r[0] = 4;                     /* Reason code: read from file pointer */
+    regs.r[0] = reason;
     regs.r[1] = file->handle;
     regs.r[2] = (int)buf;
     regs.r[3] = count;
+    regs.r[4] = offset;
+    if (_kernel_swi(OS_GBPB, &regs, &regs)) return -1;
 
-    err = _kernel_swi(OS_GBPB, &regs, &regs);
+    /* r[3] contains number of bytes NOT transferred */
+    return count - regs.r[3];
+}
 
-    if (err) return -1;
+static int riscos_read(riscos_file_t *file, void *buf, int count, int offset)
+{
+    return riscos_transfer(file, buf, count, offset, 3);
+}
 
-    /* r[3] contains number of bytes NOT transferred */
-    int bytes_read = count - regs.r[3];
-    file->file_pos += bytes_read;
+static int riscos_write(riscos_file_t *file, const void *buf, int count, int offset)
+{
+    return riscos_transfer(file, (void *)buf, count, offset, 1);
+}
 
-    return bytes_read;
-#else
-    return -1;
-#endif
+/*
+** Ensure buffered data is written with OS_Args 255
+** RISC OS 3.1 doesn't guarantee this will work, so failure is ignored
+*/
+static int riscos_sync(riscos_file_t *file)
+{
+    _kernel_swi_regs regs;
+
+    regs.r[0] = 255;
+    regs.r[1] = file->handle;
+    _kernel_swi(OS_Args, &regs, &regs);
+    return 0;
 }
 
 /*
-** Write bytes to file using OS_GBPB SWI
-** Returns number of bytes written, -1 on error
+** Read the file extent with OS_Args 2
 */
-int riscos_vfs_write(riscos_file_t *file, const void *buf, int count)
+static int riscos_size(riscos_file_t *file)
 {
-#ifdef RISCOS
     _kernel_swi_regs regs;
-    _kernel_oserror *err;
 
-    if (!file || !buf || file->handle == 0) return -1;
+    regs.r[0] = 2;
+    regs.r[1] = file->handle;
+    if (_kernel_swi(OS_Args, &regs, &regs)) return -1;
+    return regs.r[2];
+}
+
+/*
+** Set the file extent with OS_Args 3
+*/
+static int riscos_truncate(riscos_file_t *file, int size)
+{
+    _kernel_swi_regs regs;
 
-    /* Call OS_GBPB 2 (write from file pointer) */
-    regs.r[0] = 2;                     /* Reason code: write from file pointer */
+    regs.r[0] = 3;
     regs.r[1] = file->handle;
-    regs.r[2] = (int)buf;
-    regs.r[3] = count;
+    regs.r[2] = size;
+    return _kernel_swi(OS_Args, &regs, &regs) ? -1 : 0;
+}
 
-    err = _kernel_swi(OS_GBPB, &regs, &regs);
+/*
+** RISC OS 3.1 has no file locking; every lock is granted
+*/
+static int riscos_lock(riscos_file_t *file, int level)
+{
+    return 0;
+}
+
+/*
+** Delete a file with OS_File 6
+*/
+static int riscos_remove(riscos_vfs_t *vfs, const char *path)
+{
+    _kernel_swi_regs regs;
+    _kernel_oserror *err;
+    char *riscos_path;
 
-    if (err) return -1;
+    riscos_path = riscos_translate_path(path);
+    if (!riscos_path) return -1;
 
-    /* r[3] contains number of bytes NOT transferred */
-    int bytes_written = count - regs.r[3];
-    file->file_pos += bytes_written;
+    regs.r[0] = 6;
+    regs.r[1] = (int)riscos_path;
+
+    err = _kernel_swi(OS_File, &regs, &regs);
+
+    riscos_free_path(riscos_path);
+
+    return err ? -1 : 0;
+}
+
+static riscos_vfs_t memory_vfs;
+
+/* No writev: runs are gathered into one block for a single OS_GBPB */
+static riscos_vfs_t native_vfs = {
+    "riscos", riscos_open, riscos_close, riscos_read, riscos_write, NULL, riscos_sync,
+    riscos_size, riscos_truncate, riscos_lock, riscos_remove, RISCOS_VFS_BLOCK_SIZE,
+    NULL, &memory_vfs
+};
+
+#else
+/*
+** POSIX backend
+*/
+
+/* A handle of 0 means closed, so the descriptor is stored plus one */
+#define POSIX_FD(file) ((file)->handle - 1)
 
-    return bytes_written;
+#ifdef __APPLE__
+#define fdatasync fsync             /* Darwin has no fdatasync */
+#endif
+
+static int posix_open(riscos_vfs_t *vfs, const char *path, int flags,
+                      riscos_file_t *file)
+{
+    int fd;
+
+    do {
+        fd = open(path, flags, 0644);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) return -1;
+
+    file->handle = fd + 1;
+    return 0;
+}
+
+static int posix_close(riscos_file_t *file)
+{
+    return close(POSIX_FD(file)) == 0 ? 0 : -1;
+}
+
+/*
+** Transfer count bytes at offset, retrying short transfers
+*/
+static int posix_transfer(riscos_file_t *file, void *buf, int count, int offset,
+                          int write)
+{
+    int done = 0;
+    ssize_t n;
+
+    while (done < count) {
+        if (write) {
+            n = pwrite(POSIX_FD(file), (char *)buf + done, count - done,
+                       offset + done);
+        } else {
+            n = pread(POSIX_FD(file), (char *)buf + done, count - done,
+                      offset + done);
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        done += (int)n;
+    }
+    return done;
+}
+
+static int posix_read(riscos_file_t *file, void *buf, int count, int offset)
+{
+    return posix_transfer(file, buf, count, offset, 0);
+}
+
+static int posix_write(riscos_file_t *file, const void *buf, int count, int offset)
+{
+    return posix_transfer(file, (void *)buf, count, offset, 1);
+}
+
+#ifdef __linux__
+/* Pieces passed to each pwritev */
+#define POSIX_IOV_BATCH 32
+
+/*
+** Write a run of pieces with pwritev
+*/
+static int posix_writev(riscos_file_t *file, const riscos_iovec_t *vec, int count)
+{
+    struct iovec iov[POSIX_IOV_BATCH];
+    ssize_t n;
+    int i, k, len;
+
+    for (i = 0; i < count; i += k) {
+        len = 0;
+        for (k = 0; k < POSIX_IOV_BATCH && i + k < count; k++) {
+            iov[k].iov_base = (void *)vec[i + k].buf;
+            iov[k].iov_len = vec[i + k].len;
+            len += vec[i + k].len;
+        }
+        do {
+            n = pwritev(POSIX_FD(file), iov, k, vec[i].offset);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) return -1;
+        if (n == len) continue;
+
+        /* Short: finish the piece it stopped in, and go on after it */
+        for (k = 0; n >= vec[i + k].len; k++) n -= vec[i + k].len;
+        if (posix_transfer(file, (char *)vec[i + k].buf + n, vec[i + k].len - (int)n,
+                           vec[i + k].offset + (int)n, 1) != vec[i + k].len - n) {
+            return -1;
+        }
+        k++;
+    }
+    return 0;
+}
 #else
-    return -1;
+#define posix_writev NULL
 #endif
+
+static int posix_sync(riscos_file_t *file)
+{
+    int rc;
+
+    do {
+        rc = fdatasync(POSIX_FD(file));
+    } while (rc != 0 && errno == EINTR);
+    return rc == 0 ? 0 : -1;
+}
+
+static int posix_size(riscos_file_t *file)
+{
+    struct stat st;
+
+    if (fstat(POSIX_FD(file), &st) != 0) return -1;
+    return (int)st.st_size;
+}
+
+static int posix_truncate(riscos_file_t *file, int size)
+{
+    return ftruncate(POSIX_FD(file), size) == 0 ? 0 : -1;
+}
+
+/*
+** flock rather than fcntl locks: those belong to the process, so a second
+** open in the same process would neither conflict nor keep its lock when
+** the first is closed
+*/
+static int posix_lock(riscos_file_t *file, int level)
+{
+    int op = level == RISCOS_LOCK_NONE ? LOCK_UN : LOCK_EX | LOCK_NB;
+    int rc;
+
+    do {
+        rc = flock(POSIX_FD(file), op);
+    } while (rc != 0 && errno == EINTR);
+    return rc == 0 ? 0 : -1;
+}
+
+static int posix_remove(riscos_vfs_t *vfs, const char *path)
+{
+    return unlink(path) == 0 ? 0 : -1;
+}
+
+static riscos_vfs_t memory_vfs;
+
+static riscos_vfs_t native_vfs = {
+    "posix", posix_open, posix_close, posix_read, posix_write, posix_writev, posix_sync,
+    posix_size, posix_truncate, posix_lock, posix_remove, RISCOS_VFS_BLOCK_SIZE,
+    NULL, &memory_vfs
+};
+
+#endif /* RISCOS */
+
+/*
+** Memory backend
+** Each open creates a new, empty file in one heap block, private to that
+** handle and freed when it is closed; nothing is shared by name, so
+** opening without O_CREAT fails and removing a file does nothing.
+*/
+
+typedef struct {
+    unsigned char *data;
+    int size;                       /* Bytes in the file */
+    int capacity;                   /* Bytes allocated */
+} mem_file_t;
+
+/* Smallest allocation for a memory file */
+#define MEM_FILE_MIN_CAPACITY 4096
+
+static int memory_open(riscos_vfs_t *vfs, const char *path, int flags,
+                       riscos_file_t *file)
+{
+    if (!(flags & O_CREAT)) return -1;
+
+    file->data = riscos_calloc(1, sizeof(mem_file_t));
+    if (!file->data) return -1;
+    file->handle = 1;
+    return 0;
+}
+
+static int memory_close(riscos_file_t *file)
+{
+    mem_file_t *mf = (mem_file_t *)file->data;
+
+    riscos_free(mf->data);
+    riscos_free(mf);
+    return 0;
+}
+
+static int memory_read(riscos_file_t *file, void *buf, int count, int offset)
+{
+    mem_file_t *mf = (mem_file_t *)file->data;
+    int avail = mf->size - offset;
+
+    if (avail <= 0) return 0;
+    if (count > avail) count = avail;
+    memcpy(buf, mf->data + offset, count);
+    return count;
+}
+
+static int memory_write(riscos_file_t *file, const void *buf, int count, int offset)
+{
+    mem_file_t *mf = (mem_file_t *)file->data;
+    int end = offset + count;
+
+    if (end > mf->capacity) {
+        int capacity = mf->capacity ? mf->capacity : MEM_FILE_MIN_CAPACITY;
+        unsigned char *data;
+
+        while (capacity < end) capacity *= 2;
+        data = (unsigned char *)riscos_realloc(mf->data, capacity);
+        if (!data) return -1;
+        mf->data = data;
+        mf->capacity = capacity;
+    }
+
+    /* Writing past the end leaves a hole of zeroes */
+    if (offset > mf->size) {
+        memset(mf->data + mf->size, 0, offset - mf->size);
+    }
+    memcpy(mf->data + offset, buf, count);
+    if (end > mf->size) mf->size = end;
+    return count;
+}
+
+static int memory_writev(riscos_file_t *file, const riscos_iovec_t *vec, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (memory_write(file, vec[i].buf, vec[i].len, vec[i].offset) != vec[i].len) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int memory_sync(riscos_file_t *file)
+{
+    return 0;
+}
+
+static int memory_size(riscos_file_t *file)
+{
+    return ((mem_file_t *)file->data)->size;
+}
+
+static int memory_truncate(riscos_file_t *file, int size)
+{
+    mem_file_t *mf = (mem_file_t *)file->data;
+
+    if (size < mf->size) mf->size = size;
+    return 0;
+}
+
+static int memory_lock(riscos_file_t *file, int level)
+{
+    return 0;
+}
+
+static int memory_remove(riscos_vfs_t *vfs, const char *path)
+{
+    return 0;
+}
+
+static riscos_vfs_t memory_vfs = {
+    "memory", memory_open, memory_close, memory_read, memory_write, memory_writev,
+    memory_sync,
+    memory_size, memory_truncate, memory_lock, memory_remove, 0, NULL, NULL
+};
+
+/*
+** Registered backends, the default first
+*/
+static riscos_vfs_t *vfs_list = &native_vfs;
+
+/*
+** Find a backend by name, or the default one if name is NULL
+*/
+riscos_vfs_t *riscos_vfs_find(const char *name)
+{
+    riscos_vfs_t *vfs;
+
+    if (!name) return vfs_list;
+    for (vfs = vfs_list; vfs; vfs = vfs->next) {
+        if (strcmp(vfs->name, name) == 0) return vfs;
+    }
+    return NULL;
+}
+
+/*
+** Remove a backend from the list (files open through it stay usable)
+*/
+void riscos_vfs_unregister(riscos_vfs_t *vfs)
+{
+    riscos_vfs_t **link;
+
+    for (link = &vfs_list; *link; link = &(*link)->next) {
+        if (*link == vfs) {
+            *link = vfs->next;
+            return;
+        }
+    }
+}
+
+/*
+** Add a backend, or move one already registered; the default backend is
+** the first in the list
+*/
+int riscos_vfs_register(riscos_vfs_t *vfs, int make_default)
+{
+    riscos_vfs_t **link;
+
+    if (!vfs || !vfs->name) return -1;
+
+    riscos_vfs_unregister(vfs);
+    if (make_default || !vfs_list) {
+        vfs->next = vfs_list;
+        vfs_list = vfs;
+    } else {
+        for (link = &vfs_list->next; *link; link = &(*link)->next) ;
+        vfs->next = NULL;
+        *link = vfs;
+    }
+    return 0;
+}
+
+/*
+** Buffering
+** The buffer holds buf_len bytes of the file from buf_start. If dirty they
+** differ from the file, and are written by flush_buffer before any other
+** part of the file is transferred.
+*/
+
+/*
+** Write back the buffer if dirty
+** On failure the buffered bytes are dropped, so that a later flush does
+** not write them after the caller has given up on them.
+*/
+static int flush_buffer(riscos_file_t *file)
+{
+    int n;
+
+    if (!file->buf_dirty) return 0;
+
+    file->buf_dirty = 0;
+    n = file->vfs->write(file, file->buf, file->buf_len, file->buf_start);
+    if (n != file->buf_len) {
+        file->buf_len = 0;
+        n = file->vfs->size(file);
+        if (n >= 0) file->file_size = n;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+** Allocate the buffer on first use; returns 0 if the file is unbuffered
+*/
+static int have_buffer(riscos_file_t *file)
+{
+    if (file->buf_size == 0) return 0;
+    if (!file->buf) {
+        file->buf = (unsigned char *)riscos_malloc(file->buf_size);
+        if (!file->buf) {
+            file->buf_size = 0;
+            return 0;
+        }
+        file->buf_len = 0;
+    }
+    return 1;
+}
+
+/*
+** Read count bytes at offset, from the buffer where it holds them
+** Blocks are read whole and aligned to the buffer size, so a file read
+** from the front is read a block at a time; a read as large as the buffer
+** goes straight to the backend.
+*/
+static int buffered_read(riscos_file_t *file, int offset, unsigned char *buf, int count)
+{
+    int done = 0;
+    int n;
+
+    while (done < count) {
+        if (offset >= file->buf_start && offset < file->buf_start + file->buf_len) {
+            n = file->buf_start + file->buf_len - offset;
+            if (n > count - done) n = count - done;
+            memcpy(buf + done, file->buf + (offset - file->buf_start), n);
+            done += n;
+            offset += n;
+            continue;
+        }
+
+        if (flush_buffer(file) != 0) return -1;
+
+        if (count - done >= file->buf_size) {
+            n = file->vfs->read(file, buf + done, count - done, offset);
+            if (n < 0) return -1;
+            return done + n;
+        }
+
+        file->buf_start = offset - offset % file->buf_size;
+        n = file->vfs->read(file, file->buf, file->buf_size, file->buf_start);
+        if (n < 0) {
+            file->buf_len = 0;
+            return -1;
+        }
+        file->buf_len = n;
+        if (offset >= file->buf_start + n) break;   /* End of file */
+    }
+    return done;
+}
+
+/*
+** Write count bytes at offset into the buffer
+** A write that continues the buffered bytes is added to them; any other
+** starts the buffer again at its offset, after writing back the old
+** contents. A write as large as the buffer goes straight to the backend.
+*/
+static int buffered_write(riscos_file_t *file, int offset, const unsigned char *buf,
+                          int count)
+{
+    int done = 0;
+    int n;
+
+    while (done < count) {
+        if (offset >= file->buf_start && offset <= file->buf_start + file->buf_len &&
+            offset < file->buf_start + file->buf_size && file->buf_len > 0) {
+            n = file->buf_start + file->buf_size - offset;
+            if (n > count - done) n = count - done;
+            memcpy(file->buf + (offset - file->buf_start), buf + done, n);
+            if (offset + n > file->buf_start + file->buf_len) {
+                file->buf_len = offset + n - file->buf_start;
+            }
+            file->buf_dirty = 1;
+            done += n;
+            offset += n;
+            continue;
+        }
+
+        if (flush_buffer(file) != 0) return -1;
+
+        if (count - done >= file->buf_size) {
+            file->buf_len = 0;
+            n = file->vfs->write(file, buf + done, count - done, offset);
+            if (n < 0) return -1;
+            return done + n;
+        }
+
+        /* Start again at offset with nothing held */
+        file->buf_start = offset;
+        file->buf_len = 0;
+        memcpy(file->buf, buf + done, count - done);
+        file->buf_len = count - done;
+        file->buf_dirty = 1;
+        done = count;
+    }
+    return done;
+}
+
+/*
+** Write a run of pieces that follow on from one another
+** Without a backend writev the run is copied into one block (the file's
+** buffer if no larger one can be had) and written a block at a time.
+*/
+static int write_run(riscos_file_t *file, const riscos_iovec_t *vec, int count)
+{
+    unsigned char *block;
+    int size, total, used, offset, i, done, n;
+
+    if (count == 1) {
+        return file->vfs->write(file, vec[0].buf, vec[0].len, vec[0].offset) ==
+               vec[0].len ? 0 : -1;
+    }
+    if (file->vfs->writev) return file->vfs->writev(file, vec, count);
+
+    total = 0;
+    for (i = 0; i < count; i++) total += vec[i].len;
+    size = total < RISCOS_VFS_GATHER_SIZE ? total : RISCOS_VFS_GATHER_SIZE;
+    block = (unsigned char *)riscos_malloc(size);
+    if (!block && file->buf) {
+        size = file->buf_size;
+    }
+
+    offset = vec[0].offset;
+    used = 0;
+    i = 0;
+    done = 0;
+    while (i < count) {
+        if (!block && !file->buf) {
+            /* No memory to gather in: one transfer per piece */
+            n = vec[i].len - done;
+            if (file->vfs->write(file, (const char *)vec[i].buf + done, n,
+                                 offset) != n) {
+                return -1;
+            }
+            offset += n;
+            done = 0;
+            i++;
+            continue;
+        }
+
+        n = vec[i].len - done;
+        if (n > size - used) n = size - used;
+        memcpy((block ? block : file->buf) + used, (const char *)vec[i].buf + done, n);
+        used += n;
+        done += n;
+        if (done == vec[i].len) {
+            done = 0;
+            i++;
+        }
+        if (used == size || i == count) {
+            if (file->vfs->write(file, block ? block : file->buf, used, offset) != used) {
+                riscos_free(block);
+                return -1;
+            }
+            offset += used;
+            used = 0;
+        }
+    }
+    riscos_free(block);
+    return 0;
+}
+
+/*
+** File operations
+** Each checks the handle and passes the call to the file's backend.
+*/
+
+/*
+** Open a file through a backend (the default one if vfs is NULL)
+** Returns: 0 on success, -1 on error
+*/
+int riscos_vfs_open(riscos_vfs_t *vfs, const char *path, int flags, riscos_file_t *file)
+{
+    if (!file) return -1;
+    memset(file, 0, sizeof(riscos_file_t));
+    if (!vfs) vfs = vfs_list;
+    if (!vfs || !path) return -1;
+
+    file->vfs = vfs;
+    if (vfs->open(vfs, path, flags, file) != 0 || file->handle == 0) {
+        memset(file, 0, sizeof(riscos_file_t));
+        return -1;
+    }
+
+    /* The extent is kept here from now on; no one else writes the file */
+    file->file_size = vfs->size(file);
+    if (file->file_size < 0) {
+        vfs->close(file);
+        memset(file, 0, sizeof(riscos_file_t));
+        return -1;
+    }
+    file->buf_size = vfs->block_size > 0 ? vfs->block_size : 0;
+    return 0;
+}
+
+/*
+** Close a file, writing back the buffer first
+*/
+int riscos_vfs_close(riscos_file_t *file)
+{
+    int rc;
+
+    if (!file || file->handle == 0) return -1;
+
+    rc = flush_buffer(file);
+    if (file->vfs->close(file) != 0) rc = -1;
+    riscos_free(file->buf);
+    memset(file, 0, sizeof(riscos_file_t));
+    return rc;
+}
+
+/*
+** Read bytes at an offset, leaving the file position alone
+** Returns number of bytes read, -1 on error
+*/
+int riscos_vfs_read_at(riscos_file_t *file, int offset, void *buf, int count)
+{
+    if (!file || !buf || file->handle == 0 || offset < 0) return -1;
+
+    if (have_buffer(file)) {
+        return buffered_read(file, offset, (unsigned char *)buf, count);
+    }
+    return file->vfs->read(file, buf, count, offset);
 }
 
 /*
-** Seek to position in file using OS_Args SWI
+** Write bytes at an offset, leaving the file position alone
+** Returns number of bytes written (or buffered), -1 on error
+*/
+int riscos_vfs_write_at(riscos_file_t *file, int offset, const void *buf, int count)
+{
+    int n;
+
+    if (!file || !buf || file->handle == 0 || offset < 0) return -1;
+
+    if (have_buffer(file)) {
+        n = buffered_write(file, offset, (const unsigned char *)buf, count);
+    } else {
+        n = file->vfs->write(file, buf, count, offset);
+    }
+    if (n > 0 && offset + n > file->file_size) file->file_size = offset + n;
+    return n;
+}
+
+/*
+** Read bytes at the file position
+** Returns number of bytes read, -1 on error
+*/
+int riscos_vfs_read(riscos_file_t *file, void *buf, int count)
+{
+    int n;
+
+    if (!file) return -1;
+
+    n = riscos_vfs_read_at(file, file->file_pos, buf, count);
+    if (n > 0) file->file_pos += n;
+    return n;
+}
+
+/*
+** Write bytes at the file position
+** Returns number of bytes written (or buffered), -1 on error
+*/
+int riscos_vfs_write(riscos_file_t *file, const void *buf, int count)
+{
+    int n;
+
+    if (!file) return -1;
+
+    n = riscos_vfs_write_at(file, file->file_pos, buf, count);
+    if (n > 0) file->file_pos += n;
+    return n;
+}
+
+/*
+** Set the file position
 ** whence: SEEK_SET, SEEK_CUR, SEEK_END
+** The position is only used by the next read or write.
 ** Returns: 0 on success, -1 on error
 */
 int riscos_vfs_seek(riscos_file_t *file, int offset, int whence)
 {
-#ifdef RISCOS
-    _kernel_swi_regs regs;
-    _kernel_oserror *err;
     int new_pos;
 
     if (!file || file->handle == 0) return -1;
@@ -253,30 +977,15 @@ int riscos_vfs_seek(riscos_file_t *file, int offset, int whence)
             new_pos = file->file_pos + offset;
             break;
         case SEEK_END:
-            if (file->file_size == 0) {
-                /* Get file size first */
-                if (riscos_vfs_filesize(file) < 0) return -1;
-            }
             new_pos = file->file_size + offset;
             break;
         default:
             return -1;
     }
-
-    /* Call OS_Args 1 (set file pointer) */
-    regs.r[0] = 1;
-    regs.r[1] = file->handle;
-    regs.r[2] = new_pos;
-
-    err = _kernel_swi(OS_Args, &regs, &regs);
-
-    if (err) return -1;
+    if (new_pos < 0) return -1;
 
     file->file_pos = new_pos;
     return 0;
-#else
-    return -1;
-#endif
 }
 
 /*
@@ -284,106 +993,120 @@ int riscos_vfs_seek(riscos_file_t *file, int offset, int whence)
 */
 int riscos_vfs_tell(riscos_file_t *file)
 {
-#ifdef RISCOS
-    _kernel_swi_regs regs;
-    _kernel_oserror *err;
-
     if (!file || file->handle == 0) return -1;
-
-    /* Call OS_Args 0 (read file pointer) */
-    regs.r[0] = 0;
-    regs.r[1] = file->handle;
-
-    err = _kernel_swi(OS_Args, &regs, &regs);
-
-    if (err) return -1;
-
-    /* r[2] contains current file pointer */
-    file->file_pos = regs.r[2];
     return file->file_pos;
-#else
-    return -1;
-#endif
 }
 
 /*
-** Get file size in bytes
+** Get file size in bytes, counting buffered bytes not yet written
+** The extent is tracked as the file is written, so this costs no call.
 */
 int riscos_vfs_filesize(riscos_file_t *file)
 {
-#ifdef RISCOS
-    _kernel_swi_regs regs;
-    _kernel_oserror *err;
-
     if (!file || file->handle == 0) return -1;
+    return file->file_size;
+}
 
-    /* Call OS_Args 2 (read file extent) */
-    regs.r[0] = 2;
-    regs.r[1] = file->handle;
+/*
+** Write a list of pieces, each run of pieces that follow on from one
+** another (the list is best sorted by offset) with one transfer
+** The buffer is written back first, and bypassed. Returns: 0 on success,
+** -1 on error
+*/
+int riscos_vfs_writev(riscos_file_t *file, const riscos_iovec_t *vec, int count)
+{
+    int i, j, end, size;
 
-    err = _kernel_swi(OS_Args, &regs, &regs);
+    if (!file || file->handle == 0 || count < 0 || (count > 0 && !vec)) return -1;
 
-    if (err) return -1;
+    if (flush_buffer(file) != 0) return -1;
+    file->buf_len = 0;
 
-    /* r[2] contains file extent (size) */
-    file->file_size = regs.r[2];
-    return file->file_size;
-#else
-    return -1;
-#endif
+    for (i = 0; i < count; i = j) {
+        end = vec[i].offset + vec[i].len;
+        for (j = i + 1; j < count && vec[j].offset == end; j++) end += vec[j].len;
+
+        if (write_run(file, vec + i, j - i) != 0) {
+            size = file->vfs->size(file);
+            if (size >= 0) file->file_size = size;
+            return -1;
+        }
+        if (end > file->file_size) file->file_size = end;
+    }
+    return 0;
+}
+
+/*
+** Write back any buffered bytes, without syncing
+*/
+int riscos_vfs_flush(riscos_file_t *file)
+{
+    if (!file || file->handle == 0) return -1;
+    return flush_buffer(file);
 }
 
 /*
 ** Synchronize file with disk (flush buffers)
-** RISC OS 3.1 doesn't guarantee this will work, but we try
 */
 int riscos_vfs_sync(riscos_file_t *file)
 {
-#ifdef RISCOS
-    _kernel_swi_regs regs;
-    _kernel_oserror *err;
-
     if (!file || file->handle == 0) return -1;
+    if (flush_buffer(file) != 0) return -1;
+    return file->vfs->sync(file);
+}
 
-    /* Call OS_Args 255 (ensure file, if available) */
-    regs.r[0] = 255;
-    regs.r[1] = file->handle;
-
-    err = _kernel_swi(OS_Args, &regs, &regs);
-
-    /* Don't fail if this SWI is not available in RISC OS 3.1 */
+/*
+** Cut a file down to size bytes
+*/
+int riscos_vfs_truncate(riscos_file_t *file, int size)
+{
+    if (!file || file->handle == 0 || size < 0) return -1;
+    if (flush_buffer(file) != 0) return -1;
+    file->buf_len = 0;
+    if (file->vfs->truncate(file, size) != 0) return -1;
+    file->file_size = size;
     return 0;
-#else
-    return -1;
-#endif
 }
 
 /*
-** Delete a file
-** Returns: 0 on success, -1 on error
+** Take or release a lock on an open file
+** Returns -1 if another open holds the file locked.
 */
-int riscos_vfs_delete(const char *path)
+int riscos_vfs_lock(riscos_file_t *file, int level)
 {
-#ifdef RISCOS
-    _kernel_swi_regs regs;
-    _kernel_oserror *err;
-    char *riscos_path;
-
-    if (!path) return -1;
+    if (!file || file->handle == 0) return -1;
+    return file->vfs->lock(file, level);
+}
 
-    riscos_path = riscos_translate_path(path);
-    if (!riscos_path) return -1;
+/*
+** Delete a file through a backend (the default one if vfs is NULL)
+** Returns: 0 on success, -1 on error
+*/
+int riscos_vfs_delete(riscos_vfs_t *vfs, const char *path)
+{
+    if (!vfs) vfs = vfs_list;
+    if (!vfs || !path) return -1;
+    return vfs->remove(vfs, path);
+}
 
-    /* Call OS_File 6 (delete file) */
-    regs.r[0] = 6;
-    regs.r[1] = (int)riscos_path;
+/*
+** Round the buffer up to a multiple of align (a page size), so blocks
+** hold whole pages; unbuffered files stay unbuffered
+*/
+int riscos_vfs_align_buffer(riscos_file_t *file, int align)
+{
+    int size;
 
-    err = _kernel_swi(OS_File, &regs, &regs);
+    if (!file || file->handle == 0 || align <= 0) return -1;
+    if (file->vfs->block_size <= 0) return 0;
 
-    riscos_free_path(riscos_path);
+    size = (file->vfs->block_size + align - 1) / align * align;
+    if (size == file->buf_size) return 0;
 
-    return err ? -1 : 0;
-#else
-    return -1;
-#endif
+    if (flush_buffer(file) != 0) return -1;
+    riscos_free(file->buf);
+    file->buf = NULL;
+    file->buf_len = 0;
+    file->buf_size = size;
+    return 0;
 }
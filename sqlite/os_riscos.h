@@ -7,6 +7,30 @@
 ** - OS_GBPB (read/write bytes)
 ** - OS_Args (file pointer operations)
 ** - OS_File (file operations like delete)
+**
+** File I/O goes through a backend (riscos_vfs_t), a table of functions
+** chosen when the file is opened. Three are built in: "riscos" (the SWIs)
+** or, built without RISCOS, "posix" (open, pread, pwrite, fdatasync,
+** fstat, unlink); and "memory", which keeps files in the heap. More can be
+** registered at run time, for instance to inject faults in tests. The
+** riscos_vfs_* functions below dispatch to the file's backend and keep
+** the file position and extent, so backends only transfer bytes at a
+** given offset: on RISC OS OS_GBPB 3 and 1, which take the offset with the
+** transfer, so no OS_Args call is made to move the pointer. The extent is
+** read once when the file is opened, since a database is only ever used
+** through one open (sqlite_open locks it).
+**
+** Each SWI costs more on ARM2 than copying a page, so the wrappers keep a
+** block of each file in a buffer: reads are served from it, and writes
+** that follow on from one another are gathered in it and written with one
+** transfer when an access leaves the block, or on flush, sync or close.
+** A seek only moves the position. Written data is therefore not seen by
+** the backend, nor any write error reported, until riscos_vfs_flush.
+**
+** riscos_vfs_writev writes a list of (offset, buffer, length) pieces,
+** going straight to the backend with one transfer for each run of pieces
+** that follow on from one another: pwritev on Linux, or on RISC OS one
+** OS_GBPB from a block the run is gathered into.
 */
 
 #ifndef _OS_RISCOS_H_
@@ -27,23 +51,89 @@
 #define OSFIND_OPENUPDATE   0xC0    /* Open file for update */
 #define OSFIND_CLOSE        0x00    /* Close file */
 
+/* Buffer size for the file backends (riscos_vfs_align_buffer rounds it up) */
+#define RISCOS_VFS_BLOCK_SIZE   4096
+
+/* Most bytes gathered into one block by riscos_vfs_writev */
+#define RISCOS_VFS_GATHER_SIZE  16384
+
+/* Lock levels for riscos_vfs_lock */
+#define RISCOS_LOCK_NONE        0
+#define RISCOS_LOCK_EXCLUSIVE   1   /* No other open of the file may lock it */
+
+typedef struct riscos_vfs riscos_vfs_t;
+
+/* A piece of a gather write */
+typedef struct {
+    int offset;                     /* File offset */
+    const void *buf;
+    int len;
+} riscos_iovec_t;
+
 /* File handle structure */
 typedef struct {
-    int handle;                     /* RISC OS file handle */
+    riscos_vfs_t *vfs;              /* Backend the file was opened through */
+    int handle;                     /* Non-zero while open (RISC OS file handle,
+                                    ** POSIX descriptor + 1) */
+    void *data;                     /* Backend's own state */
     int file_pos;                   /* Current position in file */
-    int file_size;                  /* File size in bytes */
+    int file_size;                  /* File size in bytes, as written so far */
+
+    /* A block of the file, allocated on first use */
+    unsigned char *buf;
+    int buf_size;                   /* Bytes allocated, or 0 if unbuffered */
+    int buf_start;                  /* File offset of buf[0] */
+    int buf_len;                    /* Bytes of the file held */
+    int buf_dirty;                  /* Held bytes must be written back */
 } riscos_file_t;
 
-/* VFS function declarations */
-int riscos_vfs_open(const char *path, int flags, riscos_file_t *file);
+/*
+** A backend
+** open sets file->handle (non-zero) and may use file->data. read and write
+** transfer count bytes at offset and return the number transferred, short
+** only at end of file on a read. writev, which may be NULL, writes a run of
+** pieces that follow on from one another and returns 0. Every method
+** returns -1 on error.
+*/
+struct riscos_vfs {
+    const char *name;
+    int (*open)(riscos_vfs_t *vfs, const char *path, int flags, riscos_file_t *file);
+    int (*close)(riscos_file_t *file);
+    int (*read)(riscos_file_t *file, void *buf, int count, int offset);
+    int (*write)(riscos_file_t *file, const void *buf, int count, int offset);
+    int (*writev)(riscos_file_t *file, const riscos_iovec_t *vec, int count);
+    int (*sync)(riscos_file_t *file);
+    int (*size)(riscos_file_t *file);
+    int (*truncate)(riscos_file_t *file, int size);
+    int (*lock)(riscos_file_t *file, int level);
+    int (*remove)(riscos_vfs_t *vfs, const char *path);
+    int block_size;                 /* Bytes to buffer per file, 0 for none */
+    void *app_data;                 /* For the backend's own use */
+    riscos_vfs_t *next;             /* Next registered backend */
+};
+
+/* Backends (a NULL name finds the default one) */
+riscos_vfs_t *riscos_vfs_find(const char *name);
+int riscos_vfs_register(riscos_vfs_t *vfs, int make_default);
+void riscos_vfs_unregister(riscos_vfs_t *vfs);
+
+/* VFS function declarations (a NULL vfs is the default backend) */
+int riscos_vfs_open(riscos_vfs_t *vfs, const char *path, int flags, riscos_file_t *file);
 int riscos_vfs_close(riscos_file_t *file);
 int riscos_vfs_read(riscos_file_t *file, void *buf, int count);
 int riscos_vfs_write(riscos_file_t *file, const void *buf, int count);
+int riscos_vfs_read_at(riscos_file_t *file, int offset, void *buf, int count);
+int riscos_vfs_write_at(riscos_file_t *file, int offset, const void *buf, int count);
 int riscos_vfs_seek(riscos_file_t *file, int offset, int whence);
 int riscos_vfs_tell(riscos_file_t *file);
 int riscos_vfs_filesize(riscos_file_t *file);
+int riscos_vfs_writev(riscos_file_t *file, const riscos_iovec_t *vec, int count);
+int riscos_vfs_flush(riscos_file_t *file);
 int riscos_vfs_sync(riscos_file_t *file);
-int riscos_vfs_delete(const char *path);
+int riscos_vfs_truncate(riscos_file_t *file, int size);
+int riscos_vfs_lock(riscos_file_t *file, int level);
+int riscos_vfs_delete(riscos_vfs_t *vfs, const char *path);
+int riscos_vfs_align_buffer(riscos_file_t *file, int align);
 
 /* Path translation utilities */
 char *riscos_translate_path(const char *unix_path);
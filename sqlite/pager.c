@@ -0,0 +1,1239 @@
+/*
+** SQLite Pager Implementation for RISC OS
+**
+** Reads and writes fixed-size database pages through the RISC OS VFS layer.
+** Resident pages are kept in a page cache of up to cache_size pages, found
+** through a hash table on page number. Clean pages that nobody references
+** sit on an LRU list and are evicted least-recently-used first when the
+** cache is full. Referenced and modified pages are never evicted, so the
+** cache can grow past cache_size while a large statement is running.
+** pager_commit() writes modified pages back and syncs the file once.
+**
+** With a write-ahead log (see wal.c) the modified pages go to the log
+** instead, and pages are read from the log when it holds a newer version
+** than the file. Commits made inside a group share one sync of the log at
+** the end of the group. Once the log passes PAGER_WAL_AUTOCHECKPOINT
+** frames it is checkpointed back into the file after a commit, inside a
+** group or not, so the log stays bounded however long a group runs.
+**
+** Pages are written in page number order, so the checkpoint (or a commit
+** without a log) writes the file front to back. PRAGMA synchronous can
+** drop the sync on every commit (NORMAL: a crash may lose the last
+** commits but never leaves a torn one) or every sync altogether (OFF).
+**
+** Savepoints mark points inside an uncommitted transaction to roll back
+** to. The first change to a page after a savepoint saves what is needed
+** to undo it: a copy if the page was already modified, or just its
+** number if it was clean, since the committed copy can be read again.
+** Rolling back costs time in proportion to the pages changed since.
+**
+** File format:
+**   Page 1        - header (magic, page size, page count, freelist, schema)
+**   Chain pages   - [next:4][used:2][payload...] linked lists of pages that
+**                   hold a byte stream (the schema, or a table's records)
+**   Free pages    - [next:4] linked into the freelist from the header
+**
+** All integers are stored little-endian.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sqlite.h"
+#include "pager.h"
+#include "wal.h"
+#include "mem_riscos.h"
+
+/* Minimum cache size in pages, as in SQLite 2.8 */
+#define PAGER_MIN_CACHE_SIZE    10
+
+/* Initial number of hash buckets (power of two) */
+#define PAGER_INITIAL_HASH      64
+
+/* Log size, in frames, at which a commit checkpoints the log */
+#define PAGER_WAL_AUTOCHECKPOINT 1000
+
+/* Runs kept by the dirty list sort: enough for 2^32 pages */
+#define PAGER_SORT_RUNS         32
+
+/* Pages passed to each gather write when committing without a log */
+#define PAGER_WRITE_BATCH       32
+
+/* Resident page header - page data follows immediately after it */
+typedef struct pg_hdr {
+    struct pg_hdr *hash_next;       /* Next page in the same hash bucket */
+    struct pg_hdr *dirty_next;      /* Next page on the dirty list */
+    struct pg_hdr *lru_prev;        /* LRU list links (clean, unreferenced) */
+    struct pg_hdr *lru_next;
+    pager_t *pager;                 /* Owning pager */
+    int pgno;                       /* Page number (1-based) */
+    int refs;                       /* Outstanding pager_get() references */
+    int dirty;                      /* Modified since last commit */
+    unsigned int saved_seq;         /* Savepoint the page was last saved for */
+} pg_hdr_t;
+
+/* Page state saved for a savepoint */
+typedef struct {
+    int pgno;
+    unsigned char *image;           /* Contents, or NULL if the page was clean */
+} saved_page_t;
+
+/* Open savepoint */
+typedef struct {
+    unsigned int seq;               /* Pages saved for it carry this */
+    int first_saved;                /* Its first entry in saved_pages */
+    int page_count;                 /* Header values when it was opened */
+    int freelist;
+    int free_count;
+    int schema_root;
+} savepoint_t;
+
+#define PG_DATA(h)      ((unsigned char *)((h) + 1))
+#define PG_HDR(d)       (((pg_hdr_t *)(d)) - 1)
+
+struct pager {
+    riscos_file_t *file;            /* Underlying database file */
+    int page_size;                  /* Bytes per page */
+    int page_count;                 /* Pages in the database */
+    int file_pages;                 /* Pages actually present on disk */
+    int freelist;                   /* First freelist page */
+    int free_count;                 /* Pages on the freelist */
+    int schema_root;                /* First page of the schema chain */
+    unsigned int change_count;      /* Commit counter */
+
+    /* Page cache */
+    pg_hdr_t **hash;                /* Resident pages by page number */
+    int n_hash;                     /* Number of hash buckets */
+    int n_resident;                 /* Pages currently in memory */
+    int cache_size;                 /* Target maximum resident pages */
+    pg_hdr_t *lru_head;             /* Least recently used evictable page */
+    pg_hdr_t *lru_tail;             /* Most recently used evictable page */
+    pg_hdr_t *dirty;                /* Pages modified since last commit */
+    pager_stats_t stats;            /* Hit/miss/eviction counters */
+
+    /* Write-ahead log, if any */
+    wal_t *wal;
+    int group_depth;                /* Nesting of pager_begin_group_commit() */
+    int unsynced;                   /* Commits in the log not yet synced */
+    int synchronous;                /* PAGER_SYNC_xxx */
+
+    /* Savepoints, innermost last, and the page states saved for them */
+    savepoint_t *savepoints;
+    int num_savepoints;
+    int savepoints_capacity;
+    saved_page_t *saved_pages;
+    int num_saved;
+    int saved_capacity;
+    unsigned int savepoint_seq;     /* Sequence of the innermost savepoint */
+    unsigned int next_seq;
+
+    /* Header values as of the last commit, restored by pager_rollback() */
+    int saved_page_count;
+    int saved_freelist;
+    int saved_free_count;
+    int saved_schema_root;
+};
+
+/*
+** Little-endian integer helpers
+*/
+unsigned int pager_get_u32(const unsigned char *p)
+{
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8) |
+           ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+void pager_put_u32(unsigned char *p, unsigned int v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+unsigned int pager_get_u16(const unsigned char *p)
+{
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+void pager_put_u16(unsigned char *p, unsigned int v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+/*
+** Check that a page size is a supported power of two
+*/
+static int valid_page_size(int size)
+{
+    return size >= PAGER_MIN_PAGE_SIZE && size <= PAGER_MAX_PAGE_SIZE &&
+           (size & (size - 1)) == 0;
+}
+
+/*
+** Read the committed version of a page into buf, from the log if it has
+** one, otherwise from the file
+** Pages beyond the end of the file read as zeros
+*/
+static int read_page(pager_t *pager, int pgno, unsigned char *buf)
+{
+    int n;
+
+    if (pager->wal) {
+        int frame = wal_find(pager->wal, pgno);
+        if (frame) return wal_read(pager->wal, frame, buf);
+    }
+
+    if (pgno > pager->file_pages) {
+        memset(buf, 0, pager->page_size);
+        return SQLITE_OK;
+    }
+
+    n = riscos_vfs_read_at(pager->file, (pgno - 1) * pager->page_size, buf,
+                           pager->page_size);
+    if (n < 0) return SQLITE_IOERR;
+    if (n < pager->page_size) {
+        memset(buf + n, 0, pager->page_size - n);
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Write the pages of a sorted dirty list to the file, in batches
+** Neighbouring pages in a batch are written with one transfer.
+*/
+static int write_pages(pager_t *pager, pg_hdr_t *list)
+{
+    riscos_iovec_t vec[PAGER_WRITE_BATCH];
+    int n;
+
+    while (list) {
+        for (n = 0; list && n < PAGER_WRITE_BATCH; list = list->dirty_next, n++) {
+            vec[n].offset = (list->pgno - 1) * pager->page_size;
+            vec[n].buf = PG_DATA(list);
+            vec[n].len = pager->page_size;
+            if (list->pgno > pager->file_pages) pager->file_pages = list->pgno;
+        }
+        if (riscos_vfs_writev(pager->file, vec, n) != 0) return SQLITE_IOERR;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Find a resident page
+*/
+static pg_hdr_t *lookup_page(pager_t *pager, int pgno)
+{
+    pg_hdr_t *h;
+    for (h = pager->hash[pgno & (pager->n_hash - 1)]; h; h = h->hash_next) {
+        if (h->pgno == pgno) return h;
+    }
+    return NULL;
+}
+
+/*
+** Double the hash table once it holds more pages than buckets
+** Failure to grow is harmless; the chains just get longer.
+*/
+static void grow_hash(pager_t *pager)
+{
+    pg_hdr_t **new_hash;
+    int new_size = pager->n_hash * 2;
+    int i;
+
+    new_hash = (pg_hdr_t **)riscos_calloc(new_size, sizeof(pg_hdr_t *));
+    if (!new_hash) return;
+
+    for (i = 0; i < pager->n_hash; i++) {
+        pg_hdr_t *h = pager->hash[i];
+        while (h) {
+            pg_hdr_t *next = h->hash_next;
+            int b = h->pgno & (new_size - 1);
+            h->hash_next = new_hash[b];
+            new_hash[b] = h;
+            h = next;
+        }
+    }
+
+    riscos_free(pager->hash);
+    pager->hash = new_hash;
+    pager->n_hash = new_size;
+}
+
+/*
+** Add a page to the hash table
+*/
+static void hash_insert(pager_t *pager, pg_hdr_t *h)
+{
+    int b;
+
+    if (pager->n_resident >= pager->n_hash) grow_hash(pager);
+    b = h->pgno & (pager->n_hash - 1);
+    h->hash_next = pager->hash[b];
+    pager->hash[b] = h;
+    pager->n_resident++;
+}
+
+/*
+** Remove a page from the hash table
+*/
+static void hash_remove(pager_t *pager, pg_hdr_t *h)
+{
+    pg_hdr_t **pp = &pager->hash[h->pgno & (pager->n_hash - 1)];
+
+    while (*pp) {
+        if (*pp == h) {
+            *pp = h->hash_next;
+            pager->n_resident--;
+            return;
+        }
+        pp = &(*pp)->hash_next;
+    }
+}
+
+/*
+** Put a clean, unreferenced page at the most-recently-used end of the LRU
+*/
+static void lru_append(pager_t *pager, pg_hdr_t *h)
+{
+    h->lru_next = NULL;
+    h->lru_prev = pager->lru_tail;
+    if (pager->lru_tail) {
+        pager->lru_tail->lru_next = h;
+    } else {
+        pager->lru_head = h;
+    }
+    pager->lru_tail = h;
+}
+
+/*
+** Take a page off the LRU list (it is about to be referenced or freed)
+*/
+static void lru_unlink(pager_t *pager, pg_hdr_t *h)
+{
+    if (h->lru_prev) {
+        h->lru_prev->lru_next = h->lru_next;
+    } else {
+        pager->lru_head = h->lru_next;
+    }
+    if (h->lru_next) {
+        h->lru_next->lru_prev = h->lru_prev;
+    } else {
+        pager->lru_tail = h->lru_prev;
+    }
+    h->lru_prev = NULL;
+    h->lru_next = NULL;
+}
+
+/*
+** Evict least-recently-used pages until at most max_pages are resident
+** Only clean, unreferenced pages can be evicted.
+*/
+static void evict_pages(pager_t *pager, int max_pages)
+{
+    while (pager->n_resident > max_pages && pager->lru_head) {
+        pg_hdr_t *h = pager->lru_head;
+        lru_unlink(pager, h);
+        hash_remove(pager, h);
+        riscos_free(h);
+        pager->stats.evictions++;
+    }
+}
+
+/*
+** Load the header fields from a copy of page 1
+*/
+static int load_header(pager_t *pager, const unsigned char *hdr)
+{
+    if (memcmp(hdr, PAGER_MAGIC, sizeof(PAGER_MAGIC) - 1) != 0 ||
+        (int)pager_get_u32(hdr + PAGER_HDR_PAGE_SIZE) != pager->page_size) {
+        return SQLITE_CORRUPT;
+    }
+    pager->page_count = (int)pager_get_u32(hdr + PAGER_HDR_PAGE_COUNT);
+    pager->freelist = (int)pager_get_u32(hdr + PAGER_HDR_FREELIST);
+    pager->free_count = (int)pager_get_u32(hdr + PAGER_HDR_FREE_COUNT);
+    pager->schema_root = (int)pager_get_u32(hdr + PAGER_HDR_SCHEMA_ROOT);
+    pager->change_count = pager_get_u32(hdr + PAGER_HDR_CHANGE_COUNT);
+    return SQLITE_OK;
+}
+
+/*
+** Open a pager on an already-open database file
+**
+** An empty file becomes a new database using the requested page size.
+** Otherwise the header on page 1 is validated and its page size is used.
+** If wal_file is not NULL, commits go to the write-ahead log in it, and
+** commits already there are recovered; a database that has never been
+** checkpointed takes its page size from the log.
+*/
+int pager_open(riscos_file_t *file, riscos_file_t *wal_file, int page_size,
+               pager_t **ppager)
+{
+    pager_t *pager;
+    unsigned char hdr[PAGER_HDR_SIZE];
+    unsigned char *page1;
+    int size, frame = 0;
+    int rc;
+
+    *ppager = NULL;
+    if (!valid_page_size(page_size)) page_size = SQLITE_DEFAULT_PAGE_SIZE;
+
+    pager = (pager_t *)riscos_calloc(1, sizeof(pager_t));
+    if (!pager) return SQLITE_NOMEM;
+    pager->file = file;
+    pager->page_size = page_size;
+    pager->cache_size = SQLITE_DEFAULT_CACHE_SIZE;
+    pager->synchronous = PAGER_SYNC_FULL;
+    pager->n_hash = PAGER_INITIAL_HASH;
+    pager->hash = (pg_hdr_t **)riscos_calloc(pager->n_hash, sizeof(pg_hdr_t *));
+    if (!pager->hash) {
+        riscos_free(pager);
+        return SQLITE_NOMEM;
+    }
+
+    size = riscos_vfs_filesize(file);
+    if (size < 0) {
+        pager_close(pager);
+        return SQLITE_IOERR;
+    }
+
+    if (size > 0) {
+        if (riscos_vfs_read_at(file, 0, hdr, PAGER_HDR_SIZE) != PAGER_HDR_SIZE) {
+            pager_close(pager);
+            return SQLITE_IOERR;
+        }
+        pager->page_size = (int)pager_get_u32(hdr + PAGER_HDR_PAGE_SIZE);
+        if (!valid_page_size(pager->page_size)) {
+            pager_close(pager);
+            return SQLITE_CORRUPT;
+        }
+    }
+
+    if (wal_file) {
+        rc = wal_open(wal_file, &pager->wal);
+        if (rc != SQLITE_OK) {
+            pager_close(pager);
+            return rc;
+        }
+        if (wal_page_size(pager->wal) != 0 && wal_page_size(pager->wal) != pager->page_size) {
+            /* A log of another page size belongs to some other database */
+            if (size == 0) {
+                pager->page_size = wal_page_size(pager->wal);
+            } else {
+                wal_reset(pager->wal);
+            }
+        }
+        frame = wal_find(pager->wal, 1);
+    }
+    pager->file_pages = size / pager->page_size;
+    riscos_vfs_align_buffer(file, pager->page_size);
+
+    if (frame) {
+        /* The newest header is in the log */
+        page1 = (unsigned char *)riscos_malloc(pager->page_size);
+        rc = page1 ? wal_read(pager->wal, frame, page1) : SQLITE_NOMEM;
+        if (rc == SQLITE_OK) rc = load_header(pager, page1);
+        riscos_free(page1);
+    } else if (size > 0) {
+        rc = load_header(pager, hdr);
+    } else {
+        /* New database: page 1 is created on first commit */
+        pager->page_count = 1;
+        rc = SQLITE_OK;
+    }
+    if (rc == SQLITE_OK && (frame || size > 0) && (pager->page_count < 1 ||
+        (pager->page_count > pager->file_pages &&
+         !(pager->wal && pager->page_count <= wal_db_pages(pager->wal))))) {
+        rc = SQLITE_CORRUPT;
+    }
+    if (rc != SQLITE_OK) {
+        pager_close(pager);
+        return rc;
+    }
+
+    pager->saved_page_count = pager->page_count;
+    pager->saved_freelist = pager->freelist;
+    pager->saved_free_count = pager->free_count;
+    pager->saved_schema_root = pager->schema_root;
+
+    *ppager = pager;
+    return SQLITE_OK;
+}
+
+/*
+** Close the pager, discarding any uncommitted changes
+** The underlying files are left open for the caller to close.
+*/
+void pager_close(pager_t *pager)
+{
+    pg_hdr_t *h, *next;
+    int i;
+
+    if (!pager) return;
+
+    if (pager->wal) {
+        if (pager->unsynced) wal_sync(pager->wal);
+        wal_close(pager->wal);
+    }
+    pager_release_savepoint(pager, 0);
+    riscos_free(pager->savepoints);
+    riscos_free(pager->saved_pages);
+    for (i = 0; i < pager->n_hash; i++) {
+        for (h = pager->hash[i]; h; h = next) {
+            next = h->hash_next;
+            riscos_free(h);
+        }
+    }
+    riscos_free(pager->hash);
+    riscos_free(pager);
+}
+
+/*
+** Set the maximum number of pages kept in the cache
+** Shrinking the cache evicts pages immediately.
+*/
+void pager_set_cache_size(pager_t *pager, int pages)
+{
+    if (pages < PAGER_MIN_CACHE_SIZE) pages = PAGER_MIN_CACHE_SIZE;
+    pager->cache_size = pages;
+    evict_pages(pager, pages);
+}
+
+int pager_cache_size(pager_t *pager)
+{
+    return pager->cache_size;
+}
+
+/*
+** Choose when commits are synced (PAGER_SYNC_OFF, _NORMAL or _FULL)
+*/
+void pager_set_synchronous(pager_t *pager, int level)
+{
+    if (level < PAGER_SYNC_OFF) level = PAGER_SYNC_OFF;
+    if (level > PAGER_SYNC_FULL) level = PAGER_SYNC_FULL;
+    pager->synchronous = level;
+}
+
+int pager_synchronous(pager_t *pager)
+{
+    return pager->synchronous;
+}
+
+/*
+** Read the cache counters
+*/
+void pager_get_stats(pager_t *pager, pager_stats_t *stats)
+{
+    *stats = pager->stats;
+    stats->resident = pager->n_resident;
+}
+
+/*
+** Get a reference to a page
+** The returned buffer is page_size bytes and stays valid until pager_unref().
+*/
+int pager_get(pager_t *pager, int pgno, unsigned char **ppage)
+{
+    pg_hdr_t *h;
+    int rc;
+
+    *ppage = NULL;
+    if (pgno < 1 || pgno > pager->page_count) return SQLITE_CORRUPT;
+
+    h = lookup_page(pager, pgno);
+    if (h) {
+        pager->stats.hits++;
+        if (h->refs == 0 && !h->dirty) lru_unlink(pager, h);
+    } else {
+        pager->stats.misses++;
+        evict_pages(pager, pager->cache_size - 1);
+
+        h = (pg_hdr_t *)riscos_malloc(sizeof(pg_hdr_t) + pager->page_size);
+        if (!h) return SQLITE_NOMEM;
+        rc = read_page(pager, pgno, PG_DATA(h));
+        if (rc != SQLITE_OK) {
+            riscos_free(h);
+            return rc;
+        }
+        memset(h, 0, sizeof(pg_hdr_t));
+        h->pager = pager;
+        h->pgno = pgno;
+        hash_insert(pager, h);
+    }
+
+    h->refs++;
+    *ppage = PG_DATA(h);
+    return SQLITE_OK;
+}
+
+/*
+** Put a page on the dirty list
+*/
+static void mark_dirty(pg_hdr_t *h)
+{
+    if (!h->dirty) {
+        h->dirty = 1;
+        h->dirty_next = h->pager->dirty;
+        h->pager->dirty = h;
+    }
+}
+
+/*
+** Save what the innermost savepoint needs to undo a change to a page
+*/
+static int save_page(pager_t *pager, pg_hdr_t *h)
+{
+    saved_page_t *saved;
+
+    if (pager->num_saved == pager->saved_capacity) {
+        int capacity = pager->saved_capacity ? pager->saved_capacity * 2 : 16;
+        saved = (saved_page_t *)riscos_realloc(pager->saved_pages,
+                                                capacity * sizeof(saved_page_t));
+        if (!saved) return SQLITE_NOMEM;
+        pager->saved_pages = saved;
+        pager->saved_capacity = capacity;
+    }
+
+    saved = &pager->saved_pages[pager->num_saved];
+    saved->pgno = h->pgno;
+    saved->image = NULL;
+    if (h->dirty) {
+        saved->image = (unsigned char *)riscos_malloc(pager->page_size);
+        if (!saved->image) return SQLITE_NOMEM;
+        memcpy(saved->image, PG_DATA(h), pager->page_size);
+    }
+    pager->num_saved++;
+    h->saved_seq = pager->savepoint_seq;
+    return SQLITE_OK;
+}
+
+/*
+** Mark a referenced page as modified
+** Must be called before changing the page contents; the page must not be
+** changed if this fails.
+*/
+int pager_write(unsigned char *page)
+{
+    pg_hdr_t *h = PG_HDR(page);
+    pager_t *pager = h->pager;
+    int rc;
+
+    if (pager->num_savepoints > 0 && h->saved_seq != pager->savepoint_seq) {
+        rc = save_page(pager, h);
+        if (rc != SQLITE_OK) return rc;
+    }
+    mark_dirty(h);
+    return SQLITE_OK;
+}
+
+/*
+** Release a page reference
+** Clean pages become evictable once the last reference goes away.
+*/
+void pager_unref(unsigned char *page)
+{
+    pg_hdr_t *h;
+
+    if (!page) return;
+    h = PG_HDR(page);
+    if (h->refs > 0) h->refs--;
+    if (h->refs == 0 && !h->dirty) lru_append(h->pager, h);
+}
+
+/*
+** Allocate a page, reusing the freelist before growing the file
+** The new page is zero-filled and already marked dirty.
+*/
+int pager_alloc(pager_t *pager, int *ppgno)
+{
+    unsigned char *page;
+    int freelist = pager->freelist;
+    int free_count = pager->free_count;
+    int page_count = pager->page_count;
+    int pgno;
+    int rc;
+
+    if (pager->freelist != 0) {
+        pgno = pager->freelist;
+        rc = pager_get(pager, pgno, &page);
+        if (rc != SQLITE_OK) return rc;
+        pager->freelist = (int)pager_get_u32(page + PAGER_CHAIN_NEXT);
+        pager->free_count--;
+    } else {
+        pgno = ++pager->page_count;
+        rc = pager_get(pager, pgno, &page);
+        if (rc != SQLITE_OK) {
+            pager->page_count--;
+            return rc;
+        }
+    }
+
+    rc = pager_write(page);
+    if (rc != SQLITE_OK) {
+        pager_unref(page);
+        pager->freelist = freelist;
+        pager->free_count = free_count;
+        pager->page_count = page_count;
+        return rc;
+    }
+    memset(page, 0, pager->page_size);
+    pager_unref(page);
+
+    *ppgno = pgno;
+    return SQLITE_OK;
+}
+
+/*
+** Return a page to the freelist
+*/
+int pager_free(pager_t *pager, int pgno)
+{
+    unsigned char *page;
+    int rc;
+
+    rc = pager_get(pager, pgno, &page);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = pager_write(page);
+    if (rc != SQLITE_OK) {
+        pager_unref(page);
+        return rc;
+    }
+    memset(page, 0, pager->page_size);
+    pager_put_u32(page + PAGER_CHAIN_NEXT, (unsigned int)pager->freelist);
+    pager_unref(page);
+
+    pager->freelist = pgno;
+    pager->free_count++;
+    return SQLITE_OK;
+}
+
+/*
+** Merge two dirty lists sorted by page number
+*/
+static pg_hdr_t *merge_dirty(pg_hdr_t *a, pg_hdr_t *b)
+{
+    pg_hdr_t *head = NULL;
+    pg_hdr_t **tail = &head;
+
+    while (a && b) {
+        if (a->pgno < b->pgno) {
+            *tail = a;
+            a = a->dirty_next;
+        } else {
+            *tail = b;
+            b = b->dirty_next;
+        }
+        tail = &(*tail)->dirty_next;
+    }
+    *tail = a ? a : b;
+    return head;
+}
+
+/*
+** Sort the dirty list by page number
+** A bottom-up merge sort on the list links: runs[i] holds a sorted run of
+** 2^i pages, so nothing is allocated and the sort is O(n log n).
+*/
+static pg_hdr_t *sort_dirty(pg_hdr_t *list)
+{
+    pg_hdr_t *runs[PAGER_SORT_RUNS];
+    pg_hdr_t *p;
+    int i;
+
+    memset(runs, 0, sizeof(runs));
+    while (list) {
+        p = list;
+        list = p->dirty_next;
+        p->dirty_next = NULL;
+        for (i = 0; i < PAGER_SORT_RUNS - 1 && runs[i]; i++) {
+            p = merge_dirty(runs[i], p);
+            runs[i] = NULL;
+        }
+        runs[i] = merge_dirty(runs[i], p);
+    }
+
+    p = NULL;
+    for (i = 0; i < PAGER_SORT_RUNS; i++) p = merge_dirty(runs[i], p);
+    return p;
+}
+
+/*
+** Append the modified pages to the log as one commit
+** The last frame carries the commit record. With synchronous FULL the
+** log is synced, or marked for the end of an open group commit to sync.
+*/
+static int commit_to_wal(pager_t *pager)
+{
+    pg_hdr_t *h;
+    int rc;
+
+    rc = wal_begin(pager->wal, pager->page_size);
+    for (h = pager->dirty; rc == SQLITE_OK && h; h = h->dirty_next) {
+        rc = wal_write(pager->wal, h->pgno, PG_DATA(h),
+                       h->dirty_next ? 0 : pager->page_count);
+    }
+    if (rc != SQLITE_OK) {
+        wal_abort(pager->wal);
+        return rc;
+    }
+
+    if (pager->synchronous < PAGER_SYNC_FULL) {
+        /* NORMAL relies on the sync before each checkpoint */
+    } else if (pager->group_depth > 0) {
+        pager->unsynced = 1;
+    } else {
+        wal_sync(pager->wal);
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Write all modified pages and the file header in page order, then sync
+** the file (or the log, with a write-ahead log)
+** Any savepoints still open are closed.
+*/
+int pager_commit(pager_t *pager)
+{
+    unsigned char *hdr;
+    pg_hdr_t *h;
+    int rc;
+
+    pager_release_savepoint(pager, 0);
+    if (!pager->dirty &&
+        pager->page_count == pager->saved_page_count &&
+        pager->freelist == pager->saved_freelist &&
+        pager->schema_root == pager->saved_schema_root &&
+        (pager->file_pages > 0 || (pager->wal && wal_find(pager->wal, 1)))) {
+        return SQLITE_OK;
+    }
+
+    /* Refresh the header on page 1 */
+    rc = pager_get(pager, 1, &hdr);
+    if (rc != SQLITE_OK) return rc;
+    pager_write(hdr);
+    pager->change_count++;
+    memcpy(hdr, PAGER_MAGIC, sizeof(PAGER_MAGIC) - 1);
+    pager_put_u32(hdr + PAGER_HDR_PAGE_SIZE, (unsigned int)pager->page_size);
+    pager_put_u32(hdr + PAGER_HDR_PAGE_COUNT, (unsigned int)pager->page_count);
+    pager_put_u32(hdr + PAGER_HDR_FREELIST, (unsigned int)pager->freelist);
+    pager_put_u32(hdr + PAGER_HDR_FREE_COUNT, (unsigned int)pager->free_count);
+    pager_put_u32(hdr + PAGER_HDR_SCHEMA_ROOT, (unsigned int)pager->schema_root);
+    pager_put_u32(hdr + PAGER_HDR_CHANGE_COUNT, pager->change_count);
+    pager_unref(hdr);
+
+    pager->dirty = sort_dirty(pager->dirty);
+    if (pager->wal) {
+        rc = commit_to_wal(pager);
+        if (rc != SQLITE_OK) return rc;
+    } else {
+        rc = write_pages(pager, pager->dirty);
+        if (rc != SQLITE_OK) return rc;
+        if (pager->synchronous != PAGER_SYNC_OFF) riscos_vfs_sync(pager->file);
+    }
+
+    /* Written pages are clean again and can be evicted */
+    while (pager->dirty) {
+        h = pager->dirty;
+        pager->dirty = h->dirty_next;
+        h->dirty_next = NULL;
+        h->dirty = 0;
+        if (h->refs == 0) lru_append(pager, h);
+    }
+
+    pager->saved_page_count = pager->page_count;
+    pager->saved_freelist = pager->freelist;
+    pager->saved_free_count = pager->free_count;
+    pager->saved_schema_root = pager->schema_root;
+
+    evict_pages(pager, pager->cache_size);
+
+    /*
+    ** A checkpoint syncs the log first, so a group's deferred sync happens
+    ** here. One that fails leaves the log as it was; the commit stands.
+    */
+    if (pager->wal && wal_frame_count(pager->wal) >= PAGER_WAL_AUTOCHECKPOINT) {
+        pager_checkpoint(pager, NULL);
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Start a group of commits that share one sync of the log
+** Groups nest; without a log they have no effect.
+*/
+void pager_begin_group_commit(pager_t *pager)
+{
+    pager->group_depth++;
+}
+
+/*
+** End a group of commits, syncing the log once for all of them
+*/
+void pager_end_group_commit(pager_t *pager)
+{
+    if (pager->group_depth == 0 || --pager->group_depth > 0 || !pager->wal) return;
+
+    if (pager->unsynced) {
+        wal_sync(pager->wal);
+        pager->unsynced = 0;
+    }
+    if (wal_frame_count(pager->wal) >= PAGER_WAL_AUTOCHECKPOINT) {
+        pager_checkpoint(pager, NULL);
+    }
+}
+
+/*
+** Copy the committed pages in the log back into the database file
+** *pframes is set to the number of pages copied. Uncommitted changes are
+** not affected.
+*/
+int pager_checkpoint(pager_t *pager, int *pframes)
+{
+    int size;
+    int rc;
+
+    if (pframes) *pframes = 0;
+    if (!pager->wal) return SQLITE_OK;
+
+    rc = wal_checkpoint(pager->wal, pager->file,
+                        pager->synchronous != PAGER_SYNC_OFF, pframes);
+    if (rc != SQLITE_OK) return rc;
+    pager->unsynced = 0;
+
+    size = riscos_vfs_filesize(pager->file);
+    if (size < 0) return SQLITE_IOERR;
+    pager->file_pages = size / pager->page_size;
+    return SQLITE_OK;
+}
+
+/*
+** Discard all changes made since the last commit
+** Modified pages are dropped so that they are re-read from the file.
+*/
+void pager_rollback(pager_t *pager)
+{
+    pg_hdr_t *h;
+
+    pager_release_savepoint(pager, 0);
+    while (pager->dirty) {
+        h = pager->dirty;
+        pager->dirty = h->dirty_next;
+        h->dirty_next = NULL;
+        h->dirty = 0;
+        if (h->refs == 0) {
+            hash_remove(pager, h);
+            riscos_free(h);
+        } else {
+            read_page(pager, h->pgno, PG_DATA(h));
+        }
+    }
+
+    pager->page_count = pager->saved_page_count;
+    pager->freelist = pager->saved_freelist;
+    pager->free_count = pager->saved_free_count;
+    pager->schema_root = pager->saved_schema_root;
+}
+
+/*
+** Open a savepoint inside the current transaction
+** Savepoints nest; the new one is level pager_savepoint_count() - 1.
+*/
+int pager_open_savepoint(pager_t *pager)
+{
+    savepoint_t *sp;
+
+    if (pager->num_savepoints == pager->savepoints_capacity) {
+        int capacity = pager->savepoints_capacity ? pager->savepoints_capacity * 2 : 4;
+        sp = (savepoint_t *)riscos_realloc(pager->savepoints, capacity * sizeof(savepoint_t));
+        if (!sp) return SQLITE_NOMEM;
+        pager->savepoints = sp;
+        pager->savepoints_capacity = capacity;
+    }
+
+    sp = &pager->savepoints[pager->num_savepoints++];
+    sp->seq = ++pager->next_seq;
+    sp->first_saved = pager->num_saved;
+    sp->page_count = pager->page_count;
+    sp->freelist = pager->freelist;
+    sp->free_count = pager->free_count;
+    sp->schema_root = pager->schema_root;
+    pager->savepoint_seq = sp->seq;
+    return SQLITE_OK;
+}
+
+int pager_savepoint_count(pager_t *pager)
+{
+    return pager->num_savepoints;
+}
+
+/*
+** Close the savepoint at level and every one inside it, keeping changes
+** Their saved pages still serve the savepoints outside them.
+*/
+void pager_release_savepoint(pager_t *pager, int level)
+{
+    if (level < 0 || level >= pager->num_savepoints) return;
+
+    pager->num_savepoints = level;
+    if (level > 0) {
+        pager->savepoint_seq = pager->savepoints[level - 1].seq;
+        return;
+    }
+
+    while (pager->num_saved > 0) riscos_free(pager->saved_pages[--pager->num_saved].image);
+    pager->savepoint_seq = 0;
+}
+
+/*
+** Undo every change made since the savepoint at level was opened
+** Savepoints inside it are closed; it stays open. Pages must not be
+** referenced. Only the earliest state saved for each page since then is
+** restored: a copy goes back into the cache, a page that was clean is
+** dropped (or read again), as is a page allocated since.
+*/
+void pager_rollback_to_savepoint(pager_t *pager, int level)
+{
+    savepoint_t *sp;
+    pg_hdr_t *h, **link;
+    unsigned int stamp;
+    unsigned char *page;
+    int i;
+
+    if (level < 0 || level >= pager->num_savepoints) return;
+    sp = &pager->savepoints[level];
+
+    pager->page_count = sp->page_count;
+    pager->freelist = sp->freelist;
+    pager->free_count = sp->free_count;
+    pager->schema_root = sp->schema_root;
+
+    stamp = ++pager->next_seq;
+    for (i = sp->first_saved; i < pager->num_saved; i++) {
+        saved_page_t *saved = &pager->saved_pages[i];
+
+        h = lookup_page(pager, saved->pgno);
+        if (h && h->saved_seq == stamp) continue;
+
+        if (saved->image && saved->pgno <= pager->page_count) {
+            if (!h) {
+                /* Dropped by an earlier rollback: bring it back */
+                if (pager_get(pager, saved->pgno, &page) != SQLITE_OK) continue;
+                h = PG_HDR(page);
+                pager_unref(page);
+            } else if (h->refs == 0 && !h->dirty) {
+                lru_unlink(pager, h);
+            }
+            memcpy(PG_DATA(h), saved->image, pager->page_size);
+            mark_dirty(h);
+        } else if (h) {
+            /* Left on the dirty list for the pass below */
+            h->dirty = 0;
+        }
+        if (h) h->saved_seq = stamp;
+    }
+
+    /* Drop the pages made clean again, or read back the referenced ones */
+    link = &pager->dirty;
+    while ((h = *link) != NULL) {
+        if (h->dirty) {
+            link = &h->dirty_next;
+            continue;
+        }
+        *link = h->dirty_next;
+        h->dirty_next = NULL;
+        if (h->refs == 0) {
+            hash_remove(pager, h);
+            riscos_free(h);
+        } else {
+            read_page(pager, h->pgno, PG_DATA(h));
+        }
+    }
+
+    while (pager->num_saved > sp->first_saved) {
+        riscos_free(pager->saved_pages[--pager->num_saved].image);
+    }
+    pager->num_savepoints = level + 1;
+    sp->seq = ++pager->next_seq;
+    pager->savepoint_seq = sp->seq;
+}
+
+/*
+** Header field accessors
+*/
+int pager_page_size(pager_t *pager)
+{
+    return pager->page_size;
+}
+
+int pager_page_count(pager_t *pager)
+{
+    return pager->page_count;
+}
+
+int pager_schema_root(pager_t *pager)
+{
+    return pager->schema_root;
+}
+
+void pager_set_schema_root(pager_t *pager, int pgno)
+{
+    pager->schema_root = pgno;
+}
+
+/*
+** Start a new, empty page chain
+*/
+int pager_chain_new(pager_t *pager, int *ppgno)
+{
+    /* pager_alloc() returns a zeroed page: next = 0, used = 0 */
+    return pager_alloc(pager, ppgno);
+}
+
+/*
+** Append bytes to the end of a page chain
+** *ptail is the last page of the chain and is updated if the chain grows.
+*/
+int pager_chain_append(pager_t *pager, int *ptail, const void *data, int count)
+{
+    const unsigned char *src = (const unsigned char *)data;
+    unsigned char *page;
+    int tail = *ptail;
+    int capacity = pager->page_size - PAGER_CHAIN_HDR;
+    int rc;
+
+    rc = pager_get(pager, tail, &page);
+    if (rc != SQLITE_OK) return rc;
+
+    while (count > 0) {
+        int used = (int)pager_get_u16(page + PAGER_CHAIN_USED);
+        int n = capacity - used;
+
+        if (n == 0) {
+            int next;
+            rc = pager_alloc(pager, &next);
+            if (rc == SQLITE_OK) rc = pager_write(page);
+            if (rc != SQLITE_OK) {
+                pager_unref(page);
+                return rc;
+            }
+            pager_put_u32(page + PAGER_CHAIN_NEXT, (unsigned int)next);
+            pager_unref(page);
+
+            tail = next;
+            rc = pager_get(pager, tail, &page);
+            if (rc != SQLITE_OK) return rc;
+            continue;
+        }
+
+        if (n > count) n = count;
+        rc = pager_write(page);
+        if (rc != SQLITE_OK) {
+            pager_unref(page);
+            return rc;
+        }
+        memcpy(page + PAGER_CHAIN_HDR + used, src, n);
+        pager_put_u16(page + PAGER_CHAIN_USED, (unsigned int)(used + n));
+        src += n;
+        count -= n;
+    }
+
+    pager_unref(page);
+    *ptail = tail;
+    return SQLITE_OK;
+}
+
+/*
+** Free every page of a chain
+*/
+int pager_chain_free(pager_t *pager, int first)
+{
+    unsigned char *page;
+    int pgno = first;
+    int rc;
+
+    while (pgno != 0) {
+        int next;
+        rc = pager_get(pager, pgno, &page);
+        if (rc != SQLITE_OK) return rc;
+        next = (int)pager_get_u32(page + PAGER_CHAIN_NEXT);
+        pager_unref(page);
+
+        rc = pager_free(pager, pgno);
+        if (rc != SQLITE_OK) return rc;
+        pgno = next;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Open a sequential reader positioned at the start of a chain
+*/
+int pager_chain_open(pager_t *pager, int first, pager_chain_reader_t *reader)
+{
+    int rc;
+
+    reader->pager = pager;
+    reader->pgno = first;
+    reader->offset = 0;
+    reader->page = NULL;
+    reader->last_pgno = first;
+
+    if (first == 0) return SQLITE_OK;
+    rc = pager_get(pager, first, &reader->page);
+    if (rc != SQLITE_OK) reader->pgno = 0;
+    return rc;
+}
+
+/*
+** Read up to count bytes from a chain
+** Returns the number of bytes read (less than count at end of chain),
+** or -1 on error.
+*/
+int pager_chain_read(pager_chain_reader_t *reader, void *buf, int count)
+{
+    unsigned char *dst = (unsigned char *)buf;
+    int total = 0;
+
+    while (count > 0 && reader->pgno != 0) {
+        int used = (int)pager_get_u16(reader->page + PAGER_CHAIN_USED);
+        int n = used - reader->offset;
+
+        if (n <= 0) {
+            int next = (int)pager_get_u32(reader->page + PAGER_CHAIN_NEXT);
+            pager_unref(reader->page);
+            reader->page = NULL;
+            reader->pgno = next;
+            reader->offset = 0;
+            if (next == 0) break;
+            if (pager_get(reader->pager, next, &reader->page) != SQLITE_OK) {
+                reader->pgno = 0;
+                return -1;
+            }
+            reader->last_pgno = next;
+            continue;
+        }
+
+        if (n > count) n = count;
+        memcpy(dst, reader->page + PAGER_CHAIN_HDR + reader->offset, n);
+        reader->offset += n;
+        dst += n;
+        count -= n;
+        total += n;
+    }
+
+    return total;
+}
+
+/*
+** Release the reader's page reference
+*/
+void pager_chain_close(pager_chain_reader_t *reader)
+{
+    if (reader->page) {
+        pager_unref(reader->page);
+        reader->page = NULL;
+    }
+    reader->pgno = 0;
+}
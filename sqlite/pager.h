@@ -0,0 +1,112 @@
+/*
+** SQLite Pager for RISC OS
+** Page-based database file layer sitting on top of the RISC OS VFS
+**
+** The database file is an array of fixed-size pages numbered from 1.
+** Page 1 holds the file header; every other page is either part of a
+** page chain (schema or table data) or on the freelist. Commits can go
+** through a write-ahead log (wal.h) that is checkpointed into the file.
+*/
+
+#ifndef _PAGER_H_
+#define _PAGER_H_
+
+#include "os_riscos.h"
+
+/* Page size limits (page size must be a power of two in this range) */
+#define PAGER_MIN_PAGE_SIZE     512
+#define PAGER_MAX_PAGE_SIZE     32768
+
+/* File header layout (page 1) */
+#define PAGER_MAGIC             "** RISC OS SQLite 2 **"
+#define PAGER_MAGIC_SIZE        24
+#define PAGER_HDR_PAGE_SIZE     24  /* Page size in bytes */
+#define PAGER_HDR_PAGE_COUNT    28  /* Number of pages in the file */
+#define PAGER_HDR_FREELIST      32  /* First freelist page, 0 if none */
+#define PAGER_HDR_FREE_COUNT    36  /* Number of pages on the freelist */
+#define PAGER_HDR_SCHEMA_ROOT   40  /* First page of the schema chain */
+#define PAGER_HDR_CHANGE_COUNT  44  /* Incremented on every commit */
+#define PAGER_HDR_SIZE          48
+
+/* Chain page layout: next page number, bytes used, then payload */
+#define PAGER_CHAIN_NEXT        0
+#define PAGER_CHAIN_USED        4
+#define PAGER_CHAIN_HDR         6
+
+typedef struct pager pager_t;
+
+/* Page cache counters */
+typedef struct {
+    int hits;                       /* pager_get() found the page resident */
+    int misses;                     /* pager_get() had to read the page */
+    int evictions;                  /* Clean pages dropped to make room */
+    int resident;                   /* Pages currently in memory */
+} pager_stats_t;
+
+/* Sequential reader over a page chain */
+typedef struct {
+    pager_t *pager;
+    int pgno;                       /* Current page, 0 at end of chain */
+    int offset;                     /* Read offset within current page */
+    unsigned char *page;            /* Current page data (referenced) */
+    int last_pgno;                  /* Last page visited */
+} pager_chain_reader_t;
+
+/* Pager lifecycle */
+int pager_open(riscos_file_t *file, riscos_file_t *wal_file, int page_size,
+               pager_t **ppager);
+void pager_close(pager_t *pager);
+int pager_commit(pager_t *pager);
+void pager_rollback(pager_t *pager);
+
+/* Write-ahead log */
+void pager_begin_group_commit(pager_t *pager);
+void pager_end_group_commit(pager_t *pager);
+int pager_checkpoint(pager_t *pager, int *pframes);
+
+/* Savepoints within a transaction, numbered from 0 (outermost) */
+int pager_open_savepoint(pager_t *pager);
+int pager_savepoint_count(pager_t *pager);
+void pager_release_savepoint(pager_t *pager, int level);
+void pager_rollback_to_savepoint(pager_t *pager, int level);
+
+/* Durability (PRAGMA synchronous) */
+#define PAGER_SYNC_OFF          0   /* Never sync */
+#define PAGER_SYNC_NORMAL       1   /* Sync the log only when checkpointing */
+#define PAGER_SYNC_FULL         2   /* Sync every commit (default) */
+void pager_set_synchronous(pager_t *pager, int level);
+int pager_synchronous(pager_t *pager);
+
+/* Page cache control */
+void pager_set_cache_size(pager_t *pager, int pages);
+int pager_cache_size(pager_t *pager);
+void pager_get_stats(pager_t *pager, pager_stats_t *stats);
+
+/* Page access */
+int pager_get(pager_t *pager, int pgno, unsigned char **ppage);
+int pager_write(unsigned char *page);
+void pager_unref(unsigned char *page);
+int pager_alloc(pager_t *pager, int *ppgno);
+int pager_free(pager_t *pager, int pgno);
+
+/* Header fields */
+int pager_page_size(pager_t *pager);
+int pager_page_count(pager_t *pager);
+int pager_schema_root(pager_t *pager);
+void pager_set_schema_root(pager_t *pager, int pgno);
+
+/* Page chains */
+int pager_chain_new(pager_t *pager, int *ppgno);
+int pager_chain_append(pager_t *pager, int *ptail, const void *data, int count);
+int pager_chain_free(pager_t *pager, int first);
+int pager_chain_open(pager_t *pager, int first, pager_chain_reader_t *reader);
+int pager_chain_read(pager_chain_reader_t *reader, void *buf, int count);
+void pager_chain_close(pager_chain_reader_t *reader);
+
+/* Little-endian integer encoding used throughout the file format */
+unsigned int pager_get_u32(const unsigned char *p);
+void pager_put_u32(unsigned char *p, unsigned int v);
+unsigned int pager_get_u16(const unsigned char *p);
+void pager_put_u16(unsigned char *p, unsigned int v);
+
+#endif /* _PAGER_H_ */
@@ -0,0 +1,253 @@
+/*
+** SQLite Records for RISC OS
+**
+** Encoding and decoding of packed row records (format in record.h).
+** A record is built once per INSERT and then serves both as the in-memory
+** row and as the bytes appended to disk, so a row costs one allocation and
+** one free no matter how many columns it has.
+*/
+
+#include <string.h>
+#include "sqlite.h"
+#include "record.h"
+#include "pager.h"
+#include "mem_riscos.h"
+
+/*
+** Serial type used to store an integer
+*/
+static int int_serial_type(long long i)
+{
+    if (i >= -128 && i <= 127) return RECORD_INT8;
+    if (i >= -32768 && i <= 32767) return RECORD_INT16;
+    if (i >= -2147483647 - 1 && i <= 2147483647) return RECORD_INT32;
+    return RECORD_INT64;
+}
+
+/*
+** Data bytes that follow a serial type byte, or -1 for TEXT/BLOB
+*/
+static int serial_data_size(int type)
+{
+    switch (type) {
+        case RECORD_NULL:  return 0;
+        case RECORD_INT8:  return 1;
+        case RECORD_INT16: return 2;
+        case RECORD_INT32: return 4;
+        case RECORD_INT64:
+        case RECORD_REAL:  return 8;
+        default:           return -1;
+    }
+}
+
+/*
+** Little-endian integer of n bytes, sign-extended
+*/
+static long long get_int(const unsigned char *p, int n)
+{
+    unsigned long long v = 0;
+    int i;
+
+    for (i = n - 1; i >= 0; i--) v = (v << 8) | p[i];
+    if (n < 8 && (p[n - 1] & 0x80)) v |= ~0ull << (n * 8);
+    return (long long)v;
+}
+
+static void put_int(unsigned char *p, long long i, int n)
+{
+    unsigned long long v = (unsigned long long)i;
+    int k;
+
+    for (k = 0; k < n; k++) {
+        p[k] = (unsigned char)(v & 0xFF);
+        v >>= 8;
+    }
+}
+
+/*
+** Encode values into a newly allocated record
+*/
+int record_encode(const value_t *values, int num_values, unsigned char **prec)
+{
+    unsigned char *rec, *p;
+    int size, c;
+
+    size = RECORD_HDR_SIZE;
+    for (c = 0; c < num_values; c++) {
+        const value_t *v = &values[c];
+        switch (v->type) {
+            case VALUE_INTEGER:
+                size += 1 + serial_data_size(int_serial_type(v->u.i));
+                break;
+            case VALUE_REAL:
+                size += 1 + 8;
+                break;
+            case VALUE_TEXT:
+            case VALUE_BLOB:
+                size += 1 + 4 + v->u.s.n + 1;
+                break;
+            default:
+                size += 1;
+                break;
+        }
+    }
+
+    rec = (unsigned char *)riscos_malloc(size);
+    if (!rec) {
+        *prec = NULL;
+        return SQLITE_NOMEM;
+    }
+
+    pager_put_u32(rec, (unsigned int)(size - 4));
+    pager_put_u16(rec + 4, (unsigned int)num_values);
+    p = rec + RECORD_HDR_SIZE;
+    for (c = 0; c < num_values; c++) {
+        const value_t *v = &values[c];
+        switch (v->type) {
+            case VALUE_INTEGER: {
+                int type = int_serial_type(v->u.i);
+                *p++ = (unsigned char)type;
+                put_int(p, v->u.i, serial_data_size(type));
+                p += serial_data_size(type);
+                break;
+            }
+            case VALUE_REAL: {
+                long long bits;
+                memcpy(&bits, &v->u.r, 8);
+                *p++ = RECORD_REAL;
+                put_int(p, bits, 8);
+                p += 8;
+                break;
+            }
+            case VALUE_TEXT:
+            case VALUE_BLOB:
+                *p++ = v->type == VALUE_TEXT ? RECORD_TEXT : RECORD_BLOB;
+                pager_put_u32(p, (unsigned int)v->u.s.n);
+                memcpy(p + 4, v->u.s.z, v->u.s.n);
+                p[4 + v->u.s.n] = '\0';
+                p += 4 + v->u.s.n + 1;
+                break;
+            default:
+                *p++ = RECORD_NULL;
+                break;
+        }
+    }
+
+    *prec = rec;
+    return SQLITE_OK;
+}
+
+/*
+** Total size of a record in bytes, including its length prefix
+*/
+int record_size(const unsigned char *rec)
+{
+    return 4 + (int)pager_get_u32(rec);
+}
+
+/*
+** Check that a record read from disk is well formed
+*/
+int record_check(const unsigned char *rec, int size, int max_columns)
+{
+    int ncols, pos, c;
+
+    if (size < RECORD_HDR_SIZE || record_size(rec) != size) return SQLITE_CORRUPT;
+    ncols = (int)pager_get_u16(rec + 4);
+    if (ncols > max_columns) return SQLITE_CORRUPT;
+
+    pos = RECORD_HDR_SIZE;
+    for (c = 0; c < ncols; c++) {
+        int type, n;
+
+        if (pos >= size) return SQLITE_CORRUPT;
+        type = rec[pos++];
+        n = serial_data_size(type);
+        if (n < 0) {
+            unsigned int len;
+            if (type != RECORD_TEXT && type != RECORD_BLOB) return SQLITE_CORRUPT;
+            if (pos + 4 > size) return SQLITE_CORRUPT;
+            len = pager_get_u32(rec + pos);
+            pos += 4;
+            if (len >= (unsigned int)(size - pos) || rec[pos + len] != '\0') {
+                return SQLITE_CORRUPT;
+            }
+            n = (int)len + 1;
+        } else if (pos + n > size) {
+            return SQLITE_CORRUPT;
+        }
+        pos += n;
+    }
+
+    return pos == size ? SQLITE_OK : SQLITE_CORRUPT;
+}
+
+/*
+** Decode a record into values
+** Text and blob values point into the record and stay valid as long as
+** the record does. Columns beyond those stored in the record are NULL.
+*/
+void record_decode(const unsigned char *rec, value_t *values, int num_values)
+{
+    record_decode_columns(rec, values, num_values, ~0u);
+}
+
+/*
+** Decode only the columns whose bit is set in wanted (bit c for column c)
+** The other values are left as they were; columns after the last wanted
+** one are not even walked over.
+*/
+void record_decode_columns(const unsigned char *rec, value_t *values, int num_values,
+                           unsigned int wanted)
+{
+    const unsigned char *p = rec + RECORD_HDR_SIZE;
+    int ncols = (int)pager_get_u16(rec + 4);
+    int c;
+
+    if (ncols > num_values) ncols = num_values;
+    for (c = 0; c < ncols && (wanted >> c) != 0; c++) {
+        value_t *v = &values[c];
+        int type = *p++;
+
+        if (!(wanted & (1u << c))) {
+            /* Step over the data without decoding it */
+            if (type == RECORD_TEXT || type == RECORD_BLOB) {
+                p += 4 + pager_get_u32(p) + 1;
+            } else {
+                p += serial_data_size(type);
+            }
+            continue;
+        }
+
+        switch (type) {
+            case RECORD_INT8:
+            case RECORD_INT16:
+            case RECORD_INT32:
+            case RECORD_INT64:
+                v->type = VALUE_INTEGER;
+                v->u.i = get_int(p, serial_data_size(type));
+                p += serial_data_size(type);
+                break;
+            case RECORD_REAL: {
+                long long bits = get_int(p, 8);
+                v->type = VALUE_REAL;
+                memcpy(&v->u.r, &bits, 8);
+                p += 8;
+                break;
+            }
+            case RECORD_TEXT:
+            case RECORD_BLOB:
+                v->type = type == RECORD_TEXT ? VALUE_TEXT : VALUE_BLOB;
+                v->u.s.n = (int)pager_get_u32(p);
+                v->u.s.z = (char *)p + 4;
+                p += 4 + v->u.s.n + 1;
+                break;
+            default:
+                v->type = VALUE_NULL;
+                break;
+        }
+    }
+    for (; c < num_values && (wanted >> c) != 0; c++) {
+        if (wanted & (1u << c)) values[c].type = VALUE_NULL;
+    }
+}
@@ -0,0 +1,51 @@
+/*
+** SQLite Records for RISC OS
+** Packed row encoding shared by memory and disk
+**
+** A row is one contiguous allocation holding its record exactly as it is
+** written to the table's page chain:
+**
+**   [u32 body length][u16 column count]
+**   then per column: [u8 serial type][data]
+**
+** Serial types and their data:
+**   RECORD_NULL                  nothing
+**   RECORD_INT8/16/32/64         1/2/4/8 byte two's complement integer
+**   RECORD_REAL                  8 byte IEEE 754 bit pattern
+**   RECORD_TEXT, RECORD_BLOB     [u32 length][bytes][NUL]
+**
+** All integers are little-endian. Text carries a trailing NUL so decoded
+** values can point straight into the record.
+*/
+
+#ifndef _RECORD_H_
+#define _RECORD_H_
+
+#include "value.h"
+
+/* Serial types */
+#define RECORD_NULL     0
+#define RECORD_INT64    1
+#define RECORD_REAL     2
+#define RECORD_TEXT     3
+#define RECORD_BLOB     4
+#define RECORD_INT8     5
+#define RECORD_INT16    6
+#define RECORD_INT32    7
+
+/* Size of the length prefix and column count */
+#define RECORD_HDR_SIZE 6
+
+/* Encoding */
+int record_encode(const value_t *values, int num_values, unsigned char **prec);
+int record_size(const unsigned char *rec);
+
+/* Validation of a record read from disk (size includes the length prefix) */
+int record_check(const unsigned char *rec, int size, int max_columns);
+
+/* Decoding: values point into the record; missing columns are NULL */
+void record_decode(const unsigned char *rec, value_t *values, int num_values);
+void record_decode_columns(const unsigned char *rec, value_t *values, int num_values,
+                           unsigned int wanted);
+
+#endif /* _RECORD_H_ */
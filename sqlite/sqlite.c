@@ -6,6 +6,7 @@
 ** - Table schema management
 ** - In-memory result set handling
 ** - Transaction support
+** - Page-based persistence of tables through the pager (see pager.c)
 **
 ** Note: This is a simplified implementation for RISC OS memory constraints.
 ** A production version would use the full SQLite 2.8.17 source from sqlite.org.
@@ -19,20 +20,30 @@
 #include "sqlite.h"
 #include "os_riscos.h"
 #include "mem_riscos.h"
+#include "pager.h"
+#include "btree.h"
+#include "value.h"
+#include "record.h"
+#include "column.h"
+#include "hashidx.h"
+#include "ordidx.h"
+#include "tokenize.h"
+#include "expr.h"
+#include "vdbe.h"
 
 #define SQLITE_VERSION "2.8.17"
 #define SQLITE_VERSION_NUMBER 2008017
 
-/* Maximum number of tables */
-#define MAX_TABLES 32
-/* Maximum columns per table */
+/* Initial number of catalog hash buckets (a power of two) */
+#define CATALOG_INITIAL_BUCKETS 16
+/* Maximum columns per table (column sets are bitmasks in an unsigned int) */
 #define MAX_COLUMNS 16
 /* Maximum table name length */
 #define MAX_TABLE_NAME 64
 /* Maximum column name length */
 #define MAX_COL_NAME 32
-/* Maximum rows to store in memory */
-#define MAX_ROWS 1000
+/* Maximum columns in an index key */
+#define MAX_INDEX_COLUMNS 8
 
 /* Column type enumeration */
 typedef enum {
@@ -51,21 +62,47 @@ typedef struct {
     int not_null;
 } column_def_t;
 
-/* Table row data - stores actual values */
-typedef struct {
-    char **values;  /* Array of string values for each column */
-} table_row_t;
+/* Index types */
+#define INDEX_HASH  0
+#define INDEX_BTREE 1
+
+typedef struct table_def table_def_t;
+
+/* Secondary index on one or more columns of a table */
+typedef struct index_def index_def_t;
+struct index_def {
+    char name[MAX_TABLE_NAME];
+    int type;                       /* INDEX_HASH or INDEX_BTREE */
+    int unique;                     /* Created as UNIQUE */
+    int num_columns;
+    int columns[MAX_INDEX_COLUMNS]; /* Key columns, as table column numbers */
+    table_def_t *table;             /* Table the index belongs to */
+    unsigned int column_mask;       /* Key columns, one bit per column */
+    hashidx_t *hash;                /* Contents of an INDEX_HASH index */
+    ordidx_t *tree;                 /* Contents of an INDEX_BTREE index */
+    index_def_t *next;              /* Next index on the same table */
+};
 
 /* Table definition */
-typedef struct {
+struct table_def {
     char name[MAX_TABLE_NAME];
     int num_columns;
     column_def_t columns[MAX_COLUMNS];
-    /* Row data storage */
-    table_row_t *rows;  /* Array of rows */
-    int num_rows;       /* Current number of rows */
-    int row_capacity;   /* Allocated capacity for rows */
-} table_def_t;
+    /* Row data storage: B-tree of rowid -> packed record (see record.h) */
+    btree_t *rows;      /* Rows keyed by rowid (row layout) */
+    int columnar;       /* Created WITH (columnar) */
+    colstore_t *colstore; /* Column vectors (columnar layout), rowid = row + 1 */
+    btree_key_t last_rowid; /* Largest rowid allocated so far */
+    /* On-disk storage */
+    int first_page;     /* First page of the table's record chain */
+    int last_page;      /* Last page of the chain, where records are appended */
+    /* Secondary indexes (contents are rebuilt from the rows on open) */
+    index_def_t *indexes;
+    int readers;        /* Statement cursors open on the table */
+    /* Catalog */
+    int index;          /* Position in db->tables */
+    table_def_t *hash_next; /* Next table in the same hash bucket */
+};
 
 /* Result row (simple array of strings) */
 typedef struct {
@@ -82,18 +119,77 @@ typedef struct {
     int row_capacity;
 } result_set_t;
 
+/* Statements sqlite_exec keeps compiled, per connection */
+#define STMT_CACHE_SIZE 16
+#define STMT_CACHE_MAX_SQL 512      /* Longer SQL, such as a bulk INSERT, is not kept */
+
+/* Statement cache entry */
+typedef struct {
+    char *sql;                      /* Statement text, up to its end token */
+    int len;
+    sqlite_vm *vm;
+} stmt_cache_entry_t;
+
+/* Undo log entry types */
+#define UNDO_INSERT         0       /* Rows appended to a table */
+#define UNDO_CREATE_TABLE   1
+#define UNDO_DROP_TABLE     2       /* The entry keeps the table until it goes */
+#define UNDO_CREATE_INDEX   3
+#define UNDO_DROP_INDEX     4       /* The entry keeps the index until it goes */
+#define UNDO_ADD_COLUMN     5       /* INSERT gave a table with no columns one */
+
+/* How to take back one change made in the open transaction */
+typedef struct {
+    int type;
+    table_def_t *table;
+    index_def_t *index;
+    btree_key_t last_rowid;         /* UNDO_INSERT: rows above this are new */
+    int last_page;                  /* UNDO_INSERT: end of the record chain before */
+    int position;                   /* UNDO_DROP_INDEX: place in the table's list */
+} undo_entry_t;
+
+/* A savepoint: a point in the undo log, with no name if a statement's own */
+typedef struct {
+    char name[MAX_TABLE_NAME];
+    int undo_count;                 /* Undo entries made before it opened */
+} savepoint_def_t;
+
 /* SQLite database structure */
 struct sqlite {
+    riscos_vfs_t *vfs;              /* Backend the files are opened through */
     riscos_file_t dbfile;           /* Database file handle */
+    riscos_file_t walfile;          /* Write-ahead log file handle */
+    pager_t *pager;                 /* Page cache over dbfile */
     int is_open;                    /* Database is open */
     char *filename;                 /* Database filename */
+    char *wal_filename;             /* Log filename (database name + "-wal") */
     int cache_size;                 /* Number of pages to cache */
     int page_size;                  /* Page size in bytes */
     int in_transaction;             /* Inside a transaction */
 
+    /* Changes made since the last commit, and savepoints into them */
+    undo_entry_t *undo;             /* Oldest first */
+    int undo_count;
+    int undo_capacity;
+    savepoint_def_t *savepoints;    /* Innermost last; the index is the pager level */
+    int num_savepoints;
+    int savepoints_capacity;
+    int statement_savepoint;        /* Innermost savepoint is the running statement's */
+    int savepoint_transaction;      /* The transaction was started by SAVEPOINT */
+
     /* Table management */
-    table_def_t *tables;            /* Array of table definitions */
+    table_def_t **tables;           /* Table definitions, in no particular order */
     int num_tables;                 /* Number of tables */
+    int tables_capacity;            /* Allocated entries in tables */
+    table_def_t **table_hash;       /* Hash buckets keyed by lower-cased name */
+    int hash_buckets;               /* Number of buckets (a power of two) */
+    unsigned int schema_cookie;     /* Changed by every schema change */
+
+    /* Statements compiled by sqlite_exec, most recently used first */
+    stmt_cache_entry_t stmt_cache[STMT_CACHE_SIZE];
+    int stmt_cache_count;
+    int stmt_cache_hits;
+    int stmt_cache_misses;
 
     /* Last error */
     char error_msg[256];            /* Error message buffer */
@@ -102,45 +198,80 @@ struct sqlite {
 /*
 ** Forward declarations for helper functions
 */
-static int parse_sql_statement(sqlite *db, const char *sql,
+static int parse_sql_statement(sqlite *db, sql_lexer_t *lx,
                                int (*callback)(void*,int,char**,char**),
                                void *arg, char **errmsg);
-static int execute_create_table(sqlite *db, const char *sql, char **errmsg);
-static int execute_drop_table(sqlite *db, const char *sql, char **errmsg);
-static int execute_insert(sqlite *db, const char *sql, char **errmsg);
-static int execute_select(sqlite *db, const char *sql,
+static int execute_create_table(sqlite *db, sql_lexer_t *lx, char **errmsg);
+static int execute_drop_table(sqlite *db, sql_lexer_t *lx, char **errmsg);
+static int execute_create_index(sqlite *db, sql_lexer_t *lx, char **errmsg);
+static int execute_drop_index(sqlite *db, sql_lexer_t *lx, char **errmsg);
+static int execute_statement(sqlite *db, sql_lexer_t *lx,
+                             int (*callback)(void*,int,char**,char**),
+                             void *arg, char **errmsg);
+static int execute_pragma(sqlite *db, sql_lexer_t *lx,
                           int (*callback)(void*,int,char**,char**),
                           void *arg, char **errmsg);
+static int load_database(sqlite *db);
+static void free_table(table_def_t *table);
+static void stmt_cache_clear(sqlite *db);
 
 /*
-** Utility: Skip whitespace and return pointer to next non-whitespace char
+** Utility: Copy the name at the current token into buf and move past it
+** Quoted names lose their quotes. Returns the name's length, or 0 without
+** moving if the token is not a name.
 */
-static const char *skip_whitespace(const char *s)
+static int parse_identifier(sql_lexer_t *lx, char *buf, int size)
 {
-    while (*s && isspace(*s)) s++;
-    return s;
+    const char *z = SQL_TOKEN_TEXT(lx);
+    int n;
+
+    if (!TK_IS_NAME(lx->token.type) && !(lx->token.type == TK_STRING && *z == '"')) {
+        buf[0] = '\0';
+        return 0;
+    }
+    n = sql_dequote(z, lx->token.length, buf, size);
+    sql_lexer_next(lx);
+    return n;
 }
 
 /*
-** Utility: Compare keyword (case-insensitive)
+** Utility: Move past tokens up to the ',' or ')' that ends a list item
+** Parenthesised tokens are skipped as a whole. Returns 0 if the text
+** ends first.
 */
-static int keyword_match(const char *s, const char *keyword)
+static int skip_list_item(sql_lexer_t *lx)
 {
-    while (*keyword && *s) {
-        if (tolower(*s) != tolower(*keyword)) return 0;
-        s++;
-        keyword++;
+    int depth = 0;
+
+    for (;; sql_lexer_next(lx)) {
+        switch (lx->token.type) {
+            case TK_EOF:
+            case TK_SEMI:
+                return 0;
+            case TK_LP:
+                depth++;
+                break;
+            case TK_RP:
+                if (depth == 0) return 1;
+                depth--;
+                break;
+            case TK_COMMA:
+                if (depth == 0) return 1;
+                break;
+        }
     }
-    return *keyword == '\0' && (!*s || isspace(*s));
 }
 
 /*
 ** Open or create a SQLite database
+** mode is ignored: there is no read-only open, so the file and its log are
+** always opened for update and created if missing.
 */
 sqlite *sqlite_open(const char *filename, int mode, char **errmsg)
 {
     sqlite *db;
     int flags = O_RDWR;
+    int rc;
 
     if (!filename) {
         if (errmsg) *errmsg = "Invalid filename";
@@ -156,25 +287,23 @@ sqlite *sqlite_open(const char *filename, int mode, char **errmsg)
 
     memset(db, 0, sizeof(sqlite));
 
-    /* Allocate table array */
-    db->tables = (table_def_t *)riscos_malloc(sizeof(table_def_t) * MAX_TABLES);
-    if (!db->tables) {
+    /* Store filename */
+    db->filename = (char *)riscos_malloc(strlen(filename) + 1);
+    if (!db->filename) {
         if (errmsg) *errmsg = "Out of memory";
         riscos_free(db);
         return NULL;
     }
-    memset(db->tables, 0, sizeof(table_def_t) * MAX_TABLES);
-    db->num_tables = 0;
+    strcpy(db->filename, filename);
 
-    /* Store filename */
-    db->filename = (char *)riscos_malloc(strlen(filename) + 1);
-    if (!db->filename) {
+    db->wal_filename = (char *)riscos_malloc(strlen(filename) + 5);
+    if (!db->wal_filename) {
         if (errmsg) *errmsg = "Out of memory";
-        riscos_free(db->tables);
+        riscos_free(db->filename);
         riscos_free(db);
         return NULL;
     }
-    strcpy(db->filename, filename);
+    sprintf(db->wal_filename, "%s-wal", filename);
 
     /* Set defaults */
     db->cache_size = SQLITE_DEFAULT_CACHE_SIZE;
@@ -182,485 +311,3263 @@ sqlite *sqlite_open(const char *filename, int mode, char **errmsg)
     db->is_open = 0;
     db->in_transaction = 0;
 
-    /* Try to open existing database file */
-    if (riscos_vfs_open(filename, flags, &db->dbfile) != 0) {
-        /* File doesn't exist or can't open - create new one */
-        if (riscos_vfs_open(filename, flags | O_CREAT, &db->dbfile) != 0) {
-            if (errmsg) *errmsg = "Cannot open/create database file";
-            riscos_free(db->filename);
-            riscos_free(db->tables);
-            riscos_free(db);
-            return NULL;
-        }
+    /* ":memory:" keeps both files in the heap and never touches the disk */
+    db->vfs = riscos_vfs_find(strcmp(filename, ":memory:") == 0 ? "memory" : NULL);
+    if (!db->vfs) {
+        if (errmsg) *errmsg = "No file system backend";
+        riscos_free(db->wal_filename);
+        riscos_free(db->filename);
+        riscos_free(db);
+        return NULL;
+    }
+
+    /* Open the database file, creating it if it does not exist */
+    if (riscos_vfs_open(db->vfs, filename, flags | O_CREAT, &db->dbfile) != 0) {
+        if (errmsg) *errmsg = "Cannot open/create database file";
+        riscos_free(db->wal_filename);
+        riscos_free(db->filename);
+        riscos_free(db);
+        return NULL;
     }
 
     db->is_open = 1;
+
+    /* The log has no locking of its own, so only one open may use a database */
+    if (riscos_vfs_lock(&db->dbfile, RISCOS_LOCK_EXCLUSIVE) != 0) {
+        if (errmsg) *errmsg = "Database is locked";
+        sqlite_close(db);
+        return NULL;
+    }
+
+    /* Commits go to the log next to the database, which may hold some
+    ** already; it is created if missing (sqlite_close deletes it) */
+    if (riscos_vfs_open(db->vfs, db->wal_filename, flags | O_CREAT, &db->walfile) != 0) {
+        if (errmsg) *errmsg = "Cannot open/create write-ahead log";
+        sqlite_close(db);
+        return NULL;
+    }
+
+    /* Attach the pager and load any tables stored in the files */
+    rc = pager_open(&db->dbfile, &db->walfile, db->page_size, &db->pager);
+    if (rc == SQLITE_OK) {
+        db->page_size = pager_page_size(db->pager);
+        pager_set_cache_size(db->pager, db->cache_size);
+        rc = load_database(db);
+    }
+    if (rc != SQLITE_OK) {
+        if (errmsg) {
+            if (rc == SQLITE_CORRUPT) *errmsg = "Database file is corrupt";
+            else if (rc == SQLITE_NOMEM) *errmsg = "Out of memory";
+            else *errmsg = "Disk I/O error";
+        }
+        sqlite_close(db);
+        return NULL;
+    }
+
     return db;
 }
 
 /*
-** Close a SQLite database
+** B-tree payload destructor for table rows: a row is a single record
 */
-void sqlite_close(sqlite *db)
+static void free_row_payload(void *payload, void *arg)
 {
-    if (!db) return;
-
-    if (db->is_open && db->dbfile.handle != 0) {
-        riscos_vfs_close(&db->dbfile);
-    }
+    riscos_free(payload);
+}
 
-    if (db->filename) {
-        riscos_free(db->filename);
+/*
+** Storage affinity of a column
+*/
+static value_affinity_t column_affinity(const column_def_t *col)
+{
+    switch (col->type) {
+        case COL_INTEGER: return AFFINITY_INTEGER;
+        case COL_REAL:    return AFFINITY_REAL;
+        case COL_TEXT:    return AFFINITY_TEXT;
+        case COL_BLOB:    return AFFINITY_BLOB;
+        default:          return AFFINITY_NONE;
     }
+}
 
-    /* Free table definitions and their data */
-    if (db->tables) {
-        int t, r, c;
-        for (t = 0; t < db->num_tables; t++) {
-            table_def_t *table = &db->tables[t];
-            /* Free row data */
-            if (table->rows) {
-                for (r = 0; r < table->num_rows; r++) {
-                    if (table->rows[r].values) {
-                        for (c = 0; c < table->num_columns; c++) {
-                            if (table->rows[r].values[c]) {
-                                riscos_free(table->rows[r].values[c]);
-                            }
-                        }
-                        riscos_free(table->rows[r].values);
-                    }
-                }
-                riscos_free(table->rows);
-            }
-        }
-        riscos_free(db->tables);
+/*
+** Create empty row storage in the table's layout
+*/
+static int create_table_rows(table_def_t *table)
+{
+    if (table->columnar) {
+        table->colstore = colstore_create(table->num_columns);
+        return table->colstore ? SQLITE_OK : SQLITE_NOMEM;
     }
+    table->rows = btree_create();
+    return table->rows ? SQLITE_OK : SQLITE_NOMEM;
+}
 
-    riscos_free(db);
+/*
+** Free all row data held by a table
+*/
+static void free_table_rows(table_def_t *table)
+{
+    btree_destroy(table->rows, free_row_payload, NULL);
+    table->rows = NULL;
+    colstore_destroy(table->colstore);
+    table->colstore = NULL;
 }
 
 /*
-** Find a table by name
+** Add a row to a table under the next rowid
+** Ownership of the record passes to the table on success; a columnar
+** table copies the values into its column vectors and frees the record.
 */
-static table_def_t *find_table(sqlite *db, const char *name)
+static int insert_table_row(table_def_t *table, unsigned char *rec)
 {
-    int i;
-    for (i = 0; i < db->num_tables; i++) {
-        if (strcasecmp(db->tables[i].name, name) == 0) {
-            return &db->tables[i];
-        }
+    int rc;
+
+    if (table->colstore) {
+        value_t values[MAX_COLUMNS];
+        record_decode(rec, values, table->num_columns);
+        rc = colstore_append(table->colstore, values);
+        if (rc == SQLITE_OK) riscos_free(rec);
+    } else {
+        rc = btree_insert(table->rows, table->last_rowid + 1, rec);
     }
-    return NULL;
+    if (rc == SQLITE_OK) table->last_rowid++;
+    return rc;
 }
 
+/* Rows materialised at a time when scanning a columnar table */
+#define SCAN_BATCH 32
+
 /*
-** Create table - simple implementation
+** Sequential scan over a table in either storage layout
+** Row-layout tables decode one record at a time; columnar tables copy a
+** batch of rows out of each column vector in turn, so the inner loops run
+** down contiguous memory. Only the columns in the scan's mask are read;
+** the others are NULL.
 */
-static int execute_create_table(sqlite *db, const char *sql, char **errmsg)
-{
-    const char *p;
-    char table_name[MAX_TABLE_NAME];
+typedef struct {
     table_def_t *table;
+    unsigned int columns;           /* Columns to read, one bit per column */
+    btree_cursor_t cur;             /* Row layout: position in the B-tree */
+    int started;
+    value_t row[MAX_COLUMNS];       /* Row layout: current row */
+    value_t *batch;                 /* Columnar: SCAN_BATCH rows of values */
+    int next_row;                   /* Columnar: first row of the next batch */
+    int batch_rows;                 /* Columnar: rows in the current batch */
+    int batch_pos;                  /* Columnar: current row in the batch */
+    btree_key_t rowid;              /* Rowid of the row last returned */
+} table_scan_t;
+
+static int scan_open(table_scan_t *scan, table_def_t *table, unsigned int columns)
+{
     int i;
 
-    if (db->num_tables >= MAX_TABLES) {
-        if (errmsg) *errmsg = "Too many tables";
-        return SQLITE_ERROR;
+    memset(scan, 0, sizeof(table_scan_t));
+    scan->table = table;
+    scan->columns = columns;
+    for (i = 0; i < table->num_columns; i++) scan->row[i].type = VALUE_NULL;
+    if (table->colstore) {
+        int n = SCAN_BATCH * table->num_columns;
+        scan->batch = (value_t *)riscos_malloc(n * sizeof(value_t));
+        if (!scan->batch) return SQLITE_NOMEM;
+        for (i = 0; i < n; i++) scan->batch[i].type = VALUE_NULL;
     }
+    return SQLITE_OK;
+}
 
-    /* Very basic parsing: CREATE TABLE name (...) */
-    p = sql;
-    p = skip_whitespace(p + 12);  /* Skip "CREATE TABLE" */
-
-    /* Extract table name */
-    i = 0;
-    while (*p && *p != '(' && !isspace(*p) && i < MAX_TABLE_NAME - 1) {
-        table_name[i++] = *p++;
+/*
+** Advance to the next row
+** Returns the row's values (valid until the next call), or NULL at the end.
+*/
+static value_t *scan_next(table_scan_t *scan)
+{
+    table_def_t *table = scan->table;
+    int c, n;
+
+    if (!table->colstore) {
+        int more = scan->started ? btree_next(&scan->cur)
+                                 : btree_first(table->rows, &scan->cur);
+        scan->started = 1;
+        if (!more) return NULL;
+        record_decode_columns((unsigned char *)btree_cursor_payload(&scan->cur),
+                              scan->row, table->num_columns, scan->columns);
+        scan->rowid = btree_cursor_key(&scan->cur);
+        return scan->row;
     }
-    table_name[i] = '\0';
 
-    if (i == 0) {
-        if (errmsg) *errmsg = "Missing table name";
-        return SQLITE_ERROR;
+    if (scan->batch_pos == scan->batch_rows) {
+        n = colstore_count(table->colstore) - scan->next_row;
+        if (n <= 0) return NULL;
+        if (n > SCAN_BATCH) n = SCAN_BATCH;
+        for (c = 0; c < table->num_columns; c++) {
+            if (!(scan->columns & (1u << c))) continue;
+            colstore_fetch(table->colstore, c, scan->next_row, n,
+                           scan->batch + c, table->num_columns);
+        }
+        scan->next_row += n;
+        scan->batch_rows = n;
+        scan->batch_pos = 0;
     }
+    scan->rowid = scan->next_row - scan->batch_rows + scan->batch_pos + 1;
+    return scan->batch + table->num_columns * scan->batch_pos++;
+}
 
-    /* Check if table already exists */
-    if (find_table(db, table_name)) {
-        if (errmsg) *errmsg = "Table already exists";
-        return SQLITE_ERROR;
+static void scan_close(table_scan_t *scan)
+{
+    if (scan->batch) riscos_free(scan->batch);
+    scan->batch = NULL;
+}
+
+/*
+** Number of rows in a table
+*/
+static int table_row_count(table_def_t *table)
+{
+    return table->colstore ? colstore_count(table->colstore) : btree_count(table->rows);
+}
+
+/*
+** Fetch the given columns of one row by rowid into values
+** Other values are left untouched. Returns 0 if there is no such row.
+** Text values stay valid until the table is next modified.
+*/
+static int table_fetch_columns(table_def_t *table, btree_key_t rowid, value_t *values,
+                               unsigned int columns)
+{
+    int c;
+
+    if (table->colstore) {
+        if (rowid < 1 || rowid > colstore_count(table->colstore)) return 0;
+        for (c = 0; c < table->num_columns; c++) {
+            if (!(columns & (1u << c))) continue;
+            colstore_fetch(table->colstore, c, (int)(rowid - 1), 1, &values[c], 1);
+        }
+        return 1;
+    } else {
+        unsigned char *rec = (unsigned char *)btree_lookup(table->rows, rowid);
+        if (!rec) return 0;
+        record_decode_columns(rec, values, table->num_columns, columns);
+        return 1;
     }
+}
 
-    /* Create new table entry */
-    table = &db->tables[db->num_tables++];
-    strcpy(table->name, table_name);
-    table->num_columns = 0;
+/*
+** Secondary indexes
+** A hash index maps the hash of a row's key columns to its rowid. Rows
+** with a NULL in any key column are left out: NULL never equals anything,
+** so no equality lookup could return them.
+**
+** An ordered (B-tree) index holds every row, NULL keys first, sorted by
+** key and then rowid. It serves range conditions and ORDER BY as well as
+** equality.
+*/
 
-    /* Initialize row storage */
-    table->rows = NULL;
-    table->num_rows = 0;
-    table->row_capacity = 0;
+/* Search key for an ordered index: values for its leading key columns */
+typedef struct {
+    const value_t *values;
+    int num_columns;
+} index_key_t;
 
-    /* Very simplified: we'd parse column definitions here */
-    /* For now, just create an empty table */
+/*
+** Free an index and its contents
+*/
+static void free_index(index_def_t *index)
+{
+    hashidx_destroy(index->hash);
+    ordidx_destroy(index->tree);
+    riscos_free(index);
+}
 
-    return SQLITE_OK;
+/*
+** Compare a search key with the key columns of a row
+*/
+static int index_key_compare(index_def_t *index, const index_key_t *key,
+                             const value_t *row)
+{
+    int k, c;
+
+    for (k = 0; k < key->num_columns; k++) {
+        c = value_compare(&key->values[k], &row[index->columns[k]]);
+        if (c != 0) return c;
+    }
+    return 0;
 }
 
 /*
-** Drop table
+** Ordered index comparison callback: reads the key from the row itself
 */
-static int execute_drop_table(sqlite *db, const char *sql, char **errmsg)
+static int index_compare_rowid(void *arg, const void *key, btree_key_t rowid)
 {
-    const char *p;
-    char table_name[MAX_TABLE_NAME];
-    table_def_t *table;
-    int i;
+    index_def_t *index = (index_def_t *)arg;
+    value_t row[MAX_COLUMNS];
 
-    p = sql;
-    p = skip_whitespace(p + 10);  /* Skip "DROP TABLE" */
+    if (!table_fetch_columns(index->table, rowid, row, index->column_mask)) return 1;
+    return index_key_compare(index, (const index_key_t *)key, row);
+}
 
-    /* Extract table name */
-    i = 0;
-    while (*p && !isspace(*p) && i < MAX_TABLE_NAME - 1) {
-        table_name[i++] = *p++;
-    }
-    table_name[i] = '\0';
+/*
+** Gather a row's key columns into key order
+*/
+static void index_row_key(index_def_t *index, const value_t *values,
+                          value_t *key_values, index_key_t *key)
+{
+    int k;
 
-    if (i == 0) {
-        if (errmsg) *errmsg = "Missing table name";
-        return SQLITE_ERROR;
+    for (k = 0; k < index->num_columns; k++) {
+        key_values[k] = values[index->columns[k]];
     }
+    key->values = key_values;
+    key->num_columns = index->num_columns;
+}
 
-    /* Find and remove table */
-    table = find_table(db, table_name);
-    if (!table) {
-        if (errmsg) *errmsg = "Table not found";
-        return SQLITE_ERROR;
+/*
+** Create the empty contents of an index
+*/
+static int index_create_contents(table_def_t *table, index_def_t *index)
+{
+    int k;
+
+    index->table = table;
+    index->column_mask = 0;
+    for (k = 0; k < index->num_columns; k++) {
+        index->column_mask |= 1u << index->columns[k];
     }
+    if (index->type == INDEX_BTREE) {
+        index->tree = ordidx_create(index_compare_rowid, index);
+        return index->tree ? SQLITE_OK : SQLITE_NOMEM;
+    }
+    index->hash = hashidx_create();
+    return index->hash ? SQLITE_OK : SQLITE_NOMEM;
+}
 
-    /* Free row data */
-    if (table->rows) {
-        int r, c;
-        for (r = 0; r < table->num_rows; r++) {
-            if (table->rows[r].values) {
-                for (c = 0; c < table->num_columns; c++) {
-                    if (table->rows[r].values[c]) {
-                        riscos_free(table->rows[r].values[c]);
-                    }
-                }
-                riscos_free(table->rows[r].values);
-            }
-        }
-        riscos_free(table->rows);
+/*
+** Hash the key of a row for an index
+** Returns 0 if a key column is NULL, in which case the row is not indexed.
+*/
+static int index_key_hash(index_def_t *index, const value_t *values,
+                          unsigned int *phash)
+{
+    unsigned int h = 0;
+    int k;
+
+    for (k = 0; k < index->num_columns; k++) {
+        const value_t *v = &values[index->columns[k]];
+        if (v->type == VALUE_NULL) return 0;
+        h = h * 31 + value_hash(v);
     }
+    *phash = h;
+    return 1;
+}
 
-    /* Remove by shifting remaining tables */
-    for (i = 0; i < db->num_tables; i++) {
-        if (strcasecmp(db->tables[i].name, table_name) == 0) {
-            int j;
-            for (j = i; j < db->num_tables - 1; j++) {
-                db->tables[j] = db->tables[j + 1];
+/*
+** Check whether another row already has the key of values
+** A key containing NULL never matches.
+*/
+static int index_has_key(table_def_t *table, index_def_t *index,
+                         const value_t *values)
+{
+    value_t row[MAX_COLUMNS];
+    unsigned int hash;
+    int k;
+
+    if (!index_key_hash(index, values, &hash)) return 0;
+
+    if (index->type == INDEX_BTREE) {
+        value_t key_values[MAX_INDEX_COLUMNS];
+        index_key_t key;
+        ordidx_cursor_t cur;
+
+        index_row_key(index, values, key_values, &key);
+        return ordidx_seek(index->tree, &key, 0, &cur) &&
+               table_fetch_columns(table, ordidx_cursor_rowid(&cur), row,
+                                   index->column_mask) &&
+               index_key_compare(index, &key, row) == 0;
+    } else {
+        hashidx_probe_t probe;
+        btree_key_t rowid;
+
+        hashidx_probe(index->hash, hash, &probe);
+        while (hashidx_next(&probe, &rowid)) {
+            if (!table_fetch_columns(table, rowid, row, index->column_mask)) continue;
+            for (k = 0; k < index->num_columns; k++) {
+                int c = index->columns[k];
+                if (value_compare(&row[c], &values[c]) != 0) break;
             }
-            db->num_tables--;
-            break;
+            if (k == index->num_columns) return 1;
         }
+        return 0;
     }
-
-    return SQLITE_OK;
 }
 
 /*
-** Execute INSERT statement
-** Simple parser for: INSERT INTO table VALUES (val1, val2, ...)
+** Add one stored row to an index
 */
-static int execute_insert(sqlite *db, const char *sql, char **errmsg)
+static int index_add_row(index_def_t *index, const value_t *values,
+                         btree_key_t rowid)
 {
-    const char *p;
-    char table_name[MAX_TABLE_NAME];
-    table_def_t *table;
-    table_row_t new_row;
-    char value_buf[256];
-    int i, val_idx;
-
-    p = sql;
-    /* Skip "INSERT INTO" */
-    p = skip_whitespace(p + 6);  /* Skip "INSERT" */
-    if (!keyword_match(p, "INTO")) {
-        if (errmsg) *errmsg = "Expected INTO after INSERT";
-        return SQLITE_ERROR;
-    }
-    p = skip_whitespace(p + 4);  /* Skip "INTO" */
+    unsigned int hash;
 
-    /* Extract table name */
-    i = 0;
-    while (*p && *p != '(' && !isspace(*p) && i < MAX_TABLE_NAME - 1) {
-        table_name[i++] = *p++;
-    }
-    table_name[i] = '\0';
+    if (index->type == INDEX_BTREE) {
+        value_t key_values[MAX_INDEX_COLUMNS];
+        index_key_t key;
 
-    if (i == 0) {
-        if (errmsg) *errmsg = "Missing table name in INSERT";
-        return SQLITE_ERROR;
+        index_row_key(index, values, key_values, &key);
+        return ordidx_insert(index->tree, &key, rowid);
     }
+    if (!index_key_hash(index, values, &hash)) return SQLITE_OK;
+    return hashidx_insert(index->hash, hash, rowid);
+}
 
-    /* Find table */
-    table = find_table(db, table_name);
-    if (!table) {
-        if (errmsg) *errmsg = "Table not found";
-        return SQLITE_ERROR;
-    }
+/*
+** Take one stored row out of an index
+** The row must still be readable: ordered index comparisons fetch keys.
+*/
+static void index_remove_row(index_def_t *index, const value_t *values,
+                             btree_key_t rowid)
+{
+    unsigned int hash;
 
-    /* For simplified implementation, assume table has at least one column */
-    if (table->num_columns == 0) {
-        /* Auto-create columns if none exist */
-        table->num_columns = 1;
-        strcpy(table->columns[0].name, "value");
-        table->columns[0].type = COL_TEXT;
-    }
+    if (index->type == INDEX_BTREE) {
+        value_t key_values[MAX_INDEX_COLUMNS];
+        index_key_t key;
 
-    /* Skip to VALUES */
-    p = skip_whitespace(p);
-    if (!keyword_match(p, "VALUES")) {
-        if (errmsg) *errmsg = "Expected VALUES in INSERT";
-        return SQLITE_ERROR;
+        index_row_key(index, values, key_values, &key);
+        ordidx_remove(index->tree, &key, rowid);
+    } else if (index_key_hash(index, values, &hash)) {
+        hashidx_remove(index->hash, hash, rowid);
     }
-    p = skip_whitespace(p + 6);  /* Skip "VALUES" */
+}
 
-    /* Find opening parenthesis */
-    while (*p && *p != '(') p++;
-    if (*p != '(') {
-        if (errmsg) *errmsg = "Expected ( after VALUES";
-        return SQLITE_ERROR;
-    }
-    p++;  /* Skip '(' */
+/*
+** Fill a new index from the table's existing rows
+*/
+static int build_index(table_def_t *table, index_def_t *index)
+{
+    table_scan_t scan;
+    value_t *values;
+    int rc = SQLITE_OK;
 
-    /* Allocate row */
-    if (table->num_rows >= table->row_capacity) {
-        int new_capacity = table->row_capacity == 0 ? 10 : table->row_capacity * 2;
-        if (new_capacity > MAX_ROWS) new_capacity = MAX_ROWS;
-        if (table->num_rows >= MAX_ROWS) {
-            if (errmsg) *errmsg = "Too many rows";
-            return SQLITE_ERROR;
-        }
-        table->rows = (table_row_t *)riscos_realloc(table->rows,
-                                                     sizeof(table_row_t) * new_capacity);
-        if (!table->rows) {
-            if (errmsg) *errmsg = "Out of memory";
-            return SQLITE_ERROR;
-        }
-        table->row_capacity = new_capacity;
+    if (index->type == INDEX_HASH) {
+        rc = hashidx_reserve(index->hash, table_row_count(table));
     }
+    if (rc == SQLITE_OK) rc = scan_open(&scan, table, index->column_mask);
+    if (rc != SQLITE_OK) return rc;
 
-    /* Allocate values array for this row */
-    new_row.values = (char **)riscos_malloc(sizeof(char *) * table->num_columns);
-    if (!new_row.values) {
-        if (errmsg) *errmsg = "Out of memory";
-        return SQLITE_ERROR;
+    while ((values = scan_next(&scan)) != NULL) {
+        if (index->unique && index_has_key(table, index, values)) {
+            rc = SQLITE_CONSTRAINT;
+            break;
+        }
+        rc = index_add_row(index, values, scan.rowid);
+        if (rc != SQLITE_OK) break;
     }
 
-    /* Initialize all values to NULL */
-    for (i = 0; i < table->num_columns; i++) {
-        new_row.values[i] = NULL;
-    }
+    scan_close(&scan);
+    return rc;
+}
 
-    /* Parse values */
-    val_idx = 0;
-    while (*p && *p != ')' && val_idx < table->num_columns) {
-        p = skip_whitespace(p);
+/*
+** Prepare every index of a table to take a new row
+** Enforces UNIQUE and reserves room, so that index_insert_row() cannot
+** fail once the row has been stored.
+*/
+static int index_prepare_insert(table_def_t *table, const value_t *values)
+{
+    index_def_t *index;
+    int rc;
 
-        /* Extract value (simple string or number) */
-        i = 0;
-        if (*p == '\'' || *p == '"') {
-            /* Quoted string */
-            char quote = *p++;
-            while (*p && *p != quote && i < 255) {
-                value_buf[i++] = *p++;
-            }
-            if (*p == quote) p++;
-        } else {
-            /* Unquoted value */
-            while (*p && *p != ',' && *p != ')' && i < 255) {
-                value_buf[i++] = *p++;
-            }
+    for (index = table->indexes; index; index = index->next) {
+        if (index->unique && index_has_key(table, index, values)) {
+            return SQLITE_CONSTRAINT;
         }
-        value_buf[i] = '\0';
-
-        /* Trim whitespace from value */
-        i = strlen(value_buf);
-        while (i > 0 && isspace(value_buf[i-1])) i--;
-        value_buf[i] = '\0';
-
-        /* Allocate and store value */
-        new_row.values[val_idx] = (char *)riscos_malloc(strlen(value_buf) + 1);
-        if (new_row.values[val_idx]) {
-            strcpy(new_row.values[val_idx], value_buf);
+        if (index->type == INDEX_BTREE) {
+            rc = ordidx_reserve(index->tree);
+        } else {
+            rc = hashidx_reserve(index->hash, hashidx_count(index->hash) + 1);
         }
-
-        val_idx++;
-
-        /* Skip comma */
-        p = skip_whitespace(p);
-        if (*p == ',') p++;
+        if (rc != SQLITE_OK) return rc;
     }
-
-    /* Add row to table */
-    table->rows[table->num_rows++] = new_row;
-
     return SQLITE_OK;
 }
 
 /*
-** Execute SELECT statement
-** Simple parser for: SELECT * FROM table [WHERE condition]
-** For now, we support: SELECT * FROM table
+** Add a stored row to every index of its table
 */
-static int execute_select(sqlite *db, const char *sql,
-                          int (*callback)(void*,int,char**,char**),
-                          void *arg, char **errmsg)
+static void index_insert_row(table_def_t *table, const value_t *values,
+                             btree_key_t rowid)
 {
-    const char *p;
-    char table_name[MAX_TABLE_NAME];
-    table_def_t *table;
-    char **col_names;
-    int i, r;
+    index_def_t *index;
 
-    p = sql;
-    /* Skip "SELECT" */
-    p = skip_whitespace(p + 6);  /* Skip "SELECT" */
+    for (index = table->indexes; index; index = index->next) {
+        index_add_row(index, values, rowid);
+    }
+}
+
+/*
+** Make room for rows more rows in the table's storage and hash indexes
+** Only a hint: the B-trees grow a node at a time whatever happens.
+*/
+static int table_reserve(table_def_t *table, int rows)
+{
+    index_def_t *index;
+    int rc = SQLITE_OK;
 
-    /* For now, expect * (select all) */
-    p = skip_whitespace(p);
-    if (*p != '*') {
-        /* Simple column list support - skip to FROM */
-        while (*p && !keyword_match(p, "FROM")) {
-            p++;
+    if (table->colstore) rc = colstore_reserve(table->colstore, rows);
+    for (index = table->indexes; index && rc == SQLITE_OK; index = index->next) {
+        if (index->type == INDEX_HASH) {
+            rc = hashidx_reserve(index->hash, hashidx_count(index->hash) + rows);
         }
-    } else {
-        p++;  /* Skip '*' */
     }
+    return rc;
+}
 
-    /* Skip to FROM */
-    p = skip_whitespace(p);
-    if (!keyword_match(p, "FROM")) {
+/*
+** Free a table definition and its rows
+*/
+static void free_table(table_def_t *table)
+{
+    while (table->indexes) {
+        index_def_t *index = table->indexes;
+        table->indexes = index->next;
+        free_index(index);
+    }
+    free_table_rows(table);
+    riscos_free(table);
+}
+
+/*
+** Table catalog
+** Tables are allocated individually and indexed two ways: a dense vector
+** (db->tables) for iteration, and a chained hash table keyed by the
+** case-folded name for lookup. Removal swaps the last vector entry into
+** the freed slot, so every catalog operation is O(1).
+*/
+
+/*
+** Case-insensitive FNV-1a hash of a table name
+*/
+static unsigned int catalog_hash(const char *name)
+{
+    unsigned int h = 2166136261u;
+    while (*name) {
+        h ^= (unsigned char)tolower((unsigned char)*name++);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*
+** Find a table by name
+*/
+static table_def_t *find_table(sqlite *db, const char *name)
+{
+    table_def_t *table;
+
+    if (db->hash_buckets == 0) return NULL;
+    table = db->table_hash[catalog_hash(name) & (db->hash_buckets - 1)];
+    while (table && strcasecmp(table->name, name) != 0) {
+        table = table->hash_next;
+    }
+    return table;
+}
+
+/*
+** Rebuild the hash table with the given number of buckets
+*/
+static int catalog_rehash(sqlite *db, int buckets)
+{
+    table_def_t **hash;
+    int t;
+
+    hash = (table_def_t **)riscos_calloc(buckets, sizeof(table_def_t *));
+    if (!hash) return SQLITE_NOMEM;
+
+    for (t = 0; t < db->num_tables; t++) {
+        table_def_t *table = db->tables[t];
+        unsigned int h = catalog_hash(table->name) & (buckets - 1);
+        table->hash_next = hash[h];
+        hash[h] = table;
+    }
+
+    if (db->table_hash) riscos_free(db->table_hash);
+    db->table_hash = hash;
+    db->hash_buckets = buckets;
+    return SQLITE_OK;
+}
+
+/*
+** Add a table to the catalog
+*/
+static int catalog_add(sqlite *db, table_def_t *table)
+{
+    unsigned int h;
+    int rc;
+
+    if (db->num_tables == db->tables_capacity) {
+        int capacity = db->tables_capacity ? db->tables_capacity * 2
+                                           : CATALOG_INITIAL_BUCKETS;
+        table_def_t **tables = (table_def_t **)riscos_realloc(db->tables,
+                                   capacity * sizeof(table_def_t *));
+        if (!tables) return SQLITE_NOMEM;
+        db->tables = tables;
+        db->tables_capacity = capacity;
+    }
+
+    /* Keep the load factor at or below one */
+    if (db->num_tables >= db->hash_buckets) {
+        rc = catalog_rehash(db, db->hash_buckets ? db->hash_buckets * 2
+                                                 : CATALOG_INITIAL_BUCKETS);
+        if (rc != SQLITE_OK) return rc;
+    }
+
+    h = catalog_hash(table->name) & (db->hash_buckets - 1);
+    table->hash_next = db->table_hash[h];
+    db->table_hash[h] = table;
+    table->index = db->num_tables;
+    db->tables[db->num_tables++] = table;
+    return SQLITE_OK;
+}
+
+/*
+** Remove a table from the catalog (the table itself is not freed)
+*/
+static void catalog_remove(sqlite *db, table_def_t *table)
+{
+    table_def_t **link;
+    table_def_t *last;
+
+    link = &db->table_hash[catalog_hash(table->name) & (db->hash_buckets - 1)];
+    while (*link != table) link = &(*link)->hash_next;
+    *link = table->hash_next;
+
+    last = db->tables[--db->num_tables];
+    db->tables[table->index] = last;
+    last->index = table->index;
+}
+
+/*
+** Schema format (a single page chain rooted in the file header):
+**   [u32 table count]
+**   then per table: [u8 name length][name][u8 flags][u8 column count]
+**                   per column: [u8 name length][name][u8 type][u8 pk][u8 not null]
+**                   [u32 first page of record chain]
+**                   [u8 index count]
+**                   per index: [u8 name length][name][u8 type][u8 unique]
+**                              [u8 key column count][u8 column number]...
+** Columnar tables keep the same record chain; only their in-memory layout
+** differs. Index contents are not stored; they are rebuilt on open.
+*/
+
+/* Table flags in the schema */
+#define SCHEMA_TABLE_COLUMNAR 0x01
+
+/*
+** Rewrite the schema chain after a schema change
+** Also invalidates every compiled statement (see sqlite_compile).
+*/
+static int write_schema(sqlite *db)
+{
+    unsigned char *buf, *p;
+    int size, t, c;
+    int root, tail;
+    int rc;
+
+    db->schema_cookie++;
+
+    size = 4;
+    for (t = 0; t < db->num_tables; t++) {
+        table_def_t *table = db->tables[t];
+        index_def_t *index;
+        size += 1 + strlen(table->name) + 1 + 1 + 4 + 1;
+        for (c = 0; c < table->num_columns; c++) {
+            size += 1 + strlen(table->columns[c].name) + 3;
+        }
+        for (index = table->indexes; index; index = index->next) {
+            size += 1 + strlen(index->name) + 3 + index->num_columns;
+        }
+    }
+
+    buf = (unsigned char *)riscos_malloc(size);
+    if (!buf) return SQLITE_NOMEM;
+
+    p = buf;
+    pager_put_u32(p, (unsigned int)db->num_tables);
+    p += 4;
+    for (t = 0; t < db->num_tables; t++) {
+        table_def_t *table = db->tables[t];
+        index_def_t *index;
+        unsigned char *count;
+        int len = strlen(table->name);
+        *p++ = (unsigned char)len;
+        memcpy(p, table->name, len);
+        p += len;
+        *p++ = table->columnar ? SCHEMA_TABLE_COLUMNAR : 0;
+        *p++ = (unsigned char)table->num_columns;
+        for (c = 0; c < table->num_columns; c++) {
+            column_def_t *col = &table->columns[c];
+            len = strlen(col->name);
+            *p++ = (unsigned char)len;
+            memcpy(p, col->name, len);
+            p += len;
+            *p++ = (unsigned char)col->type;
+            *p++ = (unsigned char)col->primary_key;
+            *p++ = (unsigned char)col->not_null;
+        }
+        pager_put_u32(p, (unsigned int)table->first_page);
+        p += 4;
+
+        count = p++;
+        *count = 0;
+        for (index = table->indexes; index; index = index->next) {
+            len = strlen(index->name);
+            *p++ = (unsigned char)len;
+            memcpy(p, index->name, len);
+            p += len;
+            *p++ = (unsigned char)index->type;
+            *p++ = (unsigned char)index->unique;
+            *p++ = (unsigned char)index->num_columns;
+            for (c = 0; c < index->num_columns; c++) {
+                *p++ = (unsigned char)index->columns[c];
+            }
+            (*count)++;
+        }
+    }
+
+    /* Replace the old schema chain with a new one */
+    root = pager_schema_root(db->pager);
+    if (root != 0) {
+        rc = pager_chain_free(db->pager, root);
+        if (rc != SQLITE_OK) {
+            riscos_free(buf);
+            return rc;
+        }
+    }
+    rc = pager_chain_new(db->pager, &root);
+    if (rc == SQLITE_OK) {
+        tail = root;
+        rc = pager_chain_append(db->pager, &tail, buf, size);
+    }
+    if (rc == SQLITE_OK) {
+        pager_set_schema_root(db->pager, root);
+    }
+
+    riscos_free(buf);
+    return rc;
+}
+
+/*
+** Read exactly count bytes from a chain
+*/
+static int chain_read_exact(pager_chain_reader_t *reader, void *buf, int count)
+{
+    int n = pager_chain_read(reader, buf, count);
+    if (n < 0) return SQLITE_IOERR;
+    return n == count ? SQLITE_OK : SQLITE_CORRUPT;
+}
+
+/*
+** Load one table's records from its page chain
+** Each record is read straight into its own allocation and becomes the row.
+*/
+static int load_table_rows(sqlite *db, table_def_t *table)
+{
+    pager_chain_reader_t reader;
+    unsigned char len_buf[4];
+    int rc;
+
+    rc = create_table_rows(table);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = pager_chain_open(db->pager, table->first_page, &reader);
+    if (rc != SQLITE_OK) return rc;
+
+    for (;;) {
+        unsigned char *rec;
+        int n, size;
+
+        n = pager_chain_read(&reader, len_buf, 4);
+        if (n == 0) break;
+        if (n != 4) {
+            rc = n < 0 ? SQLITE_IOERR : SQLITE_CORRUPT;
+            break;
+        }
+        size = 4 + (int)pager_get_u32(len_buf);
+        if (size < RECORD_HDR_SIZE || size > SQLITE_MAX_LENGTH * MAX_COLUMNS) {
+            rc = SQLITE_CORRUPT;
+            break;
+        }
+
+        rec = (unsigned char *)riscos_malloc(size);
+        if (!rec) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+        memcpy(rec, len_buf, 4);
+        rc = chain_read_exact(&reader, rec + 4, size - 4);
+        if (rc == SQLITE_OK) rc = record_check(rec, size, table->num_columns);
+        if (rc == SQLITE_OK) rc = insert_table_row(table, rec);
+        if (rc != SQLITE_OK) {
+            riscos_free(rec);
+            break;
+        }
+    }
+
+    table->last_page = reader.last_pgno;
+    pager_chain_close(&reader);
+    return rc;
+}
+
+/*
+** Read a table's index definitions from the schema
+*/
+static int load_index_defs(pager_chain_reader_t *reader, table_def_t *table)
+{
+    index_def_t **tail = &table->indexes;
+    unsigned char count, len, attrs[3], col;
+    int i, k;
+    int rc;
+
+    rc = chain_read_exact(reader, &count, 1);
+    for (i = 0; rc == SQLITE_OK && i < count; i++) {
+        index_def_t *index = (index_def_t *)riscos_calloc(1, sizeof(index_def_t));
+        if (!index) return SQLITE_NOMEM;
+        *tail = index;
+        tail = &index->next;
+
+        rc = chain_read_exact(reader, &len, 1);
+        if (rc == SQLITE_OK && len >= MAX_TABLE_NAME) rc = SQLITE_CORRUPT;
+        if (rc == SQLITE_OK) rc = chain_read_exact(reader, index->name, len);
+        if (rc == SQLITE_OK) rc = chain_read_exact(reader, attrs, 3);
+        if (rc != SQLITE_OK) break;
+        if (attrs[0] > INDEX_BTREE || attrs[2] == 0 || attrs[2] > MAX_INDEX_COLUMNS) {
+            return SQLITE_CORRUPT;
+        }
+        index->type = attrs[0];
+        index->unique = attrs[1];
+        index->num_columns = attrs[2];
+        for (k = 0; rc == SQLITE_OK && k < index->num_columns; k++) {
+            rc = chain_read_exact(reader, &col, 1);
+            if (rc == SQLITE_OK && col >= table->num_columns) rc = SQLITE_CORRUPT;
+            index->columns[k] = col;
+        }
+        if (rc == SQLITE_OK) rc = index_create_contents(table, index);
+    }
+    return rc;
+}
+
+/*
+** Load the schema and all table data from the database file
+*/
+static int load_database(sqlite *db)
+{
+    pager_chain_reader_t reader;
+    unsigned char buf[4];
+    int count, t, c;
+    int rc;
+
+    if (pager_schema_root(db->pager) == 0) return SQLITE_OK;
+
+    rc = pager_chain_open(db->pager, pager_schema_root(db->pager), &reader);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = chain_read_exact(&reader, buf, 4);
+    count = (int)pager_get_u32(buf);
+
+    for (t = 0; rc == SQLITE_OK && t < count; t++) {
+        table_def_t *table;
+        unsigned char len;
+
+        table = (table_def_t *)riscos_calloc(1, sizeof(table_def_t));
+        if (!table) {
+            rc = SQLITE_NOMEM;
+            break;
+        }
+        rc = chain_read_exact(&reader, &len, 1);
+        if (rc == SQLITE_OK && len >= MAX_TABLE_NAME) rc = SQLITE_CORRUPT;
+        if (rc == SQLITE_OK) rc = chain_read_exact(&reader, table->name, len);
+        if (rc == SQLITE_OK) rc = chain_read_exact(&reader, &len, 1);
+        table->columnar = (len & SCHEMA_TABLE_COLUMNAR) != 0;
+        if (rc == SQLITE_OK) rc = chain_read_exact(&reader, &len, 1);
+        if (rc == SQLITE_OK && len > MAX_COLUMNS) rc = SQLITE_CORRUPT;
+        if (rc != SQLITE_OK) {
+            riscos_free(table);
+            break;
+        }
+        table->num_columns = len;
+
+        for (c = 0; rc == SQLITE_OK && c < table->num_columns; c++) {
+            column_def_t *col = &table->columns[c];
+            unsigned char attrs[3];
+            rc = chain_read_exact(&reader, &len, 1);
+            if (rc == SQLITE_OK && len >= MAX_COL_NAME) rc = SQLITE_CORRUPT;
+            if (rc == SQLITE_OK) rc = chain_read_exact(&reader, col->name, len);
+            if (rc == SQLITE_OK) rc = chain_read_exact(&reader, attrs, 3);
+            if (rc == SQLITE_OK && attrs[0] > COL_NULL) rc = SQLITE_CORRUPT;
+            if (rc == SQLITE_OK) {
+                col->type = (col_type_t)attrs[0];
+                col->primary_key = attrs[1];
+                col->not_null = attrs[2];
+            }
+        }
+        if (rc == SQLITE_OK) rc = chain_read_exact(&reader, buf, 4);
+        table->first_page = (int)pager_get_u32(buf);
+        if (rc == SQLITE_OK) rc = load_index_defs(&reader, table);
+        if (rc == SQLITE_OK && find_table(db, table->name)) rc = SQLITE_CORRUPT;
+        if (rc == SQLITE_OK) rc = catalog_add(db, table);
+        if (rc != SQLITE_OK) {
+            free_table(table);
+            break;
+        }
+    }
+    pager_chain_close(&reader);
+
+    /* Load row data for each table, then rebuild its indexes */
+    for (t = 0; rc == SQLITE_OK && t < db->num_tables; t++) {
+        table_def_t *table = db->tables[t];
+        index_def_t *index;
+        rc = load_table_rows(db, table);
+        for (index = table->indexes; rc == SQLITE_OK && index; index = index->next) {
+            rc = build_index(table, index);
+            if (rc == SQLITE_CONSTRAINT) rc = SQLITE_CORRUPT;
+        }
+    }
+
+    return rc;
+}
+
+/*
+** Undo log
+** Every change to the in-memory tables is recorded as it is made, so that
+** ROLLBACK, ROLLBACK TO and a failed statement take back just what changed
+** while the pager puts back the pages; nothing is reloaded from disk.
+** Appended rows need only the table's last rowid and chain tail from
+** before: rowids only grow, so undoing them cuts the table and its
+** indexes back to that rowid. A dropped table or index stays alive in its
+** entry until the transaction ends.
+**
+** Savepoints mark positions in the log and match the pager's savepoints
+** level for level. Inside a transaction, a statement's first change opens
+** an unnamed savepoint, so that an error undoes that statement alone.
+*/
+
+/* Undo entries allocated at first */
+#define UNDO_INITIAL_ENTRIES 16
+
+/*
+** Open a savepoint ("" for a statement's own)
+*/
+static int savepoint_open(sqlite *db, const char *name)
+{
+    savepoint_def_t *sp;
+    int rc;
+
+    if (db->num_savepoints == db->savepoints_capacity) {
+        int capacity = db->savepoints_capacity ? db->savepoints_capacity * 2 : 4;
+        sp = (savepoint_def_t *)riscos_realloc(db->savepoints,
+                                               capacity * sizeof(savepoint_def_t));
+        if (!sp) return SQLITE_NOMEM;
+        db->savepoints = sp;
+        db->savepoints_capacity = capacity;
+    }
+
+    rc = pager_open_savepoint(db->pager);
+    if (rc != SQLITE_OK) return rc;
+
+    sp = &db->savepoints[db->num_savepoints++];
+    strcpy(sp->name, name);
+    sp->undo_count = db->undo_count;
+    return SQLITE_OK;
+}
+
+/*
+** Find the innermost savepoint called name, or -1
+*/
+static int find_savepoint(sqlite *db, const char *name)
+{
+    int level;
+
+    for (level = db->num_savepoints - 1; level >= 0; level--) {
+        if (strcasecmp(db->savepoints[level].name, name) == 0) return level;
+    }
+    return -1;
+}
+
+/*
+** Prepare to record a change
+** Room for the entry is made here, so that recording the change once it
+** has been made cannot fail.
+*/
+static int undo_reserve(sqlite *db)
+{
+    int rc;
+
+    if (db->in_transaction && !db->statement_savepoint) {
+        rc = savepoint_open(db, "");
+        if (rc != SQLITE_OK) return rc;
+        db->statement_savepoint = 1;
+    }
+
+    if (db->undo_count == db->undo_capacity) {
+        int capacity = db->undo_capacity ? db->undo_capacity * 2 : UNDO_INITIAL_ENTRIES;
+        undo_entry_t *undo = (undo_entry_t *)riscos_realloc(db->undo,
+                                 capacity * sizeof(undo_entry_t));
+        if (!undo) return SQLITE_NOMEM;
+        db->undo = undo;
+        db->undo_capacity = capacity;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Record a change just made (after undo_reserve)
+*/
+static undo_entry_t *undo_record(sqlite *db, int type, table_def_t *table,
+                                 index_def_t *index)
+{
+    undo_entry_t *entry = &db->undo[db->undo_count++];
+
+    memset(entry, 0, sizeof(undo_entry_t));
+    entry->type = type;
+    entry->table = table;
+    entry->index = index;
+    return entry;
+}
+
+/*
+** Record the end of a table before a row is appended
+** One entry covers any number of rows: nothing more is needed while the
+** latest entry since the innermost savepoint is this table's.
+*/
+static int undo_record_insert(sqlite *db, table_def_t *table)
+{
+    undo_entry_t *entry;
+    int base;
+    int rc;
+
+    rc = undo_reserve(db);
+    if (rc != SQLITE_OK) return rc;
+
+    base = db->num_savepoints ? db->savepoints[db->num_savepoints - 1].undo_count : 0;
+    if (db->undo_count > base) {
+        entry = &db->undo[db->undo_count - 1];
+        if (entry->type == UNDO_INSERT && entry->table == table) return SQLITE_OK;
+    }
+
+    entry = undo_record(db, UNDO_INSERT, table, NULL);
+    entry->last_rowid = table->last_rowid;
+    entry->last_page = table->last_page;
+    return SQLITE_OK;
+}
+
+/*
+** Remove the rows above rowid from a table and its indexes
+*/
+static void undo_table_inserts(table_def_t *table, btree_key_t rowid)
+{
+    value_t row[MAX_COLUMNS];
+    index_def_t *index;
+    unsigned int columns = 0;
+    btree_key_t r;
+
+    for (index = table->indexes; index; index = index->next) {
+        columns |= index->column_mask;
+    }
+    for (r = rowid + 1; columns && r <= table->last_rowid; r++) {
+        if (!table_fetch_columns(table, r, row, columns)) continue;
+        for (index = table->indexes; index; index = index->next) {
+            index_remove_row(index, row, r);
+        }
+    }
+
+    if (table->colstore) {
+        colstore_truncate(table->colstore, (int)rowid);
+    } else {
+        btree_truncate(table->rows, rowid, free_row_payload, NULL);
+    }
+    table->last_rowid = rowid;
+}
+
+/*
+** Take back one change
+** Returns non-zero if it was a schema change.
+*/
+static int undo_apply(sqlite *db, undo_entry_t *entry)
+{
+    table_def_t *table = entry->table;
+    index_def_t **link;
+    int i;
+
+    switch (entry->type) {
+        case UNDO_INSERT:
+            undo_table_inserts(table, entry->last_rowid);
+            table->last_page = entry->last_page;
+            return 0;
+        case UNDO_CREATE_TABLE:
+            catalog_remove(db, table);
+            free_table(table);
+            break;
+        case UNDO_DROP_TABLE:
+            /* Cannot fail: the catalog had room for the table before; the
+            ** swap puts back the catalog order removal disturbed */
+            catalog_add(db, table);
+            db->tables[table->index] = db->tables[entry->position];
+            db->tables[table->index]->index = table->index;
+            db->tables[entry->position] = table;
+            table->index = entry->position;
+            break;
+        case UNDO_CREATE_INDEX:
+            for (link = &table->indexes; *link != entry->index; link = &(*link)->next) ;
+            *link = entry->index->next;
+            free_index(entry->index);
+            break;
+        case UNDO_DROP_INDEX:
+            link = &table->indexes;
+            for (i = 0; i < entry->position; i++) link = &(*link)->next;
+            entry->index->next = *link;
+            *link = entry->index;
+            break;
+        case UNDO_ADD_COLUMN:
+            table->num_columns = 0;
+            break;
+    }
+    return 1;
+}
+
+/*
+** Take back every change recorded after the first count entries
+** Compiled statements become stale if the schema changed back.
+*/
+static void undo_rollback(sqlite *db, int count)
+{
+    int schema = 0;
+
+    while (db->undo_count > count) {
+        schema |= undo_apply(db, &db->undo[--db->undo_count]);
+    }
+    if (schema) db->schema_cookie++;
+}
+
+/*
+** Forget every change once committed, freeing dropped tables and indexes
+*/
+static void undo_discard(sqlite *db)
+{
+    undo_entry_t *entry;
+
+    while (db->undo_count > 0) {
+        entry = &db->undo[--db->undo_count];
+        if (entry->type == UNDO_DROP_TABLE) {
+            free_table(entry->table);
+        } else if (entry->type == UNDO_DROP_INDEX) {
+            free_index(entry->index);
+        }
+    }
+}
+
+/*
+** Close the savepoint at level and those inside it, keeping their changes
+** An insert entry that now follows one for the same table is folded into
+** it, so a transaction of many single-row INSERTs keeps one entry.
+*/
+static void savepoint_release(sqlite *db, int level)
+{
+    int base = db->savepoints[level].undo_count;
+    int outer = level > 0 ? db->savepoints[level - 1].undo_count : 0;
+    undo_entry_t *entry = db->undo + base;
+
+    if (base > outer && base < db->undo_count &&
+        entry->type == UNDO_INSERT && entry[-1].type == UNDO_INSERT &&
+        entry->table == entry[-1].table) {
+        memmove(entry, entry + 1, (db->undo_count - base - 1) * sizeof(undo_entry_t));
+        db->undo_count--;
+    }
+    db->num_savepoints = level;
+    pager_release_savepoint(db->pager, level);
+}
+
+/*
+** Take back every change made since the savepoint at level opened
+** Savepoints inside it are closed; it stays open.
+*/
+static void savepoint_rollback(sqlite *db, int level)
+{
+    pager_rollback_to_savepoint(db->pager, level);
+    undo_rollback(db, db->savepoints[level].undo_count);
+    db->num_savepoints = level + 1;
+}
+
+/*
+** Close a SQLite database
+** An open transaction is rolled back. The log is checkpointed into the
+** database file and removed, unless that fails; it is then recovered by
+** the next open.
+*/
+void sqlite_close(sqlite *db)
+{
+    int checkpointed = 0;
+
+    if (!db) return;
+
+    stmt_cache_clear(db);
+
+    if (db->pager) {
+        if (db->in_transaction) {
+            pager_rollback(db->pager);
+            undo_rollback(db, 0);
+        } else {
+            pager_commit(db->pager);
+        }
+        checkpointed = pager_checkpoint(db->pager, NULL) == SQLITE_OK;
+        pager_close(db->pager);
+        db->pager = NULL;
+    }
+
+    if (db->walfile.handle != 0) {
+        riscos_vfs_close(&db->walfile);
+        if (checkpointed) riscos_vfs_delete(db->vfs, db->wal_filename);
+    }
+
+    if (db->is_open && db->dbfile.handle != 0) {
+        riscos_vfs_close(&db->dbfile);
+    }
+
+    if (db->filename) {
+        riscos_free(db->filename);
+    }
+    if (db->wal_filename) {
+        riscos_free(db->wal_filename);
+    }
+
+    /* Free table definitions and their data */
+    if (db->tables) {
+        int t;
+        for (t = 0; t < db->num_tables; t++) {
+            free_table(db->tables[t]);
+        }
+        riscos_free(db->tables);
+    }
+    if (db->table_hash) riscos_free(db->table_hash);
+    riscos_free(db->undo);
+    riscos_free(db->savepoints);
+
+    riscos_free(db);
+}
+
+/*
+** Case-insensitive search for word within text[0..len)
+*/
+static int contains_word(const char *text, int len, const char *word)
+{
+    int n = strlen(word);
+    int i;
+    for (i = 0; i + n <= len; i++) {
+        if (strncasecmp(text + i, word, n) == 0) return 1;
+    }
+    return 0;
+}
+
+/*
+** Map a declared column type to a storage type, using SQLite's affinity
+** rules. Other declared types (NUMERIC, DECIMAL, DATE, ...) get INTEGER
+** storage: integral numbers stay integers and other numbers become REAL.
+*/
+static col_type_t column_type_from_decl(const char *decl, int len)
+{
+    if (len == 0) return COL_NULL;
+    if (contains_word(decl, len, "INT")) return COL_INTEGER;
+    if (contains_word(decl, len, "CHAR") || contains_word(decl, len, "CLOB") ||
+        contains_word(decl, len, "TEXT")) return COL_TEXT;
+    if (contains_word(decl, len, "BLOB")) return COL_BLOB;
+    if (contains_word(decl, len, "REAL") || contains_word(decl, len, "FLOA") ||
+        contains_word(decl, len, "DOUB")) return COL_REAL;
+    return COL_INTEGER;
+}
+
+/*
+** Parse one column definition: name [type] [constraints]
+** Table constraints are skipped. Leaves the lexer on the ',' or ')' after
+** the definition.
+*/
+static int parse_column_def(table_def_t *table, sql_lexer_t *lx, char **errmsg)
+{
+    column_def_t *col;
+    int type_start, type_end;
+    int depth;
+
+    switch (lx->token.type) {
+        case TK_COMMA:
+        case TK_RP:
+            if (errmsg) *errmsg = "Missing column definition";
+            return SQLITE_ERROR;
+        case TK_PRIMARY:
+        case TK_UNIQUE:
+        case TK_CHECK:
+        case TK_FOREIGN:
+        case TK_CONSTRAINT:
+            /* Table constraints: PRIMARY KEY (a, b), UNIQUE (a), ... */
+            skip_list_item(lx);
+            return SQLITE_OK;
+    }
+
+    if (table->num_columns >= MAX_COLUMNS) {
+        if (errmsg) *errmsg = "Too many columns";
+        return SQLITE_ERROR;
+    }
+    col = &table->columns[table->num_columns];
+    memset(col, 0, sizeof(column_def_t));
+
+    if (!parse_identifier(lx, col->name, MAX_COL_NAME)) {
+        if (errmsg) *errmsg = "Missing column name";
+        return SQLITE_ERROR;
+    }
+
+    /* Type name runs until the first constraint keyword */
+    type_start = type_end = lx->token.offset;
+    for (depth = 0; ; sql_lexer_next(lx)) {
+        int type = lx->token.type;
+        if (TK_IS_END(type)) break;
+        if (depth == 0) {
+            if (type == TK_COMMA || type == TK_RP || type == TK_PRIMARY ||
+                type == TK_NOT || type == TK_NULL || type == TK_UNIQUE ||
+                type == TK_DEFAULT || type == TK_CHECK || type == TK_REFERENCES ||
+                type == TK_COLLATE || type == TK_CONSTRAINT) break;
+        }
+        if (type == TK_LP) depth++;
+        if (type == TK_RP) depth--;
+        type_end = lx->token.offset + lx->token.length;
+    }
+    col->type = column_type_from_decl(lx->sql + type_start, type_end - type_start);
+
+    /* Column constraints */
+    for (depth = 0; ; ) {
+        int type = lx->token.type;
+        if (TK_IS_END(type)) {
+            if (errmsg) *errmsg = "Expected ) after column definitions";
+            return SQLITE_ERROR;
+        }
+        if (depth == 0 && (type == TK_COMMA || type == TK_RP)) break;
+        sql_lexer_next(lx);
+        if (type == TK_LP) {
+            depth++;
+        } else if (type == TK_RP) {
+            depth--;
+        } else if (type == TK_PRIMARY && lx->token.type == TK_KEY) {
+            col->primary_key = col->not_null = 1;
+        } else if (type == TK_NOT && lx->token.type == TK_NULL) {
+            col->not_null = 1;
+        }
+    }
+
+    table->num_columns++;
+    return SQLITE_OK;
+}
+
+/*
+** Parse the parenthesised column list of CREATE TABLE
+** A table created without a column list gets its columns on first INSERT.
+** On success the lexer is left just past the closing parenthesis.
+*/
+static int parse_column_defs(table_def_t *table, sql_lexer_t *lx, char **errmsg)
+{
+    if (!sql_lexer_accept(lx, TK_LP)) return SQLITE_OK;
+
+    for (;;) {
+        int rc = parse_column_def(table, lx, errmsg);
+        if (rc != SQLITE_OK) return rc;
+        if (sql_lexer_accept(lx, TK_RP)) break;
+        if (!sql_lexer_accept(lx, TK_COMMA)) {
+            if (errmsg) *errmsg = "Expected ) after column definitions";
+            return SQLITE_ERROR;
+        }
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Parse table options: WITH (columnar)
+*/
+static int parse_table_options(table_def_t *table, sql_lexer_t *lx, char **errmsg)
+{
+    if (TK_IS_END(lx->token.type)) return SQLITE_OK;
+
+    if (sql_lexer_accept(lx, TK_WITH) && sql_lexer_accept(lx, TK_LP) &&
+        lx->token.type == TK_ID && lx->token.length == 8 &&
+        strncasecmp(SQL_TOKEN_TEXT(lx), "columnar", 8) == 0) {
+        sql_lexer_next(lx);
+        if (lx->token.type == TK_RP) {
+            table->columnar = 1;
+            return SQLITE_OK;
+        }
+    }
+
+    if (errmsg) *errmsg = "Unknown table option";
+    return SQLITE_ERROR;
+}
+
+/*
+** Create table - simple implementation
+*/
+static int execute_create_table(sqlite *db, sql_lexer_t *lx, char **errmsg)
+{
+    char table_name[MAX_TABLE_NAME];
+    table_def_t *table;
+    int rc;
+
+    /* CREATE TABLE name (...) [WITH (columnar)], from the table name on */
+    if (!parse_identifier(lx, table_name, sizeof(table_name))) {
+        if (errmsg) *errmsg = "Missing table name";
+        return SQLITE_ERROR;
+    }
+
+    /* Check if table already exists */
+    if (find_table(db, table_name)) {
+        if (errmsg) *errmsg = "Table already exists";
+        return SQLITE_ERROR;
+    }
+
+    /* Create new table entry */
+    table = (table_def_t *)riscos_calloc(1, sizeof(table_def_t));
+    if (!table) {
+        if (errmsg) *errmsg = "Out of memory";
+        return SQLITE_NOMEM;
+    }
+    strcpy(table->name, table_name);
+    table->num_columns = 0;
+
+    /* Column definitions and options */
+    rc = parse_column_defs(table, lx, errmsg);
+    if (rc == SQLITE_OK) rc = parse_table_options(table, lx, errmsg);
+    if (rc == SQLITE_OK && table->columnar && table->num_columns == 0) {
+        if (errmsg) *errmsg = "Columnar table needs column definitions";
+        rc = SQLITE_ERROR;
+    }
+    if (rc != SQLITE_OK) {
+        free_table(table);
+        return rc;
+    }
+
+    /* Initialize row storage */
+    table->last_rowid = 0;
+    rc = undo_reserve(db);
+    if (rc == SQLITE_OK) rc = create_table_rows(table);
+    if (rc == SQLITE_OK) rc = catalog_add(db, table);
+    if (rc != SQLITE_OK) {
+        free_table(table);
+        if (errmsg) *errmsg = "Out of memory";
+        return rc;
+    }
+
+    /* Allocate the table's record chain and record it in the schema */
+    rc = pager_chain_new(db->pager, &table->first_page);
+    if (rc == SQLITE_OK) {
+        table->last_page = table->first_page;
+        rc = write_schema(db);
+    }
+    if (rc != SQLITE_OK) {
+        catalog_remove(db, table);
+        free_table(table);
+        if (errmsg) *errmsg = rc == SQLITE_NOMEM ? "Out of memory" : "Disk I/O error";
+        return rc;
+    }
+
+    undo_record(db, UNDO_CREATE_TABLE, table, NULL);
+    return SQLITE_OK;
+}
+
+/*
+** Drop table
+*/
+static int execute_drop_table(sqlite *db, sql_lexer_t *lx, char **errmsg)
+{
+    char table_name[MAX_TABLE_NAME];
+    table_def_t *table;
+    int position;
+    int rc;
+
+    if (!parse_identifier(lx, table_name, sizeof(table_name))) {
+        if (errmsg) *errmsg = "Missing table name";
+        return SQLITE_ERROR;
+    }
+
+    /* Find and remove table */
+    table = find_table(db, table_name);
+    if (!table) {
+        if (errmsg) *errmsg = "Table not found";
+        return SQLITE_ERROR;
+    }
+    if (table->readers > 0) {
+        if (errmsg) *errmsg = "Table is locked";
+        return SQLITE_LOCKED;
+    }
+
+    /* Release the table's pages and rewrite the schema without it */
+    position = table->index;
+    rc = undo_reserve(db);
+    if (rc == SQLITE_OK) rc = pager_chain_free(db->pager, table->first_page);
+    if (rc == SQLITE_OK) {
+        catalog_remove(db, table);
+        rc = write_schema(db);
+        if (rc != SQLITE_OK) catalog_add(db, table);
+    }
+    if (rc != SQLITE_OK) {
+        if (errmsg) *errmsg = rc == SQLITE_NOMEM ? "Out of memory" : "Disk I/O error";
+        return rc;
+    }
+
+    /* The undo log keeps the definition and rows until the change commits */
+    undo_record(db, UNDO_DROP_TABLE, table, NULL)->position = position;
+    return SQLITE_OK;
+}
+
+/*
+** Find a column by name, or -1
+*/
+static int find_column(table_def_t *table, const char *name)
+{
+    int c;
+    for (c = 0; c < table->num_columns; c++) {
+        if (strcasecmp(table->columns[c].name, name) == 0) return c;
+    }
+    return -1;
+}
+
+/*
+** Find an index by name, and the table it belongs to
+*/
+static index_def_t *find_index(sqlite *db, const char *name, table_def_t **ptable)
+{
+    int t;
+    for (t = 0; t < db->num_tables; t++) {
+        index_def_t *index;
+        for (index = db->tables[t]->indexes; index; index = index->next) {
+            if (strcasecmp(index->name, name) == 0) {
+                if (ptable) *ptable = db->tables[t];
+                return index;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+** Create index
+** Syntax: CREATE [UNIQUE] INDEX name ON table (column, ...) [USING hash|btree]
+** Without USING, the index is a hash index.
+*/
+static int execute_create_index(sqlite *db, sql_lexer_t *lx, char **errmsg)
+{
+    char name[MAX_TABLE_NAME];
+    char col_name[MAX_COL_NAME];
+    table_def_t *table;
+    index_def_t *index, **tail;
+    int unique;
+    int rc;
+
+    /* From [UNIQUE] INDEX on */
+    unique = sql_lexer_accept(lx, TK_UNIQUE);
+    if (!sql_lexer_accept(lx, TK_INDEX)) {
+        if (errmsg) *errmsg = "Expected INDEX after UNIQUE";
+        return SQLITE_ERROR;
+    }
+
+    if (!parse_identifier(lx, name, sizeof(name))) {
+        if (errmsg) *errmsg = "Missing index name";
+        return SQLITE_ERROR;
+    }
+    if (find_index(db, name, NULL) || find_table(db, name)) {
+        if (errmsg) *errmsg = "Index already exists";
+        return SQLITE_ERROR;
+    }
+
+    if (!sql_lexer_accept(lx, TK_ON)) {
+        if (errmsg) *errmsg = "Expected ON in CREATE INDEX";
+        return SQLITE_ERROR;
+    }
+    if (!parse_identifier(lx, col_name, sizeof(col_name)) ||
+        !(table = find_table(db, col_name))) {
+        if (errmsg) *errmsg = "Table not found";
+        return SQLITE_ERROR;
+    }
+
+    index = (index_def_t *)riscos_calloc(1, sizeof(index_def_t));
+    if (!index) {
+        if (errmsg) *errmsg = "Out of memory";
+        return SQLITE_NOMEM;
+    }
+    strcpy(index->name, name);
+    index->type = INDEX_HASH;
+    index->unique = unique;
+
+    /* Key columns */
+    if (!sql_lexer_accept(lx, TK_LP)) {
+        free_index(index);
+        if (errmsg) *errmsg = "Expected ( after table name";
+        return SQLITE_ERROR;
+    }
+    for (;;) {
+        int c;
+        if (!parse_identifier(lx, col_name, sizeof(col_name)) ||
+            (c = find_column(table, col_name)) < 0) {
+            free_index(index);
+            if (errmsg) *errmsg = "No such column";
+            return SQLITE_ERROR;
+        }
+        if (index->num_columns == MAX_INDEX_COLUMNS) {
+            free_index(index);
+            if (errmsg) *errmsg = "Too many columns in index";
+            return SQLITE_ERROR;
+        }
+        index->columns[index->num_columns++] = c;
+
+        /* Optional sort order is accepted and ignored */
+        if (!sql_lexer_accept(lx, TK_ASC)) sql_lexer_accept(lx, TK_DESC);
+        if (sql_lexer_accept(lx, TK_COMMA)) continue;
+        if (sql_lexer_accept(lx, TK_RP)) break;
+        free_index(index);
+        if (errmsg) *errmsg = "Expected ) after index columns";
+        return SQLITE_ERROR;
+    }
+
+    /* Index type */
+    if (sql_lexer_accept(lx, TK_USING)) {
+        parse_identifier(lx, col_name, sizeof(col_name));
+        if (strcasecmp(col_name, "btree") == 0) {
+            index->type = INDEX_BTREE;
+        } else if (strcasecmp(col_name, "hash") != 0) {
+            free_index(index);
+            if (errmsg) *errmsg = "Unknown index type";
+            return SQLITE_ERROR;
+        }
+    }
+
+    /* Index the existing rows, then record the index in the schema */
+    rc = undo_reserve(db);
+    if (rc == SQLITE_OK) rc = index_create_contents(table, index);
+    if (rc == SQLITE_OK) rc = build_index(table, index);
+    if (rc != SQLITE_OK) {
+        free_index(index);
+        if (errmsg) {
+            *errmsg = rc == SQLITE_CONSTRAINT ? "Indexed columns are not unique"
+                                              : "Out of memory";
+        }
+        return rc;
+    }
+
+    for (tail = &table->indexes; *tail; tail = &(*tail)->next) ;
+    *tail = index;
+    rc = write_schema(db);
+    if (rc != SQLITE_OK) {
+        *tail = NULL;
+        free_index(index);
+        if (errmsg) *errmsg = rc == SQLITE_NOMEM ? "Out of memory" : "Disk I/O error";
+        return rc;
+    }
+
+    undo_record(db, UNDO_CREATE_INDEX, table, index);
+    return SQLITE_OK;
+}
+
+/*
+** Drop index
+*/
+static int execute_drop_index(sqlite *db, sql_lexer_t *lx, char **errmsg)
+{
+    char name[MAX_TABLE_NAME];
+    table_def_t *table;
+    index_def_t *index, **link;
+    int position = 0;
+    int rc;
+
+    if (!parse_identifier(lx, name, sizeof(name))) {
+        if (errmsg) *errmsg = "Missing index name";
+        return SQLITE_ERROR;
+    }
+    index = find_index(db, name, &table);
+    if (!index) {
+        if (errmsg) *errmsg = "Index not found";
+        return SQLITE_ERROR;
+    }
+    if (table->readers > 0) {
+        if (errmsg) *errmsg = "Table is locked";
+        return SQLITE_LOCKED;
+    }
+
+    rc = undo_reserve(db);
+    if (rc != SQLITE_OK) {
+        if (errmsg) *errmsg = "Out of memory";
+        return rc;
+    }
+
+    /* Unlink, rewrite the schema, and put it back if that fails */
+    for (link = &table->indexes; *link != index; link = &(*link)->next) position++;
+    *link = index->next;
+    rc = write_schema(db);
+    if (rc != SQLITE_OK) {
+        *link = index;
+        if (errmsg) *errmsg = rc == SQLITE_NOMEM ? "Out of memory" : "Disk I/O error";
+        return rc;
+    }
+
+    /* The undo log keeps the index until the change commits */
+    undo_record(db, UNDO_DROP_INDEX, table, index)->position = position;
+    return SQLITE_OK;
+}
+
+/*
+** Add a row to a table
+** UNIQUE indexes are checked first; then the record is appended to the
+** table's page chain and the row added to the table and its indexes.
+*/
+static int table_insert(sqlite *db, table_def_t *table, const value_t *values,
+                        char **errmsg)
+{
+    unsigned char *rec;
+    int last_page;
+    int rc;
+
+    /* Rows being read must stay where they are */
+    if (table->readers > 0) {
+        if (errmsg) *errmsg = "Table is locked";
+        return SQLITE_LOCKED;
+    }
+
+    /* Check UNIQUE indexes before anything is written */
+    rc = index_prepare_insert(table, values);
+    if (rc != SQLITE_OK) {
+        if (errmsg) {
+            *errmsg = rc == SQLITE_CONSTRAINT ? "UNIQUE constraint failed"
+                                              : "Out of memory";
+        }
+        return rc;
+    }
+
+    /* Note where the table ended, so the row can be taken back */
+    rc = undo_record_insert(db, table);
+    if (rc != SQLITE_OK) {
+        if (errmsg) *errmsg = "Out of memory";
+        return rc;
+    }
+
+    /* Pack the row into one record: the same bytes go to disk and memory */
+    rc = record_encode(values, table->num_columns, &rec);
+    if (rc != SQLITE_OK) {
+        if (errmsg) *errmsg = "Out of memory";
+        return rc;
+    }
+
+    /* Append the record to the table's page chain, then add the row */
+    last_page = table->last_page;
+    rc = pager_chain_append(db->pager, &table->last_page, rec, record_size(rec));
+    if (rc == SQLITE_OK) {
+        rc = insert_table_row(table, rec);
+    }
+    if (rc != SQLITE_OK) {
+        table->last_page = last_page;
+        riscos_free(rec);
+        if (errmsg) *errmsg = rc == SQLITE_NOMEM ? "Out of memory" : "Disk I/O error";
+        return rc;
+    }
+
+    index_insert_row(table, values, table->last_rowid);
+    return SQLITE_OK;
+}
+
+/* Maximum WHERE terms the planner looks at */
+#define MAX_WHERE_TERMS 16
+
+/* One ORDER BY column */
+typedef struct {
+    int column;
+    int desc;
+} order_term_t;
+
+/*
+** Resolve a column name in a WHERE clause
+*/
+static int resolve_column(void *arg, const char *name, int len,
+                          value_affinity_t *paffinity)
+{
+    table_def_t *table = (table_def_t *)arg;
+    int c;
+
+    for (c = 0; c < table->num_columns; c++) {
+        if (strncasecmp(table->columns[c].name, name, len) == 0 &&
+            table->columns[c].name[len] == '\0') {
+            *paffinity = column_affinity(&table->columns[c]);
+            return c;
+        }
+    }
+    return -1;
+}
+
+/*
+** Parse ORDER BY column [ASC|DESC], ...
+** Leaves the lexer after the last term.
+*/
+static int parse_order_by(table_def_t *table, sql_lexer_t *lx,
+                          order_term_t *order, int *pnum_order, char **errmsg)
+{
+    char col_name[MAX_COL_NAME];
+    int n = 0;
+
+    do {
+        if (!parse_identifier(lx, col_name, sizeof(col_name)) || n == MAX_COLUMNS) {
+            if (errmsg) *errmsg = "Unsupported ORDER BY clause";
+            return SQLITE_ERROR;
+        }
+        order[n].column = find_column(table, col_name);
+        if (order[n].column < 0) {
+            if (errmsg) *errmsg = "No such column";
+            return SQLITE_ERROR;
+        }
+        order[n].desc = 0;
+        if (!sql_lexer_accept(lx, TK_ASC)) order[n].desc = sql_lexer_accept(lx, TK_DESC);
+        n++;
+    } while (sql_lexer_accept(lx, TK_COMMA));
+
+    *pnum_order = n;
+    return SQLITE_OK;
+}
+
+/*
+** Resolve the SELECT list to table column numbers
+** "*" selects every column in table order; otherwise the list is column
+** names separated by commas, repeats allowed. Leaves the lexer after the
+** list.
+*/
+static int parse_select_list(table_def_t *table, sql_lexer_t *lx,
+                             int *proj, int *pnum_proj, char **errmsg)
+{
+    char col_name[MAX_COL_NAME];
+    int n = 0;
+
+    if (sql_lexer_accept(lx, TK_STAR)) {
+        for (n = 0; n < table->num_columns; n++) proj[n] = n;
+        *pnum_proj = n;
+        return SQLITE_OK;
+    }
+
+    do {
+        if (!parse_identifier(lx, col_name, sizeof(col_name)) || n == MAX_COLUMNS) {
+            if (errmsg) *errmsg = "Unsupported SELECT column list";
+            return SQLITE_ERROR;
+        }
+        proj[n] = find_column(table, col_name);
+        if (proj[n] < 0) {
+            if (errmsg) *errmsg = "No such column";
+            return SQLITE_ERROR;
+        }
+        n++;
+    } while (sql_lexer_accept(lx, TK_COMMA));
+
+    *pnum_proj = n;
+    return SQLITE_OK;
+}
+
+/*
+** Find the first term on a column with one of two operators
+*/
+static const expr_term_t *find_term(const expr_term_t *terms, int num_terms,
+                                     int column, int op1, int op2)
+{
+    int t;
+    for (t = 0; t < num_terms; t++) {
+        if (terms[t].column == column && (terms[t].op == op1 || terms[t].op == op2)) {
+            return &terms[t];
+        }
+    }
+    return NULL;
+}
+
+/*
+** Pick the hash index whose key columns are all fixed by equality terms,
+** preferring the one with the most key columns
+*/
+static index_def_t *choose_hash_index(table_def_t *table, const expr_term_t *terms,
+                                      int num_terms)
+{
+    index_def_t *index, *best = NULL;
+    int k;
+
+    for (index = table->indexes; index; index = index->next) {
+        if (index->type != INDEX_HASH) continue;
+        for (k = 0; k < index->num_columns; k++) {
+            if (!find_term(terms, num_terms, index->columns[k], EXPR_EQ, EXPR_EQ)) break;
+        }
+        if (k == index->num_columns &&
+            (!best || index->num_columns > best->num_columns)) {
+            best = index;
+        }
+    }
+    return best;
+}
+
+/*
+** How a SELECT walks an ordered index
+** Equality terms fix the leading key columns; the next column may have a
+** range. lower and upper are the bounds of the walk (no columns when
+** unbounded), and ordered is set when the walk yields the ORDER BY order.
+*/
+typedef struct {
+    index_def_t *index;
+    value_t lower_values[MAX_INDEX_COLUMNS];
+    value_t upper_values[MAX_INDEX_COLUMNS];
+    int lower_params[MAX_INDEX_COLUMNS]; /* Parameters bound to bound values, or 0 */
+    int upper_params[MAX_INDEX_COLUMNS];
+    index_key_t lower;
+    index_key_t upper;
+    int lower_strict;               /* Lower bound excluded (>) */
+    int upper_strict;               /* Upper bound excluded (<) */
+    int ordered;
+    int desc;                       /* Walk backwards */
+} index_plan_t;
+
+/*
+** Work out how well an ordered index serves a query
+** Returns a score, 0 if the index does not help; more fixed columns beat
+** a range, which beats providing the order.
+*/
+static int plan_ordered_index(index_def_t *index, const expr_term_t *terms,
+                              int num_terms, const order_term_t *order,
+                              int num_order, index_plan_t *plan)
+{
+    const expr_term_t *lo = NULL, *hi = NULL;
+    int num_eq, j, k;
+
+    memset(plan, 0, sizeof(*plan));
+    plan->index = index;
+
+    for (num_eq = 0; num_eq < index->num_columns; num_eq++) {
+        const expr_term_t *t = find_term(terms, num_terms, index->columns[num_eq],
+                                          EXPR_EQ, EXPR_EQ);
+        if (!t) break;
+        plan->lower_values[num_eq] = t->value;
+        plan->upper_values[num_eq] = t->value;
+        plan->lower_params[num_eq] = t->param;
+        plan->upper_params[num_eq] = t->param;
+    }
+    plan->lower.values = plan->lower_values;
+    plan->lower.num_columns = num_eq;
+    plan->upper.values = plan->upper_values;
+    plan->upper.num_columns = num_eq;
+
+    if (num_eq < index->num_columns) {
+        int c = index->columns[num_eq];
+        lo = find_term(terms, num_terms, c, EXPR_GT, EXPR_GE);
+        hi = find_term(terms, num_terms, c, EXPR_LT, EXPR_LE);
+        if (lo) {
+            plan->lower_values[num_eq] = lo->value;
+            plan->lower_params[num_eq] = lo->param;
+            plan->lower.num_columns++;
+            plan->lower_strict = lo->op == EXPR_GT;
+        }
+        if (hi) {
+            plan->upper_values[num_eq] = hi->value;
+            plan->upper_params[num_eq] = hi->param;
+            plan->upper.num_columns++;
+            plan->upper_strict = hi->op == EXPR_LT;
+        }
+    }
+
+    /* ORDER BY must follow the key columns after some of the fixed ones */
+    for (j = 0; num_order > 0 && j <= num_eq && !plan->ordered; j++) {
+        if (j + num_order > index->num_columns) break;
+        for (k = 0; k < num_order; k++) {
+            if (order[k].column != index->columns[j + k] ||
+                order[k].desc != order[0].desc) break;
+        }
+        if (k == num_order) {
+            plan->ordered = 1;
+            plan->desc = order[0].desc;
+        }
+    }
+
+    return num_eq * 4 + (lo || hi ? 2 : 0) + plan->ordered;
+}
+
+/*
+** Utility: Order rowids for qsort
+*/
+static int compare_rowids(const void *a, const void *b)
+{
+    btree_key_t x = *(const btree_key_t *)a;
+    btree_key_t y = *(const btree_key_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Access paths to the rows a statement reads */
+#define ACCESS_SCAN 0               /* Every row, in rowid order */
+#define ACCESS_HASH 1               /* Rows with one key of a hash index */
+#define ACCESS_TREE 2               /* Rows between bounds of an ordered index */
+
+/*
+** Table behind a compiled statement's cursor (see vdbe_table_ops_t)
+** The access path is fixed when the statement is compiled; the fields
+** after it are the state of the current pass over the rows.
+*/
+typedef struct {
+    sqlite *db;
+    vdbe_t *vdbe;                   /* Program supplying parameter values */
+    table_def_t *table;
+    unsigned int columns;           /* Columns to read, one bit per column */
+    int access;                     /* ACCESS_SCAN, ACCESS_HASH or ACCESS_TREE */
+    index_def_t *index;             /* ACCESS_HASH: index to probe */
+    value_t key[MAX_COLUMNS];       /* ACCESS_HASH: key values, by table column */
+    int key_params[MAX_COLUMNS];    /* ACCESS_HASH: parameters giving key values, or 0 */
+    index_plan_t plan;              /* ACCESS_TREE: how to walk the index */
+    table_scan_t scan;              /* ACCESS_SCAN */
+    btree_key_t *rowids;            /* ACCESS_HASH: matching rowids, in order */
+    int num_rowids;
+    int rowids_capacity;
+    int pos;
+    ordidx_cursor_t cur;            /* ACCESS_TREE */
+    int valid;
+    value_t row[MAX_COLUMNS];       /* Row fetched by rowid */
+} table_source_t;
+
+/*
+** Gather the rowids under the key from the hash index
+** They are sorted so the rows come out in the order a full scan gives.
+*/
+static int source_open_hash(table_source_t *src)
+{
+    hashidx_probe_t probe;
+    btree_key_t rowid;
+    unsigned int hash;
+
+    src->num_rowids = 0;
+    src->pos = 0;
+    if (!index_key_hash(src->index, src->key, &hash)) return SQLITE_OK;
+
+    hashidx_probe(src->index->hash, hash, &probe);
+    while (hashidx_next(&probe, &rowid)) {
+        if (src->num_rowids == src->rowids_capacity) {
+            int capacity = src->rowids_capacity ? src->rowids_capacity * 2 : 16;
+            btree_key_t *p = (btree_key_t *)riscos_realloc(src->rowids,
+                                capacity * sizeof(btree_key_t));
+            if (!p) return SQLITE_NOMEM;
+            src->rowids = p;
+            src->rowids_capacity = capacity;
+        }
+        src->rowids[src->num_rowids++] = rowid;
+    }
+    if (src->num_rowids > 1) {
+        qsort(src->rowids, src->num_rowids, sizeof(btree_key_t), compare_rowids);
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Position on the first index entry inside the plan's start bound
+*/
+static void source_open_tree(table_source_t *src)
+{
+    index_plan_t *plan = &src->plan;
+    ordidx_t *tree = plan->index->tree;
+    const index_key_t *start = plan->desc ? &plan->upper : &plan->lower;
+    int start_strict = plan->desc ? plan->upper_strict : plan->lower_strict;
+
+    if (start->num_columns == 0) {
+        src->valid = plan->desc ? ordidx_last(tree, &src->cur)
+                                : ordidx_first(tree, &src->cur);
+    } else if (plan->desc) {
+        /* Step back from the first entry past the upper bound */
+        src->valid = ordidx_seek(tree, start, !start_strict, &src->cur)
+                         ? ordidx_prev(&src->cur) : ordidx_last(tree, &src->cur);
+    } else {
+        src->valid = ordidx_seek(tree, start, start_strict, &src->cur);
+    }
+}
+
+/*
+** Fetch the row at the index cursor and step on, stopping at the first
+** row outside the plan's other bound
+*/
+static const value_t *source_next_tree(table_source_t *src)
+{
+    index_plan_t *plan = &src->plan;
+    const index_key_t *stop = plan->desc ? &plan->lower : &plan->upper;
+    int stop_strict = plan->desc ? plan->lower_strict : plan->upper_strict;
+    int found, c;
+
+    while (src->valid) {
+        found = table_fetch_columns(src->table, ordidx_cursor_rowid(&src->cur),
+                                    src->row, src->columns);
+        src->valid = plan->desc ? ordidx_prev(&src->cur) : ordidx_next(&src->cur);
+        if (!found) continue;
+        if (stop->num_columns > 0) {
+            c = index_key_compare(plan->index, stop, src->row);
+            if (plan->desc) c = -c;
+            if (c < 0 || (c == 0 && stop_strict)) {
+                src->valid = 0;
+                break;
+            }
+        }
+        return src->row;
+    }
+    return NULL;
+}
+
+/*
+** Fetch the index key values that come from parameters
+** Each is converted with its column's affinity, as a literal would have
+** been when the statement was compiled.
+*/
+static void source_bind_keys(table_source_t *src)
+{
+    table_def_t *table = src->table;
+    index_plan_t *plan = &src->plan;
+    int k, c;
+
+    if (src->access == ACCESS_HASH) {
+        for (k = 0; k < src->index->num_columns; k++) {
+            c = src->index->columns[k];
+            if (src->key_params[c]) {
+                vdbe_variable(src->vdbe, src->key_params[c],
+                              column_affinity(&table->columns[c]), &src->key[c]);
+            }
+        }
+    } else if (src->access == ACCESS_TREE) {
+        for (k = 0; k < plan->index->num_columns; k++) {
+            c = plan->index->columns[k];
+            if (plan->lower_params[k]) {
+                vdbe_variable(src->vdbe, plan->lower_params[k],
+                              column_affinity(&table->columns[c]), &plan->lower_values[k]);
+            }
+            if (plan->upper_params[k]) {
+                vdbe_variable(src->vdbe, plan->upper_params[k],
+                              column_affinity(&table->columns[c]), &plan->upper_values[k]);
+            }
+        }
+    }
+}
+
+/*
+** Start a pass over the rows
+** The table counts as read until the pass is closed, so it cannot be
+** dropped or written under the cursor.
+*/
+static int source_open(void *arg)
+{
+    table_source_t *src = (table_source_t *)arg;
+    int rc = SQLITE_OK;
+    int i;
+
+    for (i = 0; i < src->table->num_columns; i++) src->row[i].type = VALUE_NULL;
+    source_bind_keys(src);
+    switch (src->access) {
+        case ACCESS_HASH:
+            rc = source_open_hash(src);
+            break;
+        case ACCESS_TREE:
+            source_open_tree(src);
+            break;
+        default:
+            rc = scan_open(&src->scan, src->table, src->columns);
+            break;
+    }
+    if (rc == SQLITE_OK) src->table->readers++;
+    return rc;
+}
+
+static int source_next(void *arg, const value_t **prow)
+{
+    table_source_t *src = (table_source_t *)arg;
+
+    *prow = NULL;
+    switch (src->access) {
+        case ACCESS_HASH:
+            while (src->pos < src->num_rowids) {
+                if (table_fetch_columns(src->table, src->rowids[src->pos++],
+                                        src->row, src->columns)) {
+                    *prow = src->row;
+                    break;
+                }
+            }
+            break;
+        case ACCESS_TREE:
+            *prow = source_next_tree(src);
+            break;
+        default:
+            *prow = scan_next(&src->scan);
+            break;
+    }
+    return SQLITE_OK;
+}
+
+static void source_close(void *arg)
+{
+    table_source_t *src = (table_source_t *)arg;
+    if (src->access == ACCESS_SCAN) scan_close(&src->scan);
+    src->table->readers--;
+}
+
+static int source_insert(void *arg, const value_t *values, char **errmsg)
+{
+    table_source_t *src = (table_source_t *)arg;
+    return table_insert(src->db, src->table, values, errmsg);
+}
+
+static int source_reserve(void *arg, int rows)
+{
+    table_source_t *src = (table_source_t *)arg;
+    return table_reserve(src->table, rows);
+}
+
+static const vdbe_table_ops_t table_source_ops = {
+    source_open, source_next, source_close, source_insert, source_reserve
+};
+
+/*
+** A compiled statement (see sqlite_compile)
+** SELECT and INSERT become a program that reads or writes the table
+** through source, whose index bounds may point at literals in the WHERE
+** tree, so all three live as long as the vm does. Other statements keep
+** their text and are run directly by the first step.
+*/
+struct sqlite_vm {
+    sqlite *db;
+    unsigned int cookie;            /* Schema the statement was compiled against */
+    vdbe_t *vdbe;                   /* NULL for statements run directly */
+    char *sql;                      /* Text of a statement run directly */
+    table_source_t source;
+    expr_tree_t *where;
+    int num_columns;                /* Result columns */
+    char **col_names;               /* Names, then declared types */
+    char **argv;
+    char *text_buf;                 /* Numbers rendered as text */
+    int done;                       /* Finished, or failed, since the last reset */
+    int rc;                         /* Error that stopped the statement */
+    char *errmsg;
+    int running;                    /* Stepped since the last reset */
+};
+
+static void vm_free(sqlite_vm *vm)
+{
+    if (!vm) return;
+    vdbe_free(vm->vdbe);
+    riscos_free(vm->sql);
+    riscos_free(vm->source.rowids);
+    expr_free(vm->where);
+    riscos_free(vm->col_names);
+    riscos_free(vm);
+}
+
+/*
+** Create a statement on a table, with a program to build
+*/
+static sqlite_vm *vm_new(sqlite *db, table_def_t *table)
+{
+    sqlite_vm *vm = (sqlite_vm *)riscos_calloc(1, sizeof(sqlite_vm));
+    if (!vm) return NULL;
+    vm->vdbe = vdbe_create();
+    if (!vm->vdbe) {
+        riscos_free(vm);
+        return NULL;
+    }
+    vm->db = db;
+    vm->source.db = db;
+    vm->source.vdbe = vm->vdbe;
+    vm->source.table = table;
+    return vm;
+}
+
+/*
+** Declared type of a column, as reported after the result column names
+*/
+static char *column_type_name(const column_def_t *col)
+{
+    switch (col->type) {
+        case COL_INTEGER: return "INTEGER";
+        case COL_REAL:    return "REAL";
+        case COL_TEXT:    return "TEXT";
+        case COL_BLOB:    return "BLOB";
+        default:          return NULL;
+    }
+}
+
+/*
+** Name the result columns
+** Column names and types, the result values and scratch space for
+** rendering numeric values as text share one allocation.
+*/
+static int vm_set_columns(sqlite_vm *vm, table_def_t *table,
+                          const int *proj, int num_proj)
+{
+    int i;
+
+    vm->col_names = (char **)riscos_malloc(num_proj *
+                                           (3 * sizeof(char *) + VALUE_TEXT_BUF));
+    if (!vm->col_names) return SQLITE_NOMEM;
+    vm->argv = vm->col_names + 2 * num_proj;
+    vm->text_buf = (char *)(vm->argv + num_proj);
+    for (i = 0; i < num_proj; i++) {
+        vm->col_names[i] = table->columns[proj[i]].name;
+        vm->col_names[num_proj + i] = column_type_name(&table->columns[proj[i]]);
+    }
+    vm->num_columns = num_proj;
+    return SQLITE_OK;
+}
+
+/*
+** Undoubled string literals of one statement
+** Kept in blocks chained through their first word until the program has
+** copied the values.
+*/
+#define LITERAL_BLOCK_SIZE 1024
+
+typedef struct literal_block literal_block_t;
+struct literal_block {
+    literal_block_t *next;
+};
+
+typedef struct {
+    literal_block_t *blocks;
+    char *free;                     /* Next unused byte of the newest block */
+    int room;                       /* Bytes left after free */
+} literal_scratch_t;
+
+/*
+** Utility: Text of a string token without its quotes
+** The text stays in the SQL unless it has doubled quotes; those are
+** undoubled into the scratch blocks, sized from the token. Returns NULL if
+** out of memory.
+*/
+static const char *string_text(const char *sql, const sql_token_t *token,
+                               literal_scratch_t *scratch, int *plen)
+{
+    const char *z = sql + token->offset;
+    int n = token->length;
+    literal_block_t *block;
+    char *lit;
+    int size;
+
+    if (!memchr(z + 1, *z, n - 2)) {
+        *plen = n - 2;
+        return z + 1;
+    }
+    if (scratch->room < n) {
+        size = n > LITERAL_BLOCK_SIZE ? n : LITERAL_BLOCK_SIZE;
+        block = (literal_block_t *)riscos_malloc(sizeof(literal_block_t) + size);
+        if (!block) return NULL;
+        block->next = scratch->blocks;
+        scratch->blocks = block;
+        scratch->free = (char *)(block + 1);
+        scratch->room = size;
+    }
+    lit = scratch->free;
+    *plen = sql_dequote(z, n, lit, n);
+    scratch->free += *plen;
+    scratch->room -= *plen;
+    return lit;
+}
+
+/*
+** Utility: Free the scratch blocks of string_text
+*/
+static void literal_scratch_free(literal_scratch_t *scratch)
+{
+    literal_block_t *block;
+
+    while (scratch->blocks) {
+        block = scratch->blocks;
+        scratch->blocks = block->next;
+        riscos_free(block);
+    }
+}
+
+/*
+** Compile INSERT statement
+** Parser for: INSERT INTO table VALUES (val1, val2, ...) [, (...) ...]
+** The values become program constants in the registers OP_Insert stores,
+** one block of registers per row. The VALUES list is read once; the
+** arrays the rows are parsed into double as they fill, so their growth is
+** amortized, and once the rows are known the program and the table's
+** storage are sized for the batch in one step. Value text is converted
+** straight from the SQL; the program keeps its own copies.
+*/
+static int compile_insert(sqlite *db, sql_lexer_t *lx, sqlite_vm **pvm,
+                          char **errmsg)
+{
+    char table_name[MAX_TABLE_NAME];
+    table_def_t *table;
+    value_t *values, *row_values;
+    int *params, *row_params;
+    sqlite_vm *vm;
+    vdbe_t *v;
+    literal_scratch_t scratch = { NULL, NULL, 0 };
+    const char *text;
+    int i, val_idx, len, num_params = 0;
+    int num_rows, num_values, row, capacity;
+    int cursor, base;
+    int rc;
+
+    /* From INTO on */
+    if (!sql_lexer_accept(lx, TK_INTO)) {
+        if (errmsg) *errmsg = "Expected INTO after INSERT";
+        return SQLITE_ERROR;
+    }
+    if (!parse_identifier(lx, table_name, sizeof(table_name))) {
+        if (errmsg) *errmsg = "Missing table name in INSERT";
+        return SQLITE_ERROR;
+    }
+
+    /* Find table */
+    table = find_table(db, table_name);
+    if (!table) {
+        if (errmsg) *errmsg = "Table not found";
+        return SQLITE_ERROR;
+    }
+
+    /* For simplified implementation, assume table has at least one column */
+    if (table->num_columns == 0) {
+        /* Auto-create columns if none exist */
+        if (undo_reserve(db) != SQLITE_OK) {
+            if (errmsg) *errmsg = "Out of memory";
+            return SQLITE_NOMEM;
+        }
+        table->num_columns = 1;
+        strcpy(table->columns[0].name, "value");
+        table->columns[0].type = COL_TEXT;
+        if (write_schema(db) != SQLITE_OK) {
+            table->num_columns = 0;
+            if (errmsg) *errmsg = "Disk I/O error";
+            return SQLITE_IOERR;
+        }
+        undo_record(db, UNDO_ADD_COLUMN, table, NULL);
+    }
+
+    if (!sql_lexer_accept(lx, TK_VALUES)) {
+        if (errmsg) *errmsg = "Expected VALUES in INSERT";
+        return SQLITE_ERROR;
+    }
+    if (lx->token.type != TK_LP) {
+        if (errmsg) *errmsg = "Expected ( after VALUES";
+        return SQLITE_ERROR;
+    }
+
+    /*
+    ** Values and parameter numbers for every row, grown as rows are parsed
+    ** so that the VALUES list is only read once
+    */
+    values = NULL;
+    params = NULL;
+    capacity = 0;
+    for (row = 0; ; row++) {
+        if (row == capacity) {
+            value_t *new_values;
+            int *new_params;
+
+            capacity = capacity ? capacity * 2 : 1;
+            new_values = (value_t *)riscos_realloc(values, capacity * table->num_columns *
+                                                   sizeof(value_t));
+            if (new_values) values = new_values;
+            new_params = (int *)riscos_realloc(params, capacity * table->num_columns *
+                                               sizeof(int));
+            if (new_params) params = new_params;
+            if (!new_values || !new_params) {
+                if (errmsg) *errmsg = "Out of memory";
+                rc = SQLITE_NOMEM;
+                goto error;
+            }
+        }
+        row_values = values + row * table->num_columns;
+        row_params = params + row * table->num_columns;
+        sql_lexer_next(lx);  /* Skip '(' */
+
+        /* Parse values; columns not given are NULL, extra values are ignored */
+        for (i = 0; i < table->num_columns; i++) {
+            row_values[i].type = VALUE_NULL;
+            row_params[i] = 0;
+        }
+        for (val_idx = 0; ; val_idx++) {
+            sql_token_t first = lx->token, last = first;
+            int count = 0, depth = 0;
+
+            /* A value is every token up to the next ',' or ')' outside parentheses */
+            for (;;) {
+                int type = lx->token.type;
+                if (TK_IS_END(type)) break;
+                if (depth == 0 && (type == TK_COMMA || type == TK_RP)) break;
+                if (type == TK_LP) depth++;
+                if (type == TK_RP) depth--;
+                last = lx->token;
+                count++;
+                sql_lexer_next(lx);
+            }
+            if (count == 0 || (lx->token.type != TK_COMMA && lx->token.type != TK_RP)) {
+                if (errmsg) *errmsg = "Malformed VALUES list";
+                rc = SQLITE_ERROR;
+                goto error;
+            }
+
+            /* Convert to the column's storage class; ? is bound at run time */
+            if (val_idx < table->num_columns) {
+                if (count == 1 && first.type == TK_VARIABLE) {
+                    row_params[val_idx] = ++num_params;
+                } else if (count == 1 && first.type == TK_STRING) {
+                    text = string_text(lx->sql, &first, &scratch, &len);
+                    if (!text) {
+                        if (errmsg) *errmsg = "Out of memory";
+                        rc = SQLITE_NOMEM;
+                        goto error;
+                    }
+                    value_from_literal(&row_values[val_idx], text, len, 1,
+                                       column_affinity(&table->columns[val_idx]));
+                } else {
+                    value_from_literal(&row_values[val_idx], lx->sql + first.offset,
+                                       last.offset + last.length - first.offset, 0,
+                                       column_affinity(&table->columns[val_idx]));
+                }
+            }
+
+            if (sql_lexer_accept(lx, TK_RP)) break;
+            sql_lexer_next(lx);  /* Skip ',' */
+        }
+
+        /* Rows are separated by commas; the statement ends after the last */
+        if (!sql_lexer_accept(lx, TK_COMMA)) break;
+        if (lx->token.type != TK_LP) {
+            if (errmsg) *errmsg = "Malformed VALUES list";
+            rc = SQLITE_ERROR;
+            goto error;
+        }
+    }
+    if (!TK_IS_END(lx->token.type)) {
+        if (errmsg) *errmsg = "Malformed VALUES list";
+        rc = SQLITE_ERROR;
+        goto error;
+    }
+    num_rows = row + 1;
+    num_values = num_rows * table->num_columns;
+
+    vm = vm_new(db, table);
+    if (!vm) {
+        if (errmsg) *errmsg = "Out of memory";
+        rc = SQLITE_NOMEM;
+        goto error;
+    }
+    /* Insert each row from its registers, preloaded as constants apart from parameters */
+    v = vm->vdbe;
+    vdbe_reserve(v, num_rows + 2 + num_params, num_values - num_params);
+    cursor = vdbe_add_cursor(v, &table_source_ops, &vm->source);
+    base = vdbe_alloc_regs(v, num_values);
+    for (i = 0; i < num_values; i++) {
+        value_affinity_t affinity = column_affinity(&table->columns[i % table->num_columns]);
+        if (params[i]) {
+            vdbe_add_op(v, OP_Variable, params[i], base + i, affinity);
+        } else {
+            vdbe_set_constant(v, base + i, &values[i]);
+        }
+    }
+    if (num_rows > 1) vdbe_add_op(v, OP_Reserve, cursor, num_rows, 0);
+    for (row = 0; row < num_rows; row++) {
+        vdbe_add_op(v, OP_Insert, cursor, base + row * table->num_columns,
+                    table->num_columns);
+    }
+    vdbe_add_op(v, OP_Halt, 0, 0, 0);
+    riscos_free(values);
+    riscos_free(params);
+    literal_scratch_free(&scratch);
+
+    rc = vdbe_ready(v);
+    if (rc != SQLITE_OK) {
+        vm_free(vm);
+        if (errmsg) *errmsg = "Out of memory";
+        return rc;
+    }
+    *pvm = vm;
+    return SQLITE_OK;
+
+error:
+    riscos_free(values);
+    riscos_free(params);
+    literal_scratch_free(&scratch);
+    return rc;
+}
+
+/*
+** Compile SELECT statement
+** Simple parser for:
+**   SELECT * | col, ... FROM table [WHERE expr] [ORDER BY col [ASC|DESC], ...]
+** The WHERE clause becomes jumps inside the loop over the cursor. Its
+** top-level AND terms of the form "col op literal" choose the cursor's
+** access path: equality lookups use a hash index when one covers the
+** terms; otherwise an ordered index can narrow the rows to a range and
+** supply ORDER BY order. Any other ORDER BY goes through a sorter.
+*/
+static int compile_select(sqlite *db, sql_lexer_t *lx, sqlite_vm **pvm,
+                          char **errmsg)
+{
+    char table_name[MAX_TABLE_NAME];
+    table_def_t *table;
+    sqlite_vm *vm;
+    table_source_t *src;
+    vdbe_t *v;
+    expr_term_t terms[MAX_WHERE_TERMS];
+    order_term_t order[MAX_COLUMNS];
+    int proj[MAX_COLUMNS];
+    int num_terms = 0, num_order = 0, num_proj;
+    sql_lexer_t list;
+    expr_tree_t *where = NULL;
+    index_def_t *index;
+    index_plan_t plan, best_plan;
+    int score, best_score = 0;
+    int cursor, sorter = -1, base, width;
+    int loop, next, end;
+    unsigned int desc = 0;
+    int i;
+    int rc;
+
+    /* The column list is resolved once the table is known */
+    list = *lx;
+    while (lx->token.type != TK_FROM && !TK_IS_END(lx->token.type)) {
+        sql_lexer_next(lx);
+    }
+    if (!sql_lexer_accept(lx, TK_FROM)) {
         if (errmsg) *errmsg = "Expected FROM in SELECT";
         return SQLITE_ERROR;
     }
-    p = skip_whitespace(p + 4);  /* Skip "FROM" */
 
-    /* Extract table name */
-    i = 0;
-    while (*p && !isspace(*p) && *p != ';' && i < MAX_TABLE_NAME - 1) {
-        table_name[i++] = *p++;
+    if (!parse_identifier(lx, table_name, sizeof(table_name))) {
+        if (errmsg) *errmsg = "Missing table name in SELECT";
+        return SQLITE_ERROR;
+    }
+
+    /* Find table */
+    table = find_table(db, table_name);
+    if (!table) {
+        if (errmsg) *errmsg = "Table not found";
+        return SQLITE_ERROR;
+    }
+
+    vm = vm_new(db, table);
+    if (!vm) {
+        if (errmsg) *errmsg = "Out of memory";
+        return SQLITE_NOMEM;
+    }
+    v = vm->vdbe;
+
+    /* If table has no columns, return empty result */
+    if (table->num_columns == 0) {
+        vdbe_add_op(v, OP_Halt, 0, 0, 0);
+        goto ready;
+    }
+
+    rc = parse_select_list(table, &list, proj, &num_proj, errmsg);
+    if (rc != SQLITE_OK) goto error;
+    if (list.token.type != TK_FROM) {
+        if (errmsg) *errmsg = "Unsupported SELECT column list";
+        rc = SQLITE_ERROR;
+        goto error;
+    }
+
+    /* WHERE clause, compiled against the table's columns */
+    if (sql_lexer_accept(lx, TK_WHERE)) {
+        rc = expr_compile(lx, resolve_column, table, &where, errmsg);
+        if (rc != SQLITE_OK) goto error;
+        vm->where = where;
+        num_terms = expr_terms(where, terms, MAX_WHERE_TERMS);
+    }
+
+    /* ORDER BY, then the end of the statement */
+    if (sql_lexer_accept(lx, TK_ORDER)) {
+        if (!sql_lexer_accept(lx, TK_BY)) {
+            if (errmsg) *errmsg = "Expected BY after ORDER";
+            rc = SQLITE_ERROR;
+            goto error;
+        }
+        rc = parse_order_by(table, lx, order, &num_order, errmsg);
+        if (rc != SQLITE_OK) goto error;
+    }
+    if (!TK_IS_END(lx->token.type)) {
+        if (errmsg) *errmsg = "Unsupported SELECT syntax";
+        rc = SQLITE_ERROR;
+        goto error;
+    }
+
+    rc = vm_set_columns(vm, table, proj, num_proj);
+    if (rc != SQLITE_OK) goto nomem;
+
+    /* Only the columns the statement refers to are read from storage */
+    src = &vm->source;
+    src->columns = where ? expr_columns(where) : 0;
+    for (i = 0; i < num_proj; i++) src->columns |= 1u << proj[i];
+    for (i = 0; i < num_order; i++) src->columns |= 1u << order[i].column;
+
+    /* A covering hash index wins; otherwise take the best ordered index */
+    index = choose_hash_index(table, terms, num_terms);
+    if (!index) {
+        for (index = table->indexes; index; index = index->next) {
+            if (index->type != INDEX_BTREE) continue;
+            score = plan_ordered_index(index, terms, num_terms, order, num_order, &plan);
+            if (score > best_score) {
+                best_score = score;
+                best_plan = plan;
+            }
+        }
+        index = NULL;
+    }
+    if (index) {
+        src->access = ACCESS_HASH;
+        src->index = index;
+        for (i = 0; i < index->num_columns; i++) {
+            const expr_term_t *t = find_term(terms, num_terms, index->columns[i],
+                                             EXPR_EQ, EXPR_EQ);
+            src->key[t->column] = t->value;
+            src->key_params[t->column] = t->param;
+        }
+    } else if (best_score > 0) {
+        src->access = ACCESS_TREE;
+        src->plan = best_plan;
+        src->plan.lower.values = src->plan.lower_values;
+        src->plan.upper.values = src->plan.upper_values;
+        src->columns |= best_plan.index->column_mask;
+    }
+
+    /* Rows go through a sorter unless they already come out in order */
+    if (num_order > 0 && !(best_score > 0 && best_plan.ordered)) {
+        for (i = 0; i < num_order; i++) {
+            if (order[i].desc) desc |= 1u << i;
+        }
+        sorter = vdbe_add_sorter(v, num_order, desc);
     }
-    table_name[i] = '\0';
 
-    if (i == 0) {
-        if (errmsg) *errmsg = "Missing table name in SELECT";
-        return SQLITE_ERROR;
+    /*
+    ** The scan loop; a sorter row is the ORDER BY keys followed by the
+    ** result columns, all in r[base..]
+    */
+    cursor = vdbe_add_cursor(v, &table_source_ops, src);
+    width = sorter >= 0 ? num_order + num_proj : num_proj;
+    base = vdbe_alloc_regs(v, width);
+    loop = vdbe_make_label(v);
+    next = vdbe_make_label(v);
+    end = vdbe_make_label(v);
+
+    vdbe_add_op(v, OP_OpenRead, cursor, 0, 0);
+    vdbe_add_op(v, OP_Rewind, cursor, end, 0);
+    vdbe_resolve_label(v, loop);
+    if (where) expr_code_if_false(where, v, cursor, next);
+    if (sorter >= 0) {
+        for (i = 0; i < num_order; i++) {
+            vdbe_add_op(v, OP_Column, cursor, order[i].column, base + i);
+        }
+        for (i = 0; i < num_proj; i++) {
+            vdbe_add_op(v, OP_Column, cursor, proj[i], base + num_order + i);
+        }
+        vdbe_add_op(v, OP_SorterInsert, sorter, base, width);
+    } else {
+        for (i = 0; i < num_proj; i++) {
+            vdbe_add_op(v, OP_Column, cursor, proj[i], base + i);
+        }
+        vdbe_add_op(v, OP_ResultRow, base, num_proj, 0);
+    }
+    vdbe_resolve_label(v, next);
+    vdbe_add_op(v, OP_Next, cursor, loop, 0);
+    vdbe_resolve_label(v, end);
+    vdbe_add_op(v, OP_Close, cursor, 0, 0);
+
+    /* Then the sorted rows */
+    if (sorter >= 0) {
+        loop = vdbe_make_label(v);
+        end = vdbe_make_label(v);
+        vdbe_add_op(v, OP_Rewind, sorter, end, 0);
+        vdbe_resolve_label(v, loop);
+        for (i = 0; i < num_proj; i++) {
+            vdbe_add_op(v, OP_Column, sorter, num_order + i, base + i);
+        }
+        vdbe_add_op(v, OP_ResultRow, base, num_proj, 0);
+        vdbe_add_op(v, OP_Next, sorter, loop, 0);
+        vdbe_resolve_label(v, end);
     }
+    vdbe_add_op(v, OP_Halt, 0, 0, 0);
 
-    /* Find table */
-    table = find_table(db, table_name);
-    if (!table) {
-        if (errmsg) *errmsg = "Table not found";
-        return SQLITE_ERROR;
+ready:
+    rc = vdbe_ready(v);
+    if (rc != SQLITE_OK) goto nomem;
+    *pvm = vm;
+    return SQLITE_OK;
+
+nomem:
+    if (errmsg) *errmsg = "Out of memory";
+error:
+    vm_free(vm);
+    return rc;
+}
+
+/*
+** Run a compiled statement, passing each result row to the callback
+** Values are converted to text only here.
+*/
+static int run_statement(sqlite_vm *vm,
+                         int (*callback)(void*,int,char**,char**),
+                         void *arg, char **errmsg)
+{
+    const value_t *values;
+    int rc, i, n;
+
+    while ((rc = vdbe_step(vm->vdbe, errmsg)) == SQLITE_ROW) {
+        if (!callback) continue;
+        values = vdbe_row(vm->vdbe, &n);
+        for (i = 0; i < n; i++) {
+            vm->argv[i] = (char *)value_to_text(&values[i],
+                                                  vm->text_buf + i * VALUE_TEXT_BUF);
+        }
+        if (callback(arg, n, vm->argv, vm->col_names) != 0) {
+            rc = SQLITE_ABORT;
+            break;
+        }
     }
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
 
-    /* If table has no columns, return empty result */
-    if (table->num_columns == 0) {
-        return SQLITE_OK;
+/*
+** Statement cache
+** sqlite_exec keeps the last STMT_CACHE_SIZE SELECT and INSERT statements
+** it compiled, keyed by their exact SQL text, so running the same text
+** again skips parsing and planning. A statement is taken out of the cache
+** while it runs, which keeps a callback that runs SQL from reusing or
+** evicting it, and put back at the front afterwards; the entry at the back
+** is the least recently used and is evicted first. Statements compiled
+** against an older schema are dropped when they are next seen.
+*/
+
+/*
+** Utility: Remove cache entry i, handing back its SQL text
+*/
+static char *stmt_cache_remove(sqlite *db, int i)
+{
+    char *sql = db->stmt_cache[i].sql;
+    db->stmt_cache_count--;
+    memmove(&db->stmt_cache[i], &db->stmt_cache[i + 1],
+            (db->stmt_cache_count - i) * sizeof(stmt_cache_entry_t));
+    return sql;
+}
+
+/*
+** Take the statement at the lexer out of the cache
+** A statement matches an entry whose text it starts with, if it ends
+** there. Returns NULL on a miss. On a hit the lexer is moved to the
+** statement's end token, and *psql and *plen are the entry's copy of the
+** text and its length, to be handed back to stmt_cache_put.
+*/
+static sqlite_vm *stmt_cache_take(sqlite *db, sql_lexer_t *lx, char **psql,
+                                  int *plen)
+{
+    const char *sql = SQL_TOKEN_TEXT(lx);
+    stmt_cache_entry_t *e;
+    sql_lexer_t end;
+    sqlite_vm *vm;
+    int i = 0;
+
+    while (i < db->stmt_cache_count) {
+        e = &db->stmt_cache[i];
+        if (e->vm->cookie != db->schema_cookie) {
+            vm_free(e->vm);
+            riscos_free(stmt_cache_remove(db, i));
+            continue;
+        }
+        if (e->sql[0] == sql[0] && strncmp(e->sql, sql, e->len) == 0) {
+            sql_lexer_start(&end, sql + e->len);
+            if (!TK_IS_END(end.token.type)) {
+                i++;
+                continue;
+            }
+            *lx = end;
+            *plen = e->len;
+            vm = e->vm;
+            *psql = stmt_cache_remove(db, i);
+            db->stmt_cache_hits++;
+            return vm;
+        }
+        i++;
+    }
+    db->stmt_cache_misses++;
+    return NULL;
+}
+
+/*
+** Put a statement at the front of the cache, evicting the least recently
+** used one if the cache is full
+** The cache takes ownership of vm and of cache_sql, the entry's copy of
+** the len bytes of sql (made here if NULL); a statement that cannot be
+** cached is freed.
+*/
+static void stmt_cache_put(sqlite *db, const char *sql, int len,
+                           char *cache_sql, sqlite_vm *vm)
+{
+    stmt_cache_entry_t *e;
+
+    if (!cache_sql && len <= STMT_CACHE_MAX_SQL) {
+        cache_sql = (char *)riscos_malloc(len + 1);
+        if (cache_sql) {
+            memcpy(cache_sql, sql, len);
+            cache_sql[len] = '\0';
+        }
+    }
+    if (!cache_sql || vm->cookie != db->schema_cookie) {
+        riscos_free(cache_sql);
+        vm_free(vm);
+        return;
     }
 
-    /* Prepare column names array */
-    col_names = (char **)riscos_malloc(sizeof(char *) * table->num_columns);
-    if (!col_names) {
-        if (errmsg) *errmsg = "Out of memory";
+    if (db->stmt_cache_count == STMT_CACHE_SIZE) {
+        e = &db->stmt_cache[--db->stmt_cache_count];
+        vm_free(e->vm);
+        riscos_free(e->sql);
+    }
+    memmove(&db->stmt_cache[1], &db->stmt_cache[0],
+            db->stmt_cache_count * sizeof(stmt_cache_entry_t));
+    e = &db->stmt_cache[0];
+    e->sql = cache_sql;
+    e->len = len;
+    e->vm = vm;
+    db->stmt_cache_count++;
+}
+
+/*
+** Free every cached statement
+*/
+static void stmt_cache_clear(sqlite *db)
+{
+    stmt_cache_entry_t *e;
+
+    while (db->stmt_cache_count > 0) {
+        e = &db->stmt_cache[--db->stmt_cache_count];
+        vm_free(e->vm);
+        riscos_free(e->sql);
+    }
+}
+
+/*
+** Run a SELECT or INSERT statement, compiling it unless the cache has it
+** The lexer is on the statement's first keyword, and is left on its end.
+*/
+static int execute_statement(sqlite *db, sql_lexer_t *lx,
+                             int (*callback)(void*,int,char**,char**),
+                             void *arg, char **errmsg)
+{
+    const char *sql = SQL_TOKEN_TEXT(lx);
+    sqlite_vm *vm;
+    char *cache_sql = NULL;
+    int len, rc;
+
+    vm = stmt_cache_take(db, lx, &cache_sql, &len);
+    if (!vm) {
+        int type = lx->token.type;
+        sql_lexer_next(lx);
+        if (type == TK_INSERT) {
+            rc = compile_insert(db, lx, &vm, errmsg);
+        } else {
+            rc = compile_select(db, lx, &vm, errmsg);
+        }
+        if (rc != SQLITE_OK) return rc;
+        vm->cookie = db->schema_cookie;
+        len = (int)(SQL_TOKEN_TEXT(lx) - sql);
+    }
+
+    rc = run_statement(vm, callback, arg, errmsg);
+    vdbe_reset(vm->vdbe);
+    stmt_cache_put(db, sql, len, cache_sql, vm);
+    return rc;
+}
+
+/*
+** Report a single integer PRAGMA value through the callback
+*/
+static int pragma_result(const char *name, int value,
+                         int (*callback)(void*,int,char**,char**), void *arg)
+{
+    char buf[16];
+    char *values[1];
+    char *names[1];
+
+    if (!callback) return SQLITE_OK;
+
+    sprintf(buf, "%d", value);
+    values[0] = buf;
+    names[0] = (char *)name;
+    return callback(arg, 1, values, names) ? SQLITE_ABORT : SQLITE_OK;
+}
+
+/* PRAGMA synchronous levels by name, indexed by PAGER_SYNC_xxx */
+static const char *const sync_level_names[] = { "OFF", "NORMAL", "FULL" };
+
+/*
+** Execute PRAGMA statement
+** Syntax: PRAGMA name; PRAGMA name = value; PRAGMA name(value)
+** A value is an integer or, for some pragmas, a name.
+** Unrecognized pragmas are accepted and ignored.
+*/
+static int execute_pragma(sqlite *db, sql_lexer_t *lx,
+                          int (*callback)(void*,int,char**,char**),
+                          void *arg, char **errmsg)
+{
+    char name[MAX_COL_NAME];
+    const char *word = NULL;
+    int has_value = 0, value = 0, word_len = 0;
+
+    if (!parse_identifier(lx, name, sizeof(name))) {
+        if (errmsg) *errmsg = "Missing pragma name";
         return SQLITE_ERROR;
     }
 
-    for (i = 0; i < table->num_columns; i++) {
-        col_names[i] = table->columns[i].name;
+    /* Optional integer value */
+    if (sql_lexer_accept(lx, TK_EQ) || sql_lexer_accept(lx, TK_LP)) {
+        int negative = sql_lexer_accept(lx, TK_MINUS);
+        if (!negative) sql_lexer_accept(lx, TK_PLUS);
+        if (lx->token.type == TK_INTEGER) {
+            value = atoi(SQL_TOKEN_TEXT(lx));
+        } else if (TK_IS_NAME(lx->token.type)) {
+            word = SQL_TOKEN_TEXT(lx);
+            word_len = lx->token.length;
+        }
+        if (negative) value = -value;
+        has_value = 1;
+    }
+
+    if (strcasecmp(name, "cache_size") == 0) {
+        if (has_value) {
+            pager_set_cache_size(db->pager, value < 0 ? -value : value);
+            db->cache_size = pager_cache_size(db->pager);
+            return SQLITE_OK;
+        }
+        return pragma_result("cache_size", db->cache_size, callback, arg);
     }
 
-    /* Call callback for each row */
-    if (callback) {
-        for (r = 0; r < table->num_rows; r++) {
-            int result = callback(arg, table->num_columns,
-                                 table->rows[r].values, col_names);
-            if (result != 0) {
-                /* Callback requested abort */
-                riscos_free(col_names);
-                return SQLITE_ABORT;
+    if (strcasecmp(name, "synchronous") == 0) {
+        if (has_value) {
+            if (word) {
+                for (value = PAGER_SYNC_FULL; value >= PAGER_SYNC_OFF; value--) {
+                    const char *level = sync_level_names[value];
+                    if ((int)strlen(level) == word_len &&
+                        strncasecmp(word, level, word_len) == 0) break;
+                }
+                if (value < PAGER_SYNC_OFF) {
+                    if (errmsg) *errmsg = "Unknown synchronous level";
+                    return SQLITE_ERROR;
+                }
             }
+            pager_set_synchronous(db->pager, value);
+            return SQLITE_OK;
+        }
+        return pragma_result("synchronous", pager_synchronous(db->pager), callback, arg);
+    }
+
+    if (strcasecmp(name, "wal_checkpoint") == 0) {
+        int frames;
+        if (pager_checkpoint(db->pager, &frames) != SQLITE_OK) {
+            if (errmsg) *errmsg = "Disk I/O error";
+            return SQLITE_IOERR;
         }
+        return pragma_result("wal_checkpoint", frames, callback, arg);
     }
 
-    riscos_free(col_names);
     return SQLITE_OK;
 }
 
 /*
-** Parse and execute SQL statement
+** Execute BEGIN, COMMIT, ROLLBACK, SAVEPOINT or RELEASE
+** Inside a transaction statements are not committed as they finish;
+** COMMIT writes all their changes as one commit. ROLLBACK has the pager
+** discard the pages and undoes the changes to the tables from the undo
+** log. SAVEPOINT name starts a transaction if none is open, and releasing
+** that outermost savepoint commits it; ROLLBACK TO name undoes everything
+** since the savepoint and leaves it open.
 */
-static int parse_sql_statement(sqlite *db, const char *sql,
-                               int (*callback)(void*,int,char**,char**),
-                               void *arg, char **errmsg)
+static int execute_transaction(sqlite *db, sql_lexer_t *lx, char **errmsg)
 {
-    const char *p;
-
-    if (!sql) return SQLITE_OK;
-
-    p = skip_whitespace(sql);
+    char name[MAX_TABLE_NAME];
+    int type = lx->token.type;
+    int level = -1;
+    int t, rc;
+
+    sql_lexer_next(lx);
+    if (type != TK_SAVEPOINT && type != TK_RELEASE) sql_lexer_accept(lx, TK_TRANSACTION);
+
+    /* RELEASE [SAVEPOINT] name, ROLLBACK [TRANSACTION] TO [SAVEPOINT] name */
+    if (type == TK_RELEASE || (type == TK_ROLLBACK && sql_lexer_accept(lx, TK_TO))) {
+        sql_lexer_accept(lx, TK_SAVEPOINT);
+        if (!parse_identifier(lx, name, sizeof(name))) {
+            if (errmsg) *errmsg = "Missing savepoint name";
+            return SQLITE_ERROR;
+        }
+        level = find_savepoint(db, name);
+        if (level < 0) {
+            if (errmsg) *errmsg = "No such savepoint";
+            return SQLITE_ERROR;
+        }
+    }
 
-    /* Dispatch based on SQL command */
-    if (keyword_match(p, "CREATE")) {
-        p = skip_whitespace(p + 6);
-        if (keyword_match(p, "TABLE")) {
-            return execute_create_table(db, sql, errmsg);
-        }
-    } else if (keyword_match(p, "DROP")) {
-        p = skip_whitespace(p + 4);
-        if (keyword_match(p, "TABLE")) {
-            return execute_drop_table(db, sql, errmsg);
-        }
-    } else if (keyword_match(p, "INSERT")) {
-        return execute_insert(db, sql, errmsg);
-    } else if (keyword_match(p, "SELECT")) {
-        return execute_select(db, sql, callback, arg, errmsg);
-    } else if (keyword_match(p, "UPDATE")) {
-        /* Placeholder for UPDATE implementation */
-        if (errmsg) *errmsg = "UPDATE not yet fully implemented";
-        return SQLITE_OK;
-    } else if (keyword_match(p, "DELETE")) {
-        /* Placeholder for DELETE implementation */
-        if (errmsg) *errmsg = "DELETE not yet fully implemented";
-        return SQLITE_OK;
-    } else if (keyword_match(p, "BEGIN")) {
+    if (type == TK_BEGIN) {
+        if (db->in_transaction) {
+            if (errmsg) *errmsg = "Cannot start a transaction within a transaction";
+            return SQLITE_ERROR;
+        }
         db->in_transaction = 1;
         return SQLITE_OK;
-    } else if (keyword_match(p, "COMMIT")) {
-        db->in_transaction = 0;
+    }
+
+    if (type == TK_SAVEPOINT) {
+        if (!parse_identifier(lx, name, sizeof(name))) {
+            if (errmsg) *errmsg = "Missing savepoint name";
+            return SQLITE_ERROR;
+        }
+        rc = savepoint_open(db, name);
+        if (rc != SQLITE_OK) {
+            if (errmsg) *errmsg = "Out of memory";
+            return rc;
+        }
+        if (!db->in_transaction) {
+            db->in_transaction = 1;
+            db->savepoint_transaction = 1;
+        }
+        return SQLITE_OK;
+    }
+
+    if (type == TK_RELEASE) {
+        savepoint_release(db, level);
+        if (level == 0 && db->savepoint_transaction) {
+            /* finish_statement commits once the flag is clear */
+            db->in_transaction = 0;
+            db->savepoint_transaction = 0;
+        }
         return SQLITE_OK;
-    } else if (keyword_match(p, "ROLLBACK")) {
+    }
+
+    if (!db->in_transaction) {
+        if (errmsg) {
+            *errmsg = type == TK_COMMIT ? "Cannot commit - no transaction is active"
+                                        : "Cannot rollback - no transaction is active";
+        }
+        return SQLITE_ERROR;
+    }
+
+    if (type == TK_COMMIT) {
         db->in_transaction = 0;
+        db->savepoint_transaction = 0;
+        db->num_savepoints = 0;
         return SQLITE_OK;
-    } else if (keyword_match(p, "PRAGMA")) {
-        /* PRAGMA statement - just return OK */
+    }
+
+    /* Rows being read must stay where they are */
+    for (t = 0; t < db->num_tables; t++) {
+        if (db->tables[t]->readers > 0) {
+            if (errmsg) *errmsg = "Table is locked";
+            return SQLITE_LOCKED;
+        }
+    }
+    if (level >= 0) {
+        savepoint_rollback(db, level);
         return SQLITE_OK;
     }
+    db->in_transaction = 0;
+    db->savepoint_transaction = 0;
+    db->num_savepoints = 0;
+    pager_rollback(db->pager);
+    undo_rollback(db, 0);
+    return SQLITE_OK;
+}
+
+/*
+** Parse and execute SQL statement
+** The lexer is on the statement's first token. After a statement that ran,
+** it is left past the statement's ';', on the first token of the next.
+*/
+static int parse_sql_statement(sqlite *db, sql_lexer_t *lx,
+                               int (*callback)(void*,int,char**,char**),
+                               void *arg, char **errmsg)
+{
+    int rc = SQLITE_OK;
+
+    /* Dispatch based on SQL command */
+    switch (lx->token.type) {
+        case TK_CREATE:
+            sql_lexer_next(lx);
+            if (sql_lexer_accept(lx, TK_TABLE)) {
+                rc = execute_create_table(db, lx, errmsg);
+            } else if (lx->token.type == TK_INDEX || lx->token.type == TK_UNIQUE) {
+                rc = execute_create_index(db, lx, errmsg);
+            }
+            break;
+        case TK_DROP:
+            sql_lexer_next(lx);
+            if (sql_lexer_accept(lx, TK_TABLE)) {
+                rc = execute_drop_table(db, lx, errmsg);
+            } else if (sql_lexer_accept(lx, TK_INDEX)) {
+                rc = execute_drop_index(db, lx, errmsg);
+            }
+            break;
+        case TK_INSERT:
+        case TK_SELECT:
+            rc = execute_statement(db, lx, callback, arg, errmsg);
+            break;
+        case TK_UPDATE:
+            /* Placeholder for UPDATE implementation */
+            if (errmsg) *errmsg = "UPDATE not yet fully implemented";
+            break;
+        case TK_DELETE:
+            /* Placeholder for DELETE implementation */
+            if (errmsg) *errmsg = "DELETE not yet fully implemented";
+            break;
+        case TK_BEGIN:
+        case TK_COMMIT:
+        case TK_ROLLBACK:
+        case TK_SAVEPOINT:
+        case TK_RELEASE:
+            rc = execute_transaction(db, lx, errmsg);
+            break;
+        case TK_PRAGMA:
+            sql_lexer_next(lx);
+            rc = execute_pragma(db, lx, callback, arg, errmsg);
+            break;
+    }
+    if (rc != SQLITE_OK) return rc;
 
+    /* Whatever the statement did not read runs up to its end */
+    while (!TK_IS_END(lx->token.type)) sql_lexer_next(lx);
+    sql_lexer_accept(lx, TK_SEMI);
     return SQLITE_OK;
 }
 
+/*
+** Make a finished statement's changes durable, or take them back on error
+** Inside a transaction only a failed statement's own changes are taken
+** back; the rest waits for COMMIT or ROLLBACK.
+*/
+static int finish_statement(sqlite *db, int rc, char **errmsg)
+{
+    if (db->statement_savepoint) {
+        int level = db->num_savepoints - 1;
+        db->statement_savepoint = 0;
+        if (rc != SQLITE_OK) savepoint_rollback(db, level);
+        savepoint_release(db, level);
+    }
+    if (db->in_transaction) return rc;
+
+    if (rc == SQLITE_OK) {
+        rc = pager_commit(db->pager);
+        if (rc != SQLITE_OK && errmsg) *errmsg = "Disk I/O error";
+    }
+    if (rc != SQLITE_OK) {
+        pager_rollback(db->pager);
+        undo_rollback(db, 0);
+    }
+    undo_discard(db);
+    return rc;
+}
+
 /*
 ** Execute SQL statement(s)
-** Parses and executes the provided SQL statement
+** Statements separated by semicolons run in turn, each committed before
+** the next starts; execution stops at the first error. The commits of a
+** script share a single sync of the log at its end.
 */
 int sqlite_exec(sqlite *db, const char *sql,
                 int (*callback)(void*,int,char**,char**),
                 void *arg, char **errmsg)
 {
-    int result;
+    sql_lexer_t lx;
+    int result = SQLITE_OK;
 
     if (!db || !sql) {
         if (errmsg) *errmsg = "Invalid arguments";
@@ -672,12 +3579,280 @@ int sqlite_exec(sqlite *db, const char *sql,
         return SQLITE_ERROR;
     }
 
-    /* Parse and execute the SQL statement */
-    result = parse_sql_statement(db, sql, callback, arg, errmsg);
+    /*
+    ** One lexer walks the caller's text: each statement leaves it on the
+    ** first token of the next, so the script is read once, in place.
+    */
+    sql_lexer_start(&lx, sql);
+    pager_begin_group_commit(db->pager);
+    while (result == SQLITE_OK && lx.token.type != TK_EOF) {
+        if (sql_lexer_accept(&lx, TK_SEMI)) continue;
+
+        result = parse_sql_statement(db, &lx, callback, arg, errmsg);
+        result = finish_statement(db, result, errmsg);
+    }
+    pager_end_group_commit(db->pager);
 
     return result;
 }
 
+/*
+** Compile the first SQL statement in sql
+** *tail is set to the text after it. A SELECT or INSERT becomes a program
+** whose ? parameters can be bound before each run; other statements are
+** kept as text and run by the first sqlite_step. *pvm is NULL when there
+** is no statement, only whitespace. A vm depends on the schema it was
+** compiled against: once the schema changes, stepping it fails with
+** SQLITE_SCHEMA and it must be compiled again.
+*/
+int sqlite_compile(sqlite *db, const char *sql, const char **tail, sqlite_vm **pvm,
+                   char **errmsg)
+{
+    const char *start;
+    char *text = NULL;
+    sql_lexer_t lx;
+    sqlite_vm *vm = NULL;
+    int rc;
+
+    if (pvm) *pvm = NULL;
+    if (tail) *tail = sql;
+    if (!db || !sql || !pvm) {
+        if (errmsg) *errmsg = "Invalid arguments";
+        return SQLITE_MISUSE;
+    }
+    if (!db->is_open) {
+        if (errmsg) *errmsg = "Database not open";
+        return SQLITE_ERROR;
+    }
+
+    sql_lexer_start(&lx, sql);
+    start = SQL_TOKEN_TEXT(&lx);
+    if (sql_lexer_accept(&lx, TK_INSERT)) {
+        rc = compile_insert(db, &lx, &vm, errmsg);
+    } else if (sql_lexer_accept(&lx, TK_SELECT)) {
+        rc = compile_select(db, &lx, &vm, errmsg);
+    } else if (TK_IS_END(lx.token.type)) {
+        rc = SQLITE_OK;
+    } else {
+        /* Kept as text until sqlite_step runs it */
+        while (!TK_IS_END(lx.token.type)) sql_lexer_next(&lx);
+        text = (char *)riscos_malloc(SQL_TOKEN_TEXT(&lx) - start + 1);
+        vm = (sqlite_vm *)riscos_calloc(1, sizeof(sqlite_vm));
+        if (text && vm) {
+            memcpy(text, start, SQL_TOKEN_TEXT(&lx) - start);
+            text[SQL_TOKEN_TEXT(&lx) - start] = '\0';
+            vm->db = db;
+            vm->sql = text;
+            rc = SQLITE_OK;
+        } else {
+            riscos_free(text);
+            riscos_free(vm);
+            vm = NULL;
+            if (errmsg) *errmsg = "Out of memory";
+            rc = SQLITE_NOMEM;
+        }
+    }
+
+    /* The tail starts past the statement's ';', wherever compiling stopped */
+    while (!TK_IS_END(lx.token.type)) sql_lexer_next(&lx);
+    sql_lexer_accept(&lx, TK_SEMI);
+    if (tail) *tail = SQL_TOKEN_TEXT(&lx);
+    if (!vm && rc == SQLITE_OK) return SQLITE_OK;
+
+    if (rc != SQLITE_OK) {
+        /* Compiling INSERT may have given the table a column */
+        finish_statement(db, rc, NULL);
+        return rc;
+    }
+
+    vm->cookie = db->schema_cookie;
+    *pvm = vm;
+    return finish_statement(db, SQLITE_OK, errmsg);
+}
+
+/*
+** Run a compiled statement to its next result row
+** Returns SQLITE_ROW with *pazValue set to the row as text (valid until the
+** next step), SQLITE_DONE with *pazValue NULL, or an error. *pN and
+** *pazColName give the result columns: their names, then their declared
+** types. Stepping again after SQLITE_DONE or an error needs a reset.
+*/
+int sqlite_step(sqlite_vm *vm, int *pN, const char ***pazValue, const char ***pazColName)
+{
+    const value_t *values;
+    char *errmsg = NULL;
+    int rc, i, n;
+
+    if (pN) *pN = 0;
+    if (pazValue) *pazValue = NULL;
+    if (pazColName) *pazColName = NULL;
+    if (!vm || vm->done) return SQLITE_MISUSE;
+
+    if (!vm->running && vm->cookie != vm->db->schema_cookie) {
+        rc = SQLITE_SCHEMA;
+        errmsg = "Database schema has changed";
+    } else if (!vm->vdbe) {
+        sql_lexer_t lx;
+        vm->running = 1;
+        sql_lexer_start(&lx, vm->sql);
+        rc = parse_sql_statement(vm->db, &lx, NULL, NULL, &errmsg);
+        if (rc == SQLITE_OK) rc = SQLITE_DONE;
+    } else {
+        vm->running = 1;
+        rc = vdbe_step(vm->vdbe, &errmsg);
+    }
+
+    if (pN) *pN = vm->num_columns;
+    if (pazColName) *pazColName = (const char **)vm->col_names;
+    if (rc == SQLITE_ROW) {
+        values = vdbe_row(vm->vdbe, &n);
+        for (i = 0; i < n; i++) {
+            vm->argv[i] = (char *)value_to_text(&values[i],
+                                                vm->text_buf + i * VALUE_TEXT_BUF);
+        }
+        if (pazValue) *pazValue = (const char **)vm->argv;
+        return rc;
+    }
+
+    /* Finished: commit or roll back as sqlite_exec would */
+    rc = finish_statement(vm->db, rc == SQLITE_DONE ? SQLITE_OK : rc, &errmsg);
+    vm->done = 1;
+    if (rc != SQLITE_OK) {
+        vm->rc = rc;
+        vm->errmsg = errmsg;
+        return rc;
+    }
+    return SQLITE_DONE;
+}
+
+/*
+** Rewind a compiled statement so it can be run again
+** Parameter bindings are kept. Returns the error that stopped the last
+** run, if any.
+*/
+int sqlite_reset(sqlite_vm *vm, char **errmsg)
+{
+    int rc;
+
+    if (!vm) return SQLITE_MISUSE;
+    rc = vm->rc;
+    if (rc != SQLITE_OK && errmsg) *errmsg = vm->errmsg;
+    if (vm->vdbe) vdbe_reset(vm->vdbe);
+    vm->done = 0;
+    vm->running = 0;
+    vm->rc = SQLITE_OK;
+    vm->errmsg = NULL;
+    return rc;
+}
+
+/*
+** Free a compiled statement
+** Returns the error that stopped the last run, if any. Every vm must be
+** finalized before its database is closed.
+*/
+int sqlite_finalize(sqlite_vm *vm, char **errmsg)
+{
+    int rc;
+
+    if (!vm) return SQLITE_OK;
+    rc = vm->rc;
+    if (rc != SQLITE_OK && errmsg) *errmsg = vm->errmsg;
+    vm_free(vm);
+    return rc;
+}
+
+/*
+** Utility: Bind a value to parameter idx of a compiled statement
+*/
+static int bind_value(sqlite_vm *vm, int idx, const value_t *value, int copy)
+{
+    if (!vm || vm->running) return SQLITE_MISUSE;
+    if (!vm->vdbe) return SQLITE_RANGE;
+    return vdbe_bind(vm->vdbe, idx, value, copy);
+}
+
+/*
+** Bind text to a parameter; it is converted with the affinity of the
+** column it is stored in or compared with
+** value NULL binds NULL. len counts the terminating NUL; if negative, the
+** length is found with strlen. Without copy, value must stay valid until
+** the parameter is bound again or the statement is finalized.
+*/
+int sqlite_bind(sqlite_vm *vm, int idx, const char *value, int len, int copy)
+{
+    value_t v;
+
+    if (!value) {
+        v.type = VALUE_NULL;
+    } else {
+        v.type = VALUE_TEXT;
+        v.u.s.z = value;
+        v.u.s.n = len < 0 ? (int)strlen(value) : len > 0 ? len - 1 : 0;
+    }
+    return bind_value(vm, idx, &v, copy);
+}
+
+int sqlite_bind_int(sqlite_vm *vm, int idx, int value)
+{
+    value_t v;
+    v.type = VALUE_INTEGER;
+    v.u.i = value;
+    return bind_value(vm, idx, &v, 0);
+}
+
+int sqlite_bind_double(sqlite_vm *vm, int idx, double value)
+{
+    value_t v;
+    v.type = VALUE_REAL;
+    v.u.r = value;
+    return bind_value(vm, idx, &v, 0);
+}
+
+int sqlite_bind_null(sqlite_vm *vm, int idx)
+{
+    value_t v;
+    v.type = VALUE_NULL;
+    return bind_value(vm, idx, &v, 0);
+}
+
+/*
+** Number of ? parameters in a compiled statement
+*/
+int sqlite_bind_parameter_count(sqlite_vm *vm)
+{
+    return vm && vm->vdbe ? vdbe_param_count(vm->vdbe) : 0;
+}
+
+/*
+** Get page cache statistics
+** Any of the output pointers may be NULL.
+*/
+int sqlite_get_cache_stats(sqlite *db, int *hits, int *misses, int *evictions)
+{
+    pager_stats_t stats;
+
+    if (!db || !db->pager) return SQLITE_ERROR;
+
+    pager_get_stats(db->pager, &stats);
+    if (hits) *hits = stats.hits;
+    if (misses) *misses = stats.misses;
+    if (evictions) *evictions = stats.evictions;
+    return SQLITE_OK;
+}
+
+/*
+** Get statement cache statistics (see execute_statement)
+** Either output pointer may be NULL.
+*/
+int sqlite_get_stmt_cache_stats(sqlite *db, int *hits, int *misses)
+{
+    if (!db) return SQLITE_ERROR;
+
+    if (hits) *hits = db->stmt_cache_hits;
+    if (misses) *misses = db->stmt_cache_misses;
+    return SQLITE_OK;
+}
+
 /*
 ** Get number of tables in database
 */
@@ -693,7 +3868,7 @@ int sqlite_get_table_count(sqlite *db)
 const char *sqlite_get_table_name(sqlite *db, int index)
 {
     if (!db || index < 0 || index >= db->num_tables) return NULL;
-    return db->tables[index].name;
+    return db->tables[index]->name;
 }
 
 /*
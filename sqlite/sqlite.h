@@ -10,6 +10,7 @@
 #include <stdlib.h>
 
 typedef struct sqlite sqlite;
+typedef struct sqlite_vm sqlite_vm;
 
 /* Function prototypes - Database Management */
 sqlite *sqlite_open(const char *filename, int mode, char **errmsg);
@@ -17,12 +18,28 @@ void sqlite_close(sqlite *db);
 int sqlite_exec(sqlite *db, const char *sql, int (*callback)(void*,int,char**,char**),
                 void *arg, char **errmsg);
 
+/* Function prototypes - Compiled Statements (? marks a parameter, numbered from 1) */
+int sqlite_compile(sqlite *db, const char *sql, const char **tail, sqlite_vm **pvm,
+                   char **errmsg);
+int sqlite_step(sqlite_vm *vm, int *pN, const char ***pazValue, const char ***pazColName);
+int sqlite_reset(sqlite_vm *vm, char **errmsg);
+int sqlite_finalize(sqlite_vm *vm, char **errmsg);
+int sqlite_bind(sqlite_vm *vm, int idx, const char *value, int len, int copy);
+int sqlite_bind_int(sqlite_vm *vm, int idx, int value);
+int sqlite_bind_double(sqlite_vm *vm, int idx, double value);
+int sqlite_bind_null(sqlite_vm *vm, int idx);
+int sqlite_bind_parameter_count(sqlite_vm *vm);
+
 /* Function prototypes - Table Information */
 int sqlite_get_table_count(sqlite *db);
 const char *sqlite_get_table_name(sqlite *db, int index);
 int sqlite_get_column_count(sqlite *db, const char *table_name);
 const char *sqlite_get_column_name(sqlite *db, const char *table_name, int col_index);
 
+/* Function prototypes - Page Cache */
+int sqlite_get_cache_stats(sqlite *db, int *hits, int *misses, int *evictions);
+int sqlite_get_stmt_cache_stats(sqlite *db, int *hits, int *misses);
+
 /* Function prototypes - Utility */
 char *sqlite_libversion(void);
 
@@ -37,6 +54,14 @@ char *sqlite_libversion(void);
 #define SQLITE_NOMEM        7
 #define SQLITE_READONLY     8
 #define SQLITE_IOERR        9
+#define SQLITE_CORRUPT     11
+#define SQLITE_NOTFOUND    12
+#define SQLITE_SCHEMA      17
+#define SQLITE_CONSTRAINT  19
+#define SQLITE_MISUSE      21
+#define SQLITE_RANGE       25
+#define SQLITE_ROW        100  /* A statement step produced a row */
+#define SQLITE_DONE       101  /* A statement has finished */
 
 /* Configuration constants */
 #define SQLITE_DEFAULT_CACHE_SIZE 100
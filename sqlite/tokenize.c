@@ -0,0 +1,235 @@
+/*
+** SQLite Tokenizer for RISC OS
+**
+** One pass over the text, one character class test per byte. Keywords are
+** found with a perfect hash over the first two and the last character and
+** the length, chosen so that every keyword lands in its own slot: a word
+** costs one table probe and at most one comparison, whatever its case.
+*/
+
+#include <string.h>
+#include <ctype.h>
+#include "tokenize.h"
+
+/* Keyword text, in token type order from TK_FIRST_KEYWORD */
+static const char *const keyword_text[] = {
+    "AND", "ASC", "BEGIN", "BETWEEN", "BY", "CHECK", "COLLATE", "COMMIT",
+    "CONSTRAINT", "CREATE", "DEFAULT", "DELETE", "DESC", "DROP", "FOREIGN",
+    "FROM", "INDEX", "INSERT", "INTO", "IS", "ISNULL", "KEY", "LIKE", "NOT",
+    "NOTNULL", "NULL", "ON", "OR", "ORDER", "PRAGMA", "PRIMARY", "REFERENCES",
+    "RELEASE", "ROLLBACK", "SAVEPOINT", "SELECT", "TABLE", "TO", "TRANSACTION",
+    "UNIQUE", "UPDATE", "USING", "VALUES", "WHERE", "WITH"
+};
+
+/* Keyword hash slots: 1 + index into keyword_text, or 0 if none */
+#define KEYWORD_SLOTS 101
+
+static const unsigned char keyword_slot[KEYWORD_SLOTS] = {
+     0,  0, 17,  0,  0,  0, 21,  0,  0, 20,  3,  0,
+     4,  0, 13,  0,  0,  1, 12,  0,  0,  0,  0,  0,
+     6,  0,  0,  0,  0,  0, 33,  2, 37,  0, 11, 25,
+     0, 27,  0, 24,  0,  7,  0, 35,  0,  0,  0, 32,
+    30, 10, 26,  0, 36, 28,  0,  8, 29,  0,  0,  9,
+     0,  0,  0, 43,  0,  0, 14, 34,  0,  0,  0,  0,
+     0, 31, 15,  0,  0, 44,  5, 16, 40, 38, 45,  0,
+     0,  0, 41,  0,  0,  0,  0, 22, 23, 19,  0,  0,
+    42,  0, 39,  0, 18
+};
+
+/*
+** Utility: Slot of a word in keyword_slot (letters hash the same in either
+** case)
+*/
+#define KEYWORD_HASH(z, n) \
+    (((z)[0] & 0xDF) * 8 + ((z)[1] & 0xDF) * 3 + ((z)[(n) - 1] & 0xDF) + (n)) \
+        % KEYWORD_SLOTS
+
+/*
+** Utility: Character may continue a name
+*/
+#define IS_ID_CHAR(c) (isalnum((unsigned char)(c)) || (c) == '_' || (c) == '$' || \
+                       ((unsigned char)(c) & 0x80))
+
+/*
+** Token type of the word z[0..n): its keyword, or TK_ID
+*/
+int sql_keyword_code(const char *z, int n)
+{
+    int k;
+
+    if (n < 2) return TK_ID;
+    k = keyword_slot[KEYWORD_HASH((const unsigned char *)z, n)];
+    if (k == 0) return TK_ID;
+    k--;
+    if (strncasecmp(z, keyword_text[k], n) != 0 || keyword_text[k][n] != '\0') {
+        return TK_ID;
+    }
+    return TK_FIRST_KEYWORD + k;
+}
+
+/*
+** Scan the token at z
+** Returns its length and sets *ptype; TK_EOF has length 0.
+*/
+int sql_get_token(const char *z, int *ptype)
+{
+    int i, c;
+
+    switch (*z) {
+        case '\0':
+            *ptype = TK_EOF;
+            return 0;
+        case ' ': case '\t': case '\n': case '\r': case '\f': case '\v':
+            for (i = 1; isspace((unsigned char)z[i]); i++) ;
+            *ptype = TK_SPACE;
+            return i;
+        case '-':
+            if (z[1] == '-') {
+                for (i = 2; z[i] && z[i] != '\n'; i++) ;
+                *ptype = TK_SPACE;
+                return i;
+            }
+            *ptype = TK_MINUS;
+            return 1;
+        case '/':
+            if (z[1] != '*') break;
+            for (i = 2; z[i] && !(z[i] == '*' && z[i + 1] == '/'); i++) ;
+            *ptype = TK_SPACE;
+            return z[i] ? i + 2 : i;
+        case '(': *ptype = TK_LP; return 1;
+        case ')': *ptype = TK_RP; return 1;
+        case ',': *ptype = TK_COMMA; return 1;
+        case ';': *ptype = TK_SEMI; return 1;
+        case '*': *ptype = TK_STAR; return 1;
+        case '+': *ptype = TK_PLUS; return 1;
+        case '?': *ptype = TK_VARIABLE; return 1;
+        case '=':
+            *ptype = TK_EQ;
+            return z[1] == '=' ? 2 : 1;
+        case '<':
+            if (z[1] == '=') { *ptype = TK_LE; return 2; }
+            if (z[1] == '>') { *ptype = TK_NE; return 2; }
+            *ptype = TK_LT;
+            return 1;
+        case '>':
+            if (z[1] == '=') { *ptype = TK_GE; return 2; }
+            *ptype = TK_GT;
+            return 1;
+        case '!':
+            if (z[1] != '=') break;
+            *ptype = TK_NE;
+            return 2;
+        case '\'': case '"':
+            /* A doubled quote stands for itself */
+            for (i = 1; z[i]; i++) {
+                if (z[i] == z[0]) {
+                    if (z[i + 1] != z[0]) break;
+                    i++;
+                }
+            }
+            *ptype = z[i] ? TK_STRING : TK_ILLEGAL;
+            return z[i] ? i + 1 : i;
+        case '`': case '[':
+            c = *z == '[' ? ']' : '`';
+            for (i = 1; z[i] && z[i] != c; i++) ;
+            *ptype = z[i] ? TK_ID : TK_ILLEGAL;
+            return z[i] ? i + 1 : i;
+        case '.':
+            if (!isdigit((unsigned char)z[1])) {
+                *ptype = TK_DOT;
+                return 1;
+            }
+            /* fall through */
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            *ptype = TK_INTEGER;
+            for (i = 0; isdigit((unsigned char)z[i]); i++) ;
+            if (z[i] == '.') {
+                *ptype = TK_FLOAT;
+                for (i++; isdigit((unsigned char)z[i]); i++) ;
+            }
+            if ((z[i] == 'e' || z[i] == 'E') &&
+                (isdigit((unsigned char)z[i + 1]) ||
+                 ((z[i + 1] == '+' || z[i + 1] == '-') && isdigit((unsigned char)z[i + 2])))) {
+                *ptype = TK_FLOAT;
+                for (i += 2; isdigit((unsigned char)z[i]); i++) ;
+            }
+            if (IS_ID_CHAR(z[i])) {
+                /* 12abc is not a number or a name */
+                while (IS_ID_CHAR(z[i])) i++;
+                *ptype = TK_ILLEGAL;
+            }
+            return i;
+        default:
+            if (!IS_ID_CHAR(*z)) break;
+            for (i = 1; IS_ID_CHAR(z[i]); i++) ;
+            *ptype = sql_keyword_code(z, i);
+            return i;
+    }
+    *ptype = TK_ILLEGAL;
+    return 1;
+}
+
+/*
+** Copy a token's text to out (size bytes, at least 1), without its quotes
+** and with doubled quotes undoubled; unquoted tokens are copied as they
+** are. Longer text is truncated. Returns the length copied.
+*/
+int sql_dequote(const char *z, int n, char *out, int size)
+{
+    char quote;
+    int i, j = 0;
+
+    switch (*z) {
+        case '\'': case '"': case '`': quote = *z; break;
+        case '[': quote = ']'; break;
+        default: quote = 0; break;
+    }
+    if (quote) {
+        for (i = 1; i < n - 1 && j < size - 1; i++) {
+            out[j++] = z[i];
+            if (z[i] == quote && quote != ']') i++;
+        }
+    } else {
+        for (i = 0; i < n && j < size - 1; i++) out[j++] = z[i];
+    }
+    out[j] = '\0';
+    return j;
+}
+
+/*
+** Start scanning sql: the first token becomes current
+*/
+void sql_lexer_start(sql_lexer_t *lx, const char *sql)
+{
+    lx->sql = sql;
+    lx->token.offset = 0;
+    lx->token.length = 0;
+    sql_lexer_next(lx);
+}
+
+/*
+** Move to the next token that is not whitespace or a comment
+** The lexer stays on TK_EOF once it gets there.
+*/
+void sql_lexer_next(sql_lexer_t *lx)
+{
+    sql_token_t *t = &lx->token;
+    int offset = t->offset + t->length;
+
+    do {
+        t->offset = offset;
+        t->length = sql_get_token(lx->sql + offset, &t->type);
+        offset += t->length;
+    } while (t->type == TK_SPACE);
+}
+
+/*
+** Consume the current token if it has the given type
+*/
+int sql_lexer_accept(sql_lexer_t *lx, int type)
+{
+    if (lx->token.type != type) return 0;
+    sql_lexer_next(lx);
+    return 1;
+}
@@ -0,0 +1,121 @@
+/*
+** SQLite Tokenizer for RISC OS
+** Splits SQL text into tokens without copying it
+**
+** A token is a type and a slice of the caller's buffer: its offset from
+** the start of the SQL and its length. Whitespace and comments (-- to the
+** end of the line, and C-style) are skipped. Keywords get their own token
+** types; any keyword can still stand for a name where the grammar expects
+** one, so a column called "key" or "desc" works. Quoted text is left in
+** place with its quotes; sql_dequote() copies it out when a parser needs
+** the value.
+*/
+
+#ifndef _TOKENIZE_H_
+#define _TOKENIZE_H_
+
+/* Token types */
+#define TK_EOF              0       /* End of the text */
+#define TK_ILLEGAL          1       /* Unrecognised character or unterminated string */
+#define TK_SPACE            2       /* Whitespace or a comment (never returned by the lexer) */
+#define TK_ID               3       /* Name: word, `name` or [name] */
+#define TK_STRING           4       /* 'text' or "text" */
+#define TK_INTEGER          5
+#define TK_FLOAT            6
+#define TK_VARIABLE         7       /* ? */
+#define TK_LP               8       /* ( */
+#define TK_RP               9       /* ) */
+#define TK_COMMA            10
+#define TK_SEMI             11
+#define TK_STAR             12
+#define TK_DOT              13
+#define TK_PLUS             14
+#define TK_MINUS            15
+#define TK_EQ               16      /* = or == */
+#define TK_NE               17      /* != or <> */
+#define TK_LT               18
+#define TK_LE               19
+#define TK_GT               20
+#define TK_GE               21
+
+/* Keywords, in alphabetical order */
+#define TK_FIRST_KEYWORD    32
+#define TK_AND             32
+#define TK_ASC             33
+#define TK_BEGIN           34
+#define TK_BETWEEN         35
+#define TK_BY              36
+#define TK_CHECK           37
+#define TK_COLLATE         38
+#define TK_COMMIT          39
+#define TK_CONSTRAINT      40
+#define TK_CREATE          41
+#define TK_DEFAULT         42
+#define TK_DELETE          43
+#define TK_DESC            44
+#define TK_DROP            45
+#define TK_FOREIGN         46
+#define TK_FROM            47
+#define TK_INDEX           48
+#define TK_INSERT          49
+#define TK_INTO            50
+#define TK_IS              51
+#define TK_ISNULL          52
+#define TK_KEY             53
+#define TK_LIKE            54
+#define TK_NOT             55
+#define TK_NOTNULL         56
+#define TK_NULL            57
+#define TK_ON              58
+#define TK_OR              59
+#define TK_ORDER           60
+#define TK_PRAGMA          61
+#define TK_PRIMARY         62
+#define TK_REFERENCES      63
+#define TK_RELEASE         64
+#define TK_ROLLBACK        65
+#define TK_SAVEPOINT       66
+#define TK_SELECT          67
+#define TK_TABLE           68
+#define TK_TO              69
+#define TK_TRANSACTION     70
+#define TK_UNIQUE          71
+#define TK_UPDATE          72
+#define TK_USING           73
+#define TK_VALUES          74
+#define TK_WHERE           75
+#define TK_WITH            76
+#define TK_LAST_KEYWORD     76
+
+/* A keyword or a name */
+#define TK_IS_NAME(type) ((type) == TK_ID || (type) >= TK_FIRST_KEYWORD)
+
+/* The end of a statement: its ';', or the end of the text */
+#define TK_IS_END(type) ((type) == TK_EOF || (type) == TK_SEMI)
+
+typedef struct {
+    int type;
+    int offset;                     /* Start, in bytes from the start of the SQL */
+    int length;
+} sql_token_t;
+
+/* Scanning state: the text and its current token */
+typedef struct {
+    const char *sql;
+    sql_token_t token;
+} sql_lexer_t;
+
+/* Single tokens */
+int sql_get_token(const char *z, int *ptype);
+int sql_keyword_code(const char *z, int n);
+int sql_dequote(const char *z, int n, char *out, int size);
+
+/* Token streams (whitespace and comments skipped) */
+void sql_lexer_start(sql_lexer_t *lx, const char *sql);
+void sql_lexer_next(sql_lexer_t *lx);
+int sql_lexer_accept(sql_lexer_t *lx, int type);
+
+/* Text of the current token */
+#define SQL_TOKEN_TEXT(lx) ((lx)->sql + (lx)->token.offset)
+
+#endif /* _TOKENIZE_H_ */
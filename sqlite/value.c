@@ -0,0 +1,343 @@
+/*
+** SQLite Values for RISC OS
+**
+** Conversion between SQL literals, native typed values and the text form
+** handed to sqlite_exec() callbacks. Numbers are parsed once, when a value
+** is stored, so scans and comparisons never re-parse text.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "value.h"
+
+/* Longest literal that is still considered as a number */
+#define VALUE_MAX_NUMBER 63
+
+/*
+** Parse text as a number
+** Returns VALUE_INTEGER or VALUE_REAL with the result stored in *pi or *pr,
+** or VALUE_NULL if the text is not entirely a number. Integers that do not
+** fit in 64 bits are returned as REAL.
+*/
+static value_type_t parse_number(const char *text, int len,
+                                 long long *pi, double *pr)
+{
+    char buf[VALUE_MAX_NUMBER + 1];
+    unsigned long long acc = 0, limit;
+    const char *p = text, *end = text + len;
+    char *stop;
+    int neg = 0, digits = 0, overflow = 0;
+
+    while (p < end && isspace((unsigned char)*p)) p++;
+    while (end > p && isspace((unsigned char)end[-1])) end--;
+    if (p == end || end - p > VALUE_MAX_NUMBER) return VALUE_NULL;
+
+    /* Integer: optional sign followed only by digits */
+    text = p;
+    if (*p == '-' || *p == '+') neg = *p++ == '-';
+    limit = neg ? 0x8000000000000000ull : 0x7FFFFFFFFFFFFFFFull;
+    while (p < end && isdigit((unsigned char)*p)) {
+        int d = *p++ - '0';
+        if (acc > (limit - d) / 10) overflow = 1;
+        else acc = acc * 10 + d;
+        digits++;
+    }
+    if (p == end && digits > 0 && !overflow) {
+        *pi = neg ? (long long)(0 - acc) : (long long)acc;
+        return VALUE_INTEGER;
+    }
+
+    /* Anything else must be consumed entirely by strtod() */
+    memcpy(buf, text, end - text);
+    buf[end - text] = '\0';
+    if (!isdigit((unsigned char)buf[0]) && buf[0] != '.' &&
+        buf[0] != '-' && buf[0] != '+') {
+        return VALUE_NULL;      /* Reject "inf", "nan" and hex forms */
+    }
+    *pr = strtod(buf, &stop);
+    if (stop == buf || *stop != '\0') return VALUE_NULL;
+    return VALUE_REAL;
+}
+
+/*
+** Make v a TEXT or BLOB value referring to text
+*/
+static void set_text(value_t *v, value_type_t type, const char *text, int len)
+{
+    v->type = type;
+    v->u.s.z = text;
+    v->u.s.n = len;
+}
+
+/*
+** Build a value from an SQL literal
+** Unquoted NULL is the NULL value. Otherwise the column affinity decides
+** the storage class: INTEGER and REAL columns store anything numeric as a
+** number (integral values in an INTEGER column as INTEGER), TEXT and BLOB
+** columns keep the literal as text, and untyped columns keep unquoted
+** numbers as numbers and everything else as text.
+** Text values refer to text, which must be NUL-terminated at text[len].
+*/
+void value_from_literal(value_t *v, const char *text, int len, int quoted,
+                        value_affinity_t affinity)
+{
+    value_type_t num = VALUE_NULL;
+    long long i = 0;
+    double r = 0.0;
+
+    if (!quoted && len == 4 && strncasecmp(text, "NULL", 4) == 0) {
+        v->type = VALUE_NULL;
+        return;
+    }
+
+    switch (affinity) {
+        case AFFINITY_TEXT:
+            set_text(v, VALUE_TEXT, text, len);
+            return;
+        case AFFINITY_BLOB:
+            set_text(v, VALUE_BLOB, text, len);
+            return;
+        case AFFINITY_NONE:
+            if (!quoted) num = parse_number(text, len, &i, &r);
+            break;
+        default:
+            num = parse_number(text, len, &i, &r);
+            break;
+    }
+
+    if (num == VALUE_REAL && affinity == AFFINITY_INTEGER &&
+        r >= -9223372036854775808.0 && r < 9223372036854775808.0 &&
+        (double)(long long)r == r) {
+        num = VALUE_INTEGER;
+        i = (long long)r;
+    }
+    if (num == VALUE_INTEGER && affinity == AFFINITY_REAL) {
+        num = VALUE_REAL;
+        r = (double)i;
+    }
+
+    switch (num) {
+        case VALUE_INTEGER:
+            v->type = VALUE_INTEGER;
+            v->u.i = i;
+            break;
+        case VALUE_REAL:
+            v->type = VALUE_REAL;
+            v->u.r = r;
+            break;
+        default:
+            set_text(v, VALUE_TEXT, text, len);
+            break;
+    }
+}
+
+/*
+** Convert a value as storing it in a column with the given affinity would
+** Text that reads as a number becomes that number under INTEGER or REAL
+** affinity, and numbers become text under TEXT or BLOB affinity, rendered
+** into buf (VALUE_TEXT_BUF bytes, which must outlive the value).
+*/
+void value_apply_affinity(value_t *v, value_affinity_t affinity, char *buf)
+{
+    const char *text;
+
+    switch (v->type) {
+        case VALUE_TEXT:
+            if (affinity != AFFINITY_NONE && affinity != AFFINITY_TEXT) {
+                value_from_literal(v, v->u.s.z, v->u.s.n, 1, affinity);
+            }
+            break;
+        case VALUE_INTEGER:
+        case VALUE_REAL:
+            if (affinity == AFFINITY_TEXT || affinity == AFFINITY_BLOB) {
+                text = value_to_text(v, buf);
+                set_text(v, affinity == AFFINITY_TEXT ? VALUE_TEXT : VALUE_BLOB,
+                         text, (int)strlen(text));
+            } else if (affinity == AFFINITY_REAL && v->type == VALUE_INTEGER) {
+                v->type = VALUE_REAL;
+                v->u.r = (double)v->u.i;
+            } else if (affinity == AFFINITY_INTEGER && v->type == VALUE_REAL &&
+                       v->u.r >= -9223372036854775808.0 &&
+                       v->u.r < 9223372036854775808.0 &&
+                       (double)(long long)v->u.r == v->u.r) {
+                v->type = VALUE_INTEGER;
+                v->u.i = (long long)v->u.r;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+** Compare two values
+** Returns negative, zero or positive. Classes order as NULL < numbers <
+** TEXT < BLOB; INTEGER and REAL compare numerically, text and blobs
+** byte by byte.
+*/
+int value_compare(const value_t *a, const value_t *b)
+{
+    int ca = a->type == VALUE_REAL ? VALUE_INTEGER : a->type;
+    int cb = b->type == VALUE_REAL ? VALUE_INTEGER : b->type;
+    int n, rc;
+
+    if (ca != cb) return ca < cb ? -1 : 1;
+
+    switch (ca) {
+        case VALUE_NULL:
+            return 0;
+        case VALUE_INTEGER:
+            if (a->type == VALUE_INTEGER && b->type == VALUE_INTEGER) {
+                return a->u.i < b->u.i ? -1 : a->u.i > b->u.i;
+            } else {
+                double x = a->type == VALUE_REAL ? a->u.r : (double)a->u.i;
+                double y = b->type == VALUE_REAL ? b->u.r : (double)b->u.i;
+                return x < y ? -1 : x > y;
+            }
+        default:
+            n = a->u.s.n < b->u.s.n ? a->u.s.n : b->u.s.n;
+            rc = memcmp(a->u.s.z, b->u.s.z, n);
+            if (rc != 0) return rc;
+            return a->u.s.n - b->u.s.n;
+    }
+}
+
+/*
+** Hash a value consistently with value_compare(): values that compare
+** equal hash equal, so a REAL with an integral value hashes as INTEGER.
+*/
+unsigned int value_hash(const value_t *v)
+{
+    unsigned long long bits;
+    unsigned int h = 2166136261u;
+    int k;
+
+    switch (v->type) {
+        case VALUE_INTEGER:
+            bits = (unsigned long long)v->u.i;
+            break;
+        case VALUE_REAL:
+            if (v->u.r >= -9223372036854775808.0 && v->u.r < 9223372036854775808.0 &&
+                (double)(long long)v->u.r == v->u.r) {
+                bits = (unsigned long long)(long long)v->u.r;
+            } else {
+                memcpy(&bits, &v->u.r, 8);
+            }
+            break;
+        case VALUE_TEXT:
+        case VALUE_BLOB:
+            for (k = 0; k < v->u.s.n; k++) {
+                h ^= (unsigned char)v->u.s.z[k];
+                h *= 16777619u;
+            }
+            return h ^ v->type;
+        default:
+            return 0;
+    }
+
+    /* Mix the 64 bits down to 32 */
+    bits ^= bits >> 33;
+    bits *= 0xFF51AFD7ED558CCDull;
+    bits ^= bits >> 33;
+    return (unsigned int)bits;
+}
+
+/*
+** Numeric value of a value, as a REAL
+** Text reads as much of its start as is a number, as atof() would, but
+** never past its length; NULL is 0.0.
+*/
+double value_to_real(const value_t *v)
+{
+    char buf[VALUE_MAX_NUMBER + 1];
+    int n;
+
+    switch (v->type) {
+        case VALUE_INTEGER:
+            return (double)v->u.i;
+        case VALUE_REAL:
+            return v->u.r;
+        case VALUE_TEXT:
+        case VALUE_BLOB:
+            n = v->u.s.n < VALUE_MAX_NUMBER ? v->u.s.n : VALUE_MAX_NUMBER;
+            memcpy(buf, v->u.s.z, n);
+            buf[n] = '\0';
+            return atof(buf);
+        default:
+            return 0.0;
+    }
+}
+
+/*
+** Render a value as text
+** INTEGER and REAL values are formatted into buf (VALUE_TEXT_BUF bytes);
+** TEXT and BLOB values are returned in place. NULL yields a NULL pointer.
+*/
+const char *value_to_text(const value_t *v, char *buf)
+{
+    switch (v->type) {
+        case VALUE_INTEGER: {
+            /* Formatted by hand: not every C library supports %lld */
+            unsigned long long u = v->u.i < 0 ? 0 - (unsigned long long)v->u.i
+                                              : (unsigned long long)v->u.i;
+            char *p = buf + VALUE_TEXT_BUF - 1;
+            *p = '\0';
+            do {
+                *--p = (char)('0' + (int)(u % 10));
+                u /= 10;
+            } while (u);
+            if (v->u.i < 0) *--p = '-';
+            return p;
+        }
+        case VALUE_REAL:
+            sprintf(buf, "%.15g", v->u.r);
+            if (!strpbrk(buf, ".eEnN")) strcat(buf, ".0");
+            return buf;
+        case VALUE_TEXT:
+        case VALUE_BLOB:
+            return v->u.s.z;
+        default:
+            return NULL;
+    }
+}
+
+/*
+** LIKE pattern match: % is any run, _ any one character, ASCII letters
+** match either case
+*/
+static int like_match(const char *p, const char *pe, const char *s, const char *se)
+{
+    const char *star_p = NULL, *star_s = NULL;
+
+    while (s < se) {
+        if (p < pe && *p == '%') {
+            star_p = ++p;
+            star_s = s;
+        } else if (p < pe && (*p == '_' ||
+                   tolower((unsigned char)*p) == tolower((unsigned char)*s))) {
+            p++;
+            s++;
+        } else if (star_p) {
+            p = star_p;
+            s = ++star_s;
+        } else {
+            return 0;
+        }
+    }
+    while (p < pe && *p == '%') p++;
+    return p == pe;
+}
+
+/*
+** Check a value against a LIKE pattern (neither may be NULL)
+** Numbers are matched in their text form.
+*/
+int value_like(const value_t *v, const value_t *pattern)
+{
+    char vbuf[VALUE_TEXT_BUF], pbuf[VALUE_TEXT_BUF];
+    const char *s = value_to_text(v, vbuf);
+    const char *p = value_to_text(pattern, pbuf);
+    return like_match(p, p + strlen(p), s, s + strlen(s));
+}
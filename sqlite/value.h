@@ -0,0 +1,62 @@
+/*
+** SQLite Values for RISC OS
+** Tagged value representation used for table cells
+**
+** INTEGER and REAL values are held in native binary form; TEXT and BLOB
+** values point at bytes owned by someone else (a row record or the SQL
+** text being parsed). Those bytes are always NUL-terminated so they can be
+** handed straight to a sqlite_exec() callback.
+*/
+
+#ifndef _VALUE_H_
+#define _VALUE_H_
+
+/* Value storage classes */
+typedef enum {
+    VALUE_NULL,
+    VALUE_INTEGER,
+    VALUE_REAL,
+    VALUE_TEXT,
+    VALUE_BLOB
+} value_type_t;
+
+/* Column affinity (how literals are converted when stored) */
+typedef enum {
+    AFFINITY_NONE,                  /* Keep the literal's own type */
+    AFFINITY_INTEGER,
+    AFFINITY_REAL,
+    AFFINITY_TEXT,
+    AFFINITY_BLOB
+} value_affinity_t;
+
+/* Tagged value */
+typedef struct {
+    value_type_t type;
+    union {
+        long long i;                /* VALUE_INTEGER */
+        double r;                   /* VALUE_REAL */
+        struct {
+            const char *z;          /* VALUE_TEXT / VALUE_BLOB, NUL-terminated */
+            int n;                  /* Length in bytes, excluding the NUL */
+        } s;
+    } u;
+} value_t;
+
+/* Buffer size large enough for any INTEGER or REAL rendered as text */
+#define VALUE_TEXT_BUF 32
+
+/* Construction */
+void value_from_literal(value_t *v, const char *text, int len, int quoted,
+                        value_affinity_t affinity);
+void value_apply_affinity(value_t *v, value_affinity_t affinity, char *buf);
+
+/* Comparison and hashing */
+int value_compare(const value_t *a, const value_t *b);
+unsigned int value_hash(const value_t *v);
+int value_like(const value_t *v, const value_t *pattern);
+
+/* Conversion */
+double value_to_real(const value_t *v);
+const char *value_to_text(const value_t *v, char *buf);
+
+#endif /* _VALUE_H_ */
@@ -0,0 +1,662 @@
+/*
+** SQLite Virtual Machine for RISC OS
+**
+** Instructions are four integers and a flag byte; literal operands are
+** not embedded but preloaded into registers of their own when the program
+** starts, so the loop body only ever moves and compares registers. Jump
+** targets may be labels while a program is being built; vdbe_ready()
+** replaces them with addresses.
+**
+** A sorter is a cursor whose rows are collected by OP_SorterInsert and
+** sorted by their leading key columns on OP_Rewind (a stable merge sort,
+** so rows with equal keys keep the order they were added in).
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "sqlite.h"
+#include "vdbe.h"
+#include "mem_riscos.h"
+
+/* Initial sizes of the growing arrays */
+#define VDBE_INITIAL_OPS     32
+#define VDBE_INITIAL_ROWS    64
+
+typedef struct {
+    unsigned char opcode;
+    unsigned char p5;
+    int p1;
+    int p2;
+    int p3;
+} vdbe_op_t;
+
+/* Value loaded into a register when the program starts */
+typedef struct {
+    int reg;
+    value_t value;                  /* Text and blobs point at a private copy */
+} vdbe_const_t;
+
+/* Bound parameter */
+typedef struct {
+    value_t value;
+    char *copy;                     /* Private copy of the text, if one was made */
+    char buf[VALUE_TEXT_BUF];       /* The number as text, for TEXT affinity */
+} vdbe_var_t;
+
+typedef struct {
+    const vdbe_table_ops_t *ops;    /* NULL for a sorter */
+    void *arg;
+    int is_open;
+    const value_t *row;             /* Current row, NULL when not on one */
+    /* Sorter */
+    int num_keys;
+    unsigned int desc;              /* Descending keys, one bit each */
+    int width;                      /* Values per row */
+    value_t *rows;
+    value_t **sorted;               /* Row pointers, then merge space */
+    int num_rows;
+    int capacity;
+    int pos;
+} vdbe_cursor_t;
+
+struct vdbe {
+    vdbe_op_t *ops;
+    int num_ops;
+    int ops_capacity;
+    vdbe_const_t *consts;
+    int num_consts;
+    int consts_capacity;
+    int *labels;                    /* Address of each label, -1 until resolved */
+    int num_labels;
+    vdbe_cursor_t *cursors;
+    int num_cursors;
+    value_t *regs;
+    int num_regs;
+    vdbe_var_t *vars;
+    int num_vars;
+    int rc;                         /* First error while building */
+    /* Execution state */
+    int pc;
+    int started;
+    int error;                      /* Error that stopped the program */
+    const value_t *result;
+    int num_result;
+};
+
+/*
+** Create an empty program
+*/
+vdbe_t *vdbe_create(void)
+{
+    vdbe_t *v = (vdbe_t *)riscos_calloc(1, sizeof(vdbe_t));
+    if (!v) return NULL;
+    v->ops = (vdbe_op_t *)riscos_malloc(VDBE_INITIAL_OPS * sizeof(vdbe_op_t));
+    if (!v->ops) {
+        riscos_free(v);
+        return NULL;
+    }
+    v->ops_capacity = VDBE_INITIAL_OPS;
+    return v;
+}
+
+/*
+** Free a program, closing any cursors it left open
+*/
+void vdbe_free(vdbe_t *v)
+{
+    int i;
+
+    if (!v) return;
+    vdbe_reset(v);
+    for (i = 0; i < v->num_consts; i++) {
+        value_t *value = &v->consts[i].value;
+        if (value->type == VALUE_TEXT || value->type == VALUE_BLOB) {
+            riscos_free((void *)value->u.s.z);
+        }
+    }
+    for (i = 0; i < v->num_cursors; i++) {
+        riscos_free(v->cursors[i].rows);
+        riscos_free(v->cursors[i].sorted);
+    }
+    for (i = 0; i < v->num_vars; i++) riscos_free(v->vars[i].copy);
+    riscos_free(v->vars);
+    riscos_free(v->ops);
+    riscos_free(v->consts);
+    riscos_free(v->labels);
+    riscos_free(v->cursors);
+    riscos_free(v->regs);
+    riscos_free(v);
+}
+
+/*
+** Utility: Grow an array by one element, recording failure in v->rc
+*/
+static void *grow(vdbe_t *v, void *array, int count, size_t size)
+{
+    void *p;
+
+    if (v->rc != SQLITE_OK) return NULL;
+    p = riscos_realloc(array, (size_t)(count + 1) * size);
+    if (!p) v->rc = SQLITE_NOMEM;
+    return p;
+}
+
+/*
+** Append an instruction, returning its address
+*/
+int vdbe_add_op(vdbe_t *v, int opcode, int p1, int p2, int p3)
+{
+    vdbe_op_t *op;
+
+    if (v->num_ops == v->ops_capacity) {
+        vdbe_op_t *ops = (vdbe_op_t *)riscos_realloc(v->ops,
+                            2 * v->ops_capacity * sizeof(vdbe_op_t));
+        if (!ops) {
+            v->rc = SQLITE_NOMEM;
+            return v->num_ops;
+        }
+        v->ops = ops;
+        v->ops_capacity *= 2;
+    }
+    op = &v->ops[v->num_ops];
+    op->opcode = (unsigned char)opcode;
+    op->p5 = 0;
+    op->p1 = p1;
+    op->p2 = p2;
+    op->p3 = p3;
+    return v->num_ops++;
+}
+
+/*
+** Make room for num_ops more instructions and num_consts more constants,
+** for a caller that knows how big the program will be
+*/
+void vdbe_reserve(vdbe_t *v, int num_ops, int num_consts)
+{
+    void *p;
+
+    if (v->rc != SQLITE_OK) return;
+    if (v->num_ops + num_ops > v->ops_capacity) {
+        p = riscos_realloc(v->ops, (v->num_ops + num_ops) * sizeof(vdbe_op_t));
+        if (!p) {
+            v->rc = SQLITE_NOMEM;
+            return;
+        }
+        v->ops = (vdbe_op_t *)p;
+        v->ops_capacity = v->num_ops + num_ops;
+    }
+    if (v->num_consts + num_consts > v->consts_capacity) {
+        p = riscos_realloc(v->consts, (v->num_consts + num_consts) * sizeof(vdbe_const_t));
+        if (!p) {
+            v->rc = SQLITE_NOMEM;
+            return;
+        }
+        v->consts = (vdbe_const_t *)p;
+        v->consts_capacity = v->num_consts + num_consts;
+    }
+}
+
+/*
+** Set the flags of the last instruction added
+*/
+void vdbe_set_p5(vdbe_t *v, int flags)
+{
+    if (v->num_ops > 0) v->ops[v->num_ops - 1].p5 = (unsigned char)flags;
+}
+
+/*
+** Allocate count consecutive registers, returning the first
+*/
+int vdbe_alloc_regs(vdbe_t *v, int count)
+{
+    int reg = v->num_regs;
+    v->num_regs += count;
+    return reg;
+}
+
+/*
+** Preload a register with a copy of value whenever the program starts
+*/
+void vdbe_set_constant(vdbe_t *v, int reg, const value_t *value)
+{
+    vdbe_const_t *k;
+
+    if (v->num_consts == v->consts_capacity) {
+        vdbe_reserve(v, 0, v->consts_capacity ? v->consts_capacity : 8);
+    }
+    if (v->rc != SQLITE_OK) return;
+    k = &v->consts[v->num_consts];
+    k->reg = reg;
+    k->value = *value;
+    if (value->type == VALUE_TEXT || value->type == VALUE_BLOB) {
+        char *z = (char *)riscos_malloc(value->u.s.n + 1);
+        if (!z) {
+            v->rc = SQLITE_NOMEM;
+            return;
+        }
+        memcpy(z, value->u.s.z, value->u.s.n);
+        z[value->u.s.n] = '\0';
+        k->value.u.s.z = z;
+    }
+    v->num_consts++;
+}
+
+/*
+** Add a table cursor, returning its number
+*/
+int vdbe_add_cursor(vdbe_t *v, const vdbe_table_ops_t *ops, void *arg)
+{
+    vdbe_cursor_t *cursors;
+
+    cursors = (vdbe_cursor_t *)grow(v, v->cursors, v->num_cursors, sizeof(vdbe_cursor_t));
+    if (!cursors) return 0;
+    v->cursors = cursors;
+    memset(&cursors[v->num_cursors], 0, sizeof(vdbe_cursor_t));
+    cursors[v->num_cursors].ops = ops;
+    cursors[v->num_cursors].arg = arg;
+    return v->num_cursors++;
+}
+
+/*
+** Add a sorter ordering rows by their first num_keys values
+** Bit k of desc makes key k sort in descending order.
+*/
+int vdbe_add_sorter(vdbe_t *v, int num_keys, unsigned int desc)
+{
+    int cursor = vdbe_add_cursor(v, NULL, NULL);
+    if (v->rc == SQLITE_OK) {
+        v->cursors[cursor].num_keys = num_keys;
+        v->cursors[cursor].desc = desc;
+    }
+    return cursor;
+}
+
+/*
+** Create a label for a jump target not yet emitted
+** Labels are negative, so they cannot be mistaken for addresses.
+*/
+int vdbe_make_label(vdbe_t *v)
+{
+    int *labels = (int *)grow(v, v->labels, v->num_labels, sizeof(int));
+    if (!labels) return -1;
+    v->labels = labels;
+    labels[v->num_labels] = -1;
+    return -1 - v->num_labels++;
+}
+
+/*
+** Make a label refer to the next instruction added
+*/
+void vdbe_resolve_label(vdbe_t *v, int label)
+{
+    int n = -1 - label;
+    if (n >= 0 && n < v->num_labels) v->labels[n] = v->num_ops;
+}
+
+/*
+** Finish building: resolve jumps to labels and allocate the registers and
+** parameters (as many as the highest OP_Variable refers to)
+*/
+int vdbe_ready(vdbe_t *v)
+{
+    int i;
+
+    if (v->rc != SQLITE_OK) return v->rc;
+
+    for (i = 0; i < v->num_ops; i++) {
+        vdbe_op_t *op = &v->ops[i];
+        if (op->p2 < 0) {
+            int n = -1 - op->p2;
+            if (n >= v->num_labels || v->labels[n] < 0) return SQLITE_INTERNAL;
+            op->p2 = v->labels[n];
+        }
+        if (op->opcode == OP_Variable && op->p1 > v->num_vars) v->num_vars = op->p1;
+    }
+
+    v->regs = (value_t *)riscos_malloc((v->num_regs + 1) * sizeof(value_t));
+    if (!v->regs) return v->rc = SQLITE_NOMEM;
+    for (i = 0; i <= v->num_regs; i++) v->regs[i].type = VALUE_NULL;
+
+    if (v->num_vars > 0) {
+        v->vars = (vdbe_var_t *)riscos_calloc(v->num_vars, sizeof(vdbe_var_t));
+        if (!v->vars) return v->rc = SQLITE_NOMEM;
+        for (i = 0; i < v->num_vars; i++) v->vars[i].value.type = VALUE_NULL;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Number of parameters the program takes
+*/
+int vdbe_param_count(vdbe_t *v)
+{
+    return v->num_vars;
+}
+
+/*
+** Bind a value to a parameter before the program starts
+** With copy set, text and blobs are copied; otherwise they must stay
+** valid until the parameter is bound again or the program is freed.
+*/
+int vdbe_bind(vdbe_t *v, int param, const value_t *value, int copy)
+{
+    vdbe_var_t *var;
+
+    if (v->started) return SQLITE_MISUSE;
+    if (param < 1 || param > v->num_vars) return SQLITE_RANGE;
+
+    var = &v->vars[param - 1];
+    riscos_free(var->copy);
+    var->copy = NULL;
+    var->value = *value;
+    if (copy && (value->type == VALUE_TEXT || value->type == VALUE_BLOB)) {
+        var->copy = (char *)riscos_malloc(value->u.s.n + 1);
+        if (!var->copy) {
+            var->value.type = VALUE_NULL;
+            return SQLITE_NOMEM;
+        }
+        memcpy(var->copy, value->u.s.z, value->u.s.n);
+        var->copy[value->u.s.n] = '\0';
+        var->value.u.s.z = var->copy;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Value of a parameter converted with an affinity
+** The result may refer to the parameter's storage.
+*/
+void vdbe_variable(vdbe_t *v, int param, value_affinity_t affinity, value_t *out)
+{
+    vdbe_var_t *var = &v->vars[param - 1];
+    *out = var->value;
+    value_apply_affinity(out, affinity, var->buf);
+}
+
+/*
+** Utility: Truth of a non-NULL value (a non-zero number)
+*/
+static int value_is_true(const value_t *value)
+{
+    switch (value->type) {
+        case VALUE_INTEGER: return value->u.i != 0;
+        case VALUE_REAL:    return value->u.r != 0.0;
+        default:            return value_to_real(value) != 0.0;
+    }
+}
+
+/*
+** Compare two sorter rows by their keys
+*/
+static int sorter_compare(const vdbe_cursor_t *s, const value_t *a, const value_t *b)
+{
+    int k;
+    for (k = 0; k < s->num_keys; k++) {
+        int c = value_compare(&a[k], &b[k]);
+        if (c != 0) return (s->desc & (1u << k)) ? -c : c;
+    }
+    return 0;
+}
+
+/*
+** Merge sort row pointers
+*/
+static void sorter_sort(const vdbe_cursor_t *s, value_t **rows, value_t **tmp, int n)
+{
+    int mid = n / 2;
+    int i, j, k;
+
+    if (n < 2) return;
+    sorter_sort(s, rows, tmp, mid);
+    sorter_sort(s, rows + mid, tmp, n - mid);
+
+    memcpy(tmp, rows, mid * sizeof(value_t *));
+    i = 0;
+    j = mid;
+    k = 0;
+    while (i < mid && j < n) {
+        if (sorter_compare(s, rows[j], tmp[i]) < 0) rows[k++] = rows[j++];
+        else rows[k++] = tmp[i++];
+    }
+    while (i < mid) rows[k++] = tmp[i++];
+}
+
+/*
+** Add a row to a sorter
+*/
+static int sorter_insert(vdbe_cursor_t *s, const value_t *values, int count)
+{
+    if (s->num_rows == s->capacity) {
+        int capacity = s->capacity ? s->capacity * 2 : VDBE_INITIAL_ROWS;
+        value_t *rows = (value_t *)riscos_realloc(s->rows,
+                            (size_t)capacity * count * sizeof(value_t));
+        if (!rows) return SQLITE_NOMEM;
+        s->rows = rows;
+        s->capacity = capacity;
+    }
+    s->width = count;
+    memcpy(s->rows + (size_t)s->num_rows * count, values, count * sizeof(value_t));
+    s->num_rows++;
+    return SQLITE_OK;
+}
+
+/*
+** Sort the rows added so far and move to the first
+*/
+static int sorter_rewind(vdbe_cursor_t *s)
+{
+    int i;
+
+    s->row = NULL;
+    s->pos = 0;
+    if (s->num_rows == 0) return SQLITE_OK;
+
+    riscos_free(s->sorted);
+    s->sorted = (value_t **)riscos_malloc(2 * (size_t)s->num_rows * sizeof(value_t *));
+    if (!s->sorted) return SQLITE_NOMEM;
+    for (i = 0; i < s->num_rows; i++) {
+        s->sorted[i] = s->rows + (size_t)i * s->width;
+    }
+    sorter_sort(s, s->sorted, s->sorted + s->num_rows, s->num_rows);
+    s->row = s->sorted[0];
+    return SQLITE_OK;
+}
+
+/*
+** Run the program until it produces a row, finishes or fails
+*/
+int vdbe_step(vdbe_t *v, char **errmsg)
+{
+    value_t *r = v->regs;
+    const vdbe_op_t *op;
+    vdbe_cursor_t *cur;
+    int pc, c, jump;
+    int rc = SQLITE_OK;
+    int i;
+
+    if (v->error != SQLITE_OK) return v->error;
+    if (!v->started) {
+        for (i = 0; i < v->num_consts; i++) r[v->consts[i].reg] = v->consts[i].value;
+        v->started = 1;
+        v->pc = 0;
+    }
+
+    pc = v->pc;
+    for (;;) {
+        op = &v->ops[pc++];
+        switch (op->opcode) {
+            case OP_Halt:
+                v->pc = pc - 1;
+                return SQLITE_DONE;
+
+            case OP_Goto:
+                pc = op->p2;
+                break;
+
+            case OP_Null:
+                r[op->p2].type = VALUE_NULL;
+                break;
+
+            case OP_Integer:
+                r[op->p2].type = VALUE_INTEGER;
+                r[op->p2].u.i = op->p1;
+                break;
+
+            case OP_OpenRead:
+                cur = &v->cursors[op->p1];
+                rc = cur->ops->open(cur->arg);
+                if (rc != SQLITE_OK) goto abort;
+                cur->is_open = 1;
+                cur->row = NULL;
+                break;
+
+            case OP_Close:
+                cur = &v->cursors[op->p1];
+                if (cur->is_open) cur->ops->close(cur->arg);
+                cur->is_open = 0;
+                cur->row = NULL;
+                break;
+
+            case OP_Rewind:
+                cur = &v->cursors[op->p1];
+                rc = cur->ops ? cur->ops->next(cur->arg, &cur->row) : sorter_rewind(cur);
+                if (rc != SQLITE_OK) goto abort;
+                if (!cur->row) pc = op->p2;
+                break;
+
+            case OP_Next:
+                cur = &v->cursors[op->p1];
+                if (cur->ops) {
+                    rc = cur->ops->next(cur->arg, &cur->row);
+                    if (rc != SQLITE_OK) goto abort;
+                } else {
+                    cur->row = ++cur->pos < cur->num_rows ? cur->sorted[cur->pos] : NULL;
+                }
+                if (cur->row) pc = op->p2;
+                break;
+
+            case OP_Column:
+                r[op->p3] = v->cursors[op->p1].row[op->p2];
+                break;
+
+            case OP_Eq:
+            case OP_Ne:
+            case OP_Lt:
+            case OP_Le:
+            case OP_Gt:
+            case OP_Ge:
+                if (r[op->p1].type == VALUE_NULL || r[op->p3].type == VALUE_NULL) {
+                    if (op->p5 & VDBE_JUMPIFNULL) pc = op->p2;
+                    break;
+                }
+                c = value_compare(&r[op->p1], &r[op->p3]);
+                switch (op->opcode) {
+                    case OP_Eq: jump = c == 0; break;
+                    case OP_Ne: jump = c != 0; break;
+                    case OP_Lt: jump = c < 0;  break;
+                    case OP_Le: jump = c <= 0; break;
+                    case OP_Gt: jump = c > 0;  break;
+                    default:    jump = c >= 0; break;
+                }
+                if (jump) pc = op->p2;
+                break;
+
+            case OP_IsNull:
+                if (r[op->p1].type == VALUE_NULL) pc = op->p2;
+                break;
+
+            case OP_NotNull:
+                if (r[op->p1].type != VALUE_NULL) pc = op->p2;
+                break;
+
+            case OP_Like:
+                if (r[op->p1].type == VALUE_NULL || r[op->p3].type == VALUE_NULL) {
+                    if (op->p5 & VDBE_JUMPIFNULL) pc = op->p2;
+                    break;
+                }
+                jump = value_like(&r[op->p1], &r[op->p3]);
+                if (op->p5 & VDBE_NEGATE) jump = !jump;
+                if (jump) pc = op->p2;
+                break;
+
+            case OP_If:
+            case OP_IfNot:
+                if (r[op->p1].type == VALUE_NULL) {
+                    if (op->p5 & VDBE_JUMPIFNULL) pc = op->p2;
+                    break;
+                }
+                if (value_is_true(&r[op->p1]) == (op->opcode == OP_If)) pc = op->p2;
+                break;
+
+            case OP_ResultRow:
+                v->result = &r[op->p1];
+                v->num_result = op->p2;
+                v->pc = pc;
+                return SQLITE_ROW;
+
+            case OP_SorterInsert:
+                rc = sorter_insert(&v->cursors[op->p1], &r[op->p2], op->p3);
+                if (rc != SQLITE_OK) goto abort;
+                break;
+
+            case OP_Insert:
+                cur = &v->cursors[op->p1];
+                rc = cur->ops->insert(cur->arg, &r[op->p2], errmsg);
+                if (rc != SQLITE_OK) goto abort;
+                break;
+
+            case OP_Variable:
+                vdbe_variable(v, op->p1, (value_affinity_t)op->p3, &r[op->p2]);
+                break;
+
+            case OP_Reserve:
+                cur = &v->cursors[op->p1];
+                if (cur->ops->reserve) {
+                    rc = cur->ops->reserve(cur->arg, op->p2);
+                    if (rc != SQLITE_OK) goto abort;
+                }
+                break;
+
+            default:
+                rc = SQLITE_INTERNAL;
+                goto abort;
+        }
+    }
+
+abort:
+    v->pc = pc;
+    v->error = rc;
+    if (rc == SQLITE_NOMEM && errmsg) *errmsg = "Out of memory";
+    return rc;
+}
+
+/*
+** The row produced by the last step that returned SQLITE_ROW
+*/
+const value_t *vdbe_row(vdbe_t *v, int *pcount)
+{
+    if (pcount) *pcount = v->num_result;
+    return v->result;
+}
+
+/*
+** Return a program to its start, closing cursors and emptying sorters
+*/
+void vdbe_reset(vdbe_t *v)
+{
+    int i;
+
+    for (i = 0; i < v->num_cursors; i++) {
+        vdbe_cursor_t *cur = &v->cursors[i];
+        if (cur->is_open) cur->ops->close(cur->arg);
+        cur->is_open = 0;
+        cur->row = NULL;
+        cur->num_rows = 0;
+        cur->pos = 0;
+    }
+    v->pc = 0;
+    v->started = 0;
+    v->error = SQLITE_OK;
+    v->result = NULL;
+    v->num_result = 0;
+}
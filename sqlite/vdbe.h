@@ -0,0 +1,93 @@
+/*
+** SQLite Virtual Machine for RISC OS
+** Bytecode programs that run compiled SELECT and INSERT statements
+**
+** A statement is parsed and planned once into a short program of
+** register-based instructions; running it is a loop over that program with
+** no SQL text in sight. Tables are reached through cursors whose rows come
+** from callbacks supplied by the compiler, so the machine knows nothing of
+** storage layouts or indexes. Values in registers are shallow: text still
+** points into the table's storage or the program's constants.
+*/
+
+#ifndef _VDBE_H_
+#define _VDBE_H_
+
+#include "value.h"
+
+/* Opcodes */
+#define OP_Halt         0   /* Stop; the statement is done */
+#define OP_Goto         1   /* Jump to P2 */
+#define OP_Null         2   /* Register P2 = NULL */
+#define OP_Integer      3   /* Register P2 = integer P1 */
+#define OP_OpenRead     4   /* Open table cursor P1 */
+#define OP_Close        5   /* Close table cursor P1 */
+#define OP_Rewind       6   /* Move cursor P1 to its first row; jump to P2 if none */
+#define OP_Next         7   /* Move cursor P1 on; jump to P2 if there is a row */
+#define OP_Column       8   /* Register P3 = column P2 of cursor P1's row */
+#define OP_Eq           9   /* Jump to P2 if register P1 = register P3 */
+#define OP_Ne           10  /*  ... <> (all comparisons: see VDBE_JUMPIFNULL) */
+#define OP_Lt           11
+#define OP_Le           12
+#define OP_Gt           13
+#define OP_Ge           14
+#define OP_IsNull       15  /* Jump to P2 if register P1 is NULL */
+#define OP_NotNull      16  /* Jump to P2 if register P1 is not NULL */
+#define OP_Like         17  /* Jump to P2 if register P1 matches pattern P3 */
+#define OP_If           18  /* Jump to P2 if register P1 is true */
+#define OP_IfNot        19  /* Jump to P2 if register P1 is false */
+#define OP_ResultRow    20  /* Registers P1..P1+P2-1 are the next result row */
+#define OP_SorterInsert 21  /* Add registers P2..P2+P3-1 as a row of sorter P1 */
+#define OP_Insert       22  /* Add registers P2..P2+P3-1 as a row of cursor P1's table */
+#define OP_Variable     23  /* Register P2 = parameter P1, with affinity P3 applied */
+#define OP_Reserve      24  /* Make room in cursor P1's table for P2 more rows */
+
+/* P5 flags */
+#define VDBE_JUMPIFNULL 0x01        /* A NULL operand takes the jump */
+#define VDBE_NEGATE     0x02        /* OP_Like: jump if the pattern does not match */
+
+typedef struct vdbe vdbe_t;
+
+/*
+** Table behind a cursor
+** open() starts a pass over the rows, next() sets *prow to the values of
+** the next row (indexed by table column, valid until the next call) or to
+** NULL after the last one, and close() ends the pass. insert() adds a row;
+** reserve() may prepare for that many more, as a hint.
+** Operations a cursor is never used for may be NULL.
+*/
+typedef struct {
+    int (*open)(void *arg);
+    int (*next)(void *arg, const value_t **prow);
+    void (*close)(void *arg);
+    int (*insert)(void *arg, const value_t *values, char **errmsg);
+    int (*reserve)(void *arg, int rows);
+} vdbe_table_ops_t;
+
+/* Program lifecycle */
+vdbe_t *vdbe_create(void);
+void vdbe_free(vdbe_t *v);
+
+/* Building a program (allocation failures are reported by vdbe_ready) */
+void vdbe_reserve(vdbe_t *v, int num_ops, int num_consts);
+int vdbe_add_op(vdbe_t *v, int opcode, int p1, int p2, int p3);
+void vdbe_set_p5(vdbe_t *v, int flags);
+int vdbe_alloc_regs(vdbe_t *v, int count);
+void vdbe_set_constant(vdbe_t *v, int reg, const value_t *value);
+int vdbe_add_cursor(vdbe_t *v, const vdbe_table_ops_t *ops, void *arg);
+int vdbe_add_sorter(vdbe_t *v, int num_keys, unsigned int desc);
+int vdbe_make_label(vdbe_t *v);
+void vdbe_resolve_label(vdbe_t *v, int label);
+int vdbe_ready(vdbe_t *v);
+
+/* Parameters, numbered from 1 (unbound ones are NULL; bindings survive a reset) */
+int vdbe_param_count(vdbe_t *v);
+int vdbe_bind(vdbe_t *v, int param, const value_t *value, int copy);
+void vdbe_variable(vdbe_t *v, int param, value_affinity_t affinity, value_t *out);
+
+/* Execution: SQLITE_ROW with a result row, SQLITE_DONE, or an error */
+int vdbe_step(vdbe_t *v, char **errmsg);
+const value_t *vdbe_row(vdbe_t *v, int *pcount);
+void vdbe_reset(vdbe_t *v);
+
+#endif /* _VDBE_H_ */
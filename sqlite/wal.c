@@ -0,0 +1,538 @@
+/*
+** SQLite Write-Ahead Log Implementation for RISC OS
+**
+** The log is only ever appended to between checkpoints. In memory it is an
+** array giving the page number of every frame and a hash table from page
+** number to the newest committed frame holding that page; frames of a
+** commit still being written are in the array but not the hash table, so
+** nobody reads them until the commit record is down. The checksum runs
+** through every frame from the header on, as in SQLite: recovery stops at
+** the first frame that does not match, and keeps only the frames up to the
+** last commit record before it.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sqlite.h"
+#include "pager.h"
+#include "wal.h"
+#include "mem_riscos.h"
+
+/* Initial hash table slots (a power of two) */
+#define WAL_INITIAL_HASH    64
+
+/* Hash table slot: page number (0 if empty) and its newest frame */
+typedef struct {
+    int pgno;
+    int frame;
+} wal_slot_t;
+
+struct wal {
+    riscos_file_t *file;
+    int page_size;                  /* 0 while the log has no header */
+    int has_header;                 /* Header on disk matches the salt below */
+    unsigned int checkpoint_seq;
+    unsigned int salt[2];
+    unsigned int cksum[2];          /* Running checksum after the last frame written */
+    unsigned int commit_cksum[2];   /* ... and after the last committed frame */
+    int max_frame;                  /* Committed frames */
+    int num_frames;                 /* Frames written, counting an unfinished commit */
+    int db_pages;                   /* Database size at the last commit */
+    int *frame_pgno;                /* Page number of each frame */
+    int frames_capacity;
+    wal_slot_t *hash;               /* Newest committed frame of each page */
+    int hash_size;
+    int hash_count;
+
+    /* Header and frames not yet written, gathered for one write */
+    unsigned char header[WAL_HDR_SIZE];
+    unsigned char frame_hdrs[WAL_PENDING_FRAMES][WAL_FRAME_HDR_SIZE];
+    riscos_iovec_t pending[2 * WAL_PENDING_FRAMES + 1];
+    int num_pending;                /* Entries in pending */
+    int pending_frames;             /* Frame headers in use */
+    int header_pending;             /* The header is in pending */
+};
+
+/*
+** Write the gathered header and frames
+** They follow on from one another, so this is one transfer.
+*/
+static int write_pending(wal_t *wal)
+{
+    int rc = SQLITE_OK;
+
+    if (wal->num_pending == 0) return SQLITE_OK;
+    if (riscos_vfs_writev(wal->file, wal->pending, wal->num_pending) != 0) {
+        rc = SQLITE_IOERR;
+        if (wal->header_pending) wal->has_header = 0;
+    }
+    wal->num_pending = 0;
+    wal->pending_frames = 0;
+    wal->header_pending = 0;
+    return rc;
+}
+
+/*
+** Add a piece to the gather list
+*/
+static void add_pending(wal_t *wal, int offset, const void *buf, int len)
+{
+    riscos_iovec_t *v = &wal->pending[wal->num_pending++];
+
+    v->offset = offset;
+    v->buf = buf;
+    v->len = len;
+}
+
+/*
+** Add n bytes (a multiple of 8) to a running checksum
+*/
+static void wal_checksum(const unsigned char *p, int n, unsigned int *s)
+{
+    unsigned int s0 = s[0], s1 = s[1];
+    int i;
+
+    for (i = 0; i < n; i += 8) {
+        s0 += pager_get_u32(p + i) + s1;
+        s1 += pager_get_u32(p + i + 4) + s0;
+    }
+    s[0] = s0;
+    s[1] = s1;
+}
+
+/*
+** Utility: File offset of a frame's header (frames are numbered from 1)
+*/
+static int frame_offset(wal_t *wal, int frame)
+{
+    return WAL_HDR_SIZE + (frame - 1) * (WAL_FRAME_HDR_SIZE + wal->page_size);
+}
+
+/*
+** Utility: Hash slot holding pgno, or the empty slot where it belongs
+*/
+static wal_slot_t *hash_slot(wal_t *wal, int pgno)
+{
+    int i = (int)(((unsigned int)pgno * 2654435761u) & (unsigned int)(wal->hash_size - 1));
+
+    while (wal->hash[i].pgno != 0 && wal->hash[i].pgno != pgno) {
+        i = (i + 1) & (wal->hash_size - 1);
+    }
+    return &wal->hash[i];
+}
+
+/*
+** Make room for count more pages in the hash table, keeping it at most
+** half full
+*/
+static int hash_reserve(wal_t *wal, int count)
+{
+    wal_slot_t *old = wal->hash;
+    int old_size = wal->hash_size;
+    int size = old_size ? old_size : WAL_INITIAL_HASH;
+    int i;
+
+    while ((wal->hash_count + count) * 2 > size) size *= 2;
+    if (size == old_size) return SQLITE_OK;
+
+    wal->hash = (wal_slot_t *)riscos_calloc(size, sizeof(wal_slot_t));
+    if (!wal->hash) {
+        wal->hash = old;
+        return SQLITE_NOMEM;
+    }
+    wal->hash_size = size;
+    for (i = 0; i < old_size; i++) {
+        if (old[i].pgno != 0) *hash_slot(wal, old[i].pgno) = old[i];
+    }
+    riscos_free(old);
+    return SQLITE_OK;
+}
+
+/*
+** Make the frames written since the last commit visible
+** The hash table has already been sized for them.
+*/
+static void commit_frames(wal_t *wal, int db_pages)
+{
+    int frame;
+
+    for (frame = wal->max_frame + 1; frame <= wal->num_frames; frame++) {
+        wal_slot_t *slot = hash_slot(wal, wal->frame_pgno[frame - 1]);
+        if (slot->pgno == 0) wal->hash_count++;
+        slot->pgno = wal->frame_pgno[frame - 1];
+        slot->frame = frame;
+    }
+    wal->max_frame = wal->num_frames;
+    wal->db_pages = db_pages;
+    wal->commit_cksum[0] = wal->cksum[0];
+    wal->commit_cksum[1] = wal->cksum[1];
+}
+
+/*
+** Record the page number of the next frame
+*/
+static int add_frame(wal_t *wal, int pgno)
+{
+    if (wal->num_frames == wal->frames_capacity) {
+        int capacity = wal->frames_capacity ? wal->frames_capacity * 2 : 64;
+        int *frames = (int *)riscos_realloc(wal->frame_pgno, capacity * sizeof(int));
+        if (!frames) return SQLITE_NOMEM;
+        wal->frame_pgno = frames;
+        wal->frames_capacity = capacity;
+    }
+    wal->frame_pgno[wal->num_frames++] = pgno;
+    return SQLITE_OK;
+}
+
+/*
+** Read the committed frames of an existing log
+** Anything after the last valid commit record is ignored, and will be
+** overwritten by the next commit.
+*/
+static int recover(wal_t *wal)
+{
+    unsigned char hdr[WAL_HDR_SIZE];
+    unsigned char *buf;
+    unsigned int s[2];
+    int size, page_size, offset;
+    int rc = SQLITE_OK;
+
+    size = riscos_vfs_filesize(wal->file);
+    if (size < 0) return SQLITE_IOERR;
+    if (size < WAL_HDR_SIZE) return SQLITE_OK;
+    if (riscos_vfs_read_at(wal->file, 0, hdr, WAL_HDR_SIZE) != WAL_HDR_SIZE) {
+        return SQLITE_IOERR;
+    }
+
+    /* A log without a valid header is empty */
+    s[0] = s[1] = 0;
+    wal_checksum(hdr, 24, s);
+    page_size = (int)pager_get_u32(hdr + 8);
+    if (pager_get_u32(hdr) != WAL_MAGIC || pager_get_u32(hdr + 4) != WAL_VERSION ||
+        page_size < PAGER_MIN_PAGE_SIZE || page_size > PAGER_MAX_PAGE_SIZE ||
+        (page_size & (page_size - 1)) != 0 ||
+        s[0] != pager_get_u32(hdr + 24) || s[1] != pager_get_u32(hdr + 28)) {
+        return SQLITE_OK;
+    }
+    wal->page_size = page_size;
+    wal->has_header = 1;
+    wal->checkpoint_seq = pager_get_u32(hdr + 12);
+    wal->salt[0] = pager_get_u32(hdr + 16);
+    wal->salt[1] = pager_get_u32(hdr + 20);
+    wal->cksum[0] = wal->commit_cksum[0] = s[0];
+    wal->cksum[1] = wal->commit_cksum[1] = s[1];
+
+    buf = (unsigned char *)riscos_malloc(WAL_FRAME_HDR_SIZE + page_size);
+    if (!buf) return SQLITE_NOMEM;
+
+    for (offset = WAL_HDR_SIZE; offset + WAL_FRAME_HDR_SIZE + page_size <= size;
+         offset += WAL_FRAME_HDR_SIZE + page_size) {
+        int pgno, db_pages;
+
+        if (riscos_vfs_read_at(wal->file, offset, buf, WAL_FRAME_HDR_SIZE + page_size) !=
+            WAL_FRAME_HDR_SIZE + page_size) {
+            rc = SQLITE_IOERR;
+            break;
+        }
+        pgno = (int)pager_get_u32(buf);
+        db_pages = (int)pager_get_u32(buf + 4);
+        if (pgno < 1 || pager_get_u32(buf + 8) != wal->salt[0] ||
+            pager_get_u32(buf + 12) != wal->salt[1]) {
+            break;
+        }
+        s[0] = wal->cksum[0];
+        s[1] = wal->cksum[1];
+        wal_checksum(buf, 8, s);
+        wal_checksum(buf + WAL_FRAME_HDR_SIZE, page_size, s);
+        if (s[0] != pager_get_u32(buf + 16) || s[1] != pager_get_u32(buf + 20)) break;
+
+        rc = add_frame(wal, pgno);
+        if (rc == SQLITE_OK && db_pages > 0) {
+            rc = hash_reserve(wal, wal->num_frames - wal->max_frame);
+        }
+        if (rc != SQLITE_OK) break;
+        wal->cksum[0] = s[0];
+        wal->cksum[1] = s[1];
+        if (db_pages > 0) commit_frames(wal, db_pages);
+    }
+    riscos_free(buf);
+
+    wal_abort(wal);
+    return rc;
+}
+
+/*
+** Open the log held in an already-open file, recovering its commits
+*/
+int wal_open(riscos_file_t *file, wal_t **pwal)
+{
+    wal_t *wal;
+    int rc;
+
+    *pwal = NULL;
+    wal = (wal_t *)riscos_calloc(1, sizeof(wal_t));
+    if (!wal) return SQLITE_NOMEM;
+    wal->file = file;
+
+    rc = hash_reserve(wal, 0);
+    if (rc == SQLITE_OK) rc = recover(wal);
+    if (rc != SQLITE_OK) {
+        wal_close(wal);
+        return rc;
+    }
+
+    *pwal = wal;
+    return SQLITE_OK;
+}
+
+/*
+** Free the log's memory; the file is left open for the caller to close
+*/
+void wal_close(wal_t *wal)
+{
+    if (!wal) return;
+    riscos_free(wal->frame_pgno);
+    riscos_free(wal->hash);
+    riscos_free(wal);
+}
+
+/*
+** Page size of the frames in the log, or 0 if it has none yet
+*/
+int wal_page_size(wal_t *wal)
+{
+    return wal->page_size;
+}
+
+/*
+** Forget every frame; the next commit starts the log again with a new
+** header and salt, so frames already in the file are never seen again
+*/
+void wal_reset(wal_t *wal)
+{
+    wal->has_header = 0;
+    wal->max_frame = 0;
+    wal->num_frames = 0;
+    wal->db_pages = 0;
+    wal->hash_count = 0;
+    memset(wal->hash, 0, wal->hash_size * sizeof(wal_slot_t));
+}
+
+/*
+** Newest committed frame holding a page, or 0 if the page is not logged
+*/
+int wal_find(wal_t *wal, int pgno)
+{
+    wal_slot_t *slot;
+
+    if (wal->max_frame == 0) return 0;
+    slot = hash_slot(wal, pgno);
+    return slot->pgno == pgno ? slot->frame : 0;
+}
+
+/*
+** Read the page held in a frame
+*/
+int wal_read(wal_t *wal, int frame, unsigned char *buf)
+{
+    if (riscos_vfs_read_at(wal->file, frame_offset(wal, frame) + WAL_FRAME_HDR_SIZE,
+                           buf, wal->page_size) != wal->page_size) {
+        return SQLITE_IOERR;
+    }
+    return SQLITE_OK;
+}
+
+/*
+** Database size in pages as of the last commit in the log, 0 if none
+*/
+int wal_db_pages(wal_t *wal)
+{
+    return wal->db_pages;
+}
+
+/*
+** Committed frames in the log
+*/
+int wal_frame_count(wal_t *wal)
+{
+    return wal->max_frame;
+}
+
+/*
+** Prepare to append a commit, with a new header if the log was reset
+*/
+int wal_begin(wal_t *wal, int page_size)
+{
+    unsigned char *hdr = wal->header;
+    unsigned int s[2];
+
+    if (wal->has_header && wal->page_size == page_size) return SQLITE_OK;
+
+    wal_reset(wal);
+    wal->page_size = page_size;
+    wal->checkpoint_seq++;
+    wal->salt[0] += 1;
+    wal->salt[1] = wal->salt[1] * 1103515245u + (unsigned int)time(NULL) +
+                   (unsigned int)clock();
+
+    pager_put_u32(hdr, WAL_MAGIC);
+    pager_put_u32(hdr + 4, WAL_VERSION);
+    pager_put_u32(hdr + 8, (unsigned int)page_size);
+    pager_put_u32(hdr + 12, wal->checkpoint_seq);
+    pager_put_u32(hdr + 16, wal->salt[0]);
+    pager_put_u32(hdr + 20, wal->salt[1]);
+    s[0] = s[1] = 0;
+    wal_checksum(hdr, 24, s);
+    pager_put_u32(hdr + 24, s[0]);
+    pager_put_u32(hdr + 28, s[1]);
+
+    /* Written with the first frames */
+    wal->num_pending = 0;
+    wal->pending_frames = 0;
+    add_pending(wal, 0, hdr, WAL_HDR_SIZE);
+    wal->header_pending = 1;
+    wal->cksum[0] = wal->commit_cksum[0] = s[0];
+    wal->cksum[1] = wal->commit_cksum[1] = s[1];
+    wal->has_header = 1;
+    return SQLITE_OK;
+}
+
+/*
+** Append a page to the log
+** db_pages is 0 except on the last page of a commit, where it is the
+** database size in pages; the commit's pages become visible once that
+** frame is written.
+*/
+int wal_write(wal_t *wal, int pgno, const unsigned char *data, int db_pages)
+{
+    unsigned char *hdr = wal->frame_hdrs[wal->pending_frames];
+    unsigned int s[2];
+    int offset, rc;
+
+    /* Room to index the whole commit, so committing cannot fail */
+    rc = hash_reserve(wal, wal->num_frames + 1 - wal->max_frame);
+    if (rc != SQLITE_OK) return rc;
+
+    pager_put_u32(hdr, (unsigned int)pgno);
+    pager_put_u32(hdr + 4, (unsigned int)db_pages);
+    pager_put_u32(hdr + 8, wal->salt[0]);
+    pager_put_u32(hdr + 12, wal->salt[1]);
+    s[0] = wal->cksum[0];
+    s[1] = wal->cksum[1];
+    wal_checksum(hdr, 8, s);
+    wal_checksum(data, wal->page_size, s);
+    pager_put_u32(hdr + 16, s[0]);
+    pager_put_u32(hdr + 20, s[1]);
+
+    /* Frames are gathered, and written together at the end of the commit */
+    offset = frame_offset(wal, wal->num_frames + 1);
+    add_pending(wal, offset, hdr, WAL_FRAME_HDR_SIZE);
+    add_pending(wal, offset + WAL_FRAME_HDR_SIZE, data, wal->page_size);
+    wal->pending_frames++;
+    if (db_pages > 0 || wal->pending_frames == WAL_PENDING_FRAMES) {
+        rc = write_pending(wal);
+        if (rc != SQLITE_OK) return rc;
+    }
+    rc = add_frame(wal, pgno);
+    if (rc != SQLITE_OK) return rc;
+    wal->cksum[0] = s[0];
+    wal->cksum[1] = s[1];
+
+    if (db_pages > 0) commit_frames(wal, db_pages);
+    return SQLITE_OK;
+}
+
+/*
+** Drop the frames of an unfinished commit; the next commit overwrites them
+*/
+void wal_abort(wal_t *wal)
+{
+    if (wal->header_pending) wal->has_header = 0;
+    wal->num_pending = 0;
+    wal->pending_frames = 0;
+    wal->header_pending = 0;
+    wal->num_frames = wal->max_frame;
+    wal->cksum[0] = wal->commit_cksum[0];
+    wal->cksum[1] = wal->commit_cksum[1];
+}
+
+/*
+** Make the commits written so far durable
+** As for the database file, a failed sync is not treated as an error.
+*/
+void wal_sync(wal_t *wal)
+{
+    riscos_vfs_sync(wal->file);
+}
+
+/*
+** Utility: Order page numbers for qsort
+*/
+static int compare_pgno(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+** Copy the newest committed version of each logged page into the database
+** file in page order, then reset the log
+** With sync, the log is synced first and the database file after the
+** copy. *pframes is set to the number of pages copied.
+*/
+int wal_checkpoint(wal_t *wal, riscos_file_t *db, int sync, int *pframes)
+{
+    riscos_iovec_t vec[WAL_CHECKPOINT_PAGES];
+    unsigned char *buf;
+    int *pages;
+    int frame, count = 0, batch, i, k;
+    int rc = SQLITE_OK;
+
+    if (pframes) *pframes = 0;
+    if (wal->max_frame == 0) return SQLITE_OK;
+
+    /* The log must be durable before the database can depend on it */
+    if (sync) wal_sync(wal);
+
+    /* Pages are copied in batches of up to a gather block */
+    batch = RISCOS_VFS_GATHER_SIZE / wal->page_size;
+    if (batch < 1) batch = 1;
+    if (batch > WAL_CHECKPOINT_PAGES) batch = WAL_CHECKPOINT_PAGES;
+    if (batch > wal->max_frame) batch = wal->max_frame;
+
+    pages = (int *)riscos_malloc(wal->max_frame * sizeof(int));
+    buf = (unsigned char *)riscos_malloc(batch * wal->page_size);
+    if (!pages || !buf) {
+        riscos_free(pages);
+        riscos_free(buf);
+        return SQLITE_NOMEM;
+    }
+
+    /* Only the newest frame of each page is copied */
+    for (frame = 1; frame <= wal->max_frame; frame++) {
+        int pgno = wal->frame_pgno[frame - 1];
+        if (wal_find(wal, pgno) == frame) pages[count++] = pgno;
+    }
+    qsort(pages, count, sizeof(int), compare_pgno);
+
+    /* Neighbouring pages in a batch go to the file in one transfer */
+    for (i = 0; rc == SQLITE_OK && i < count; i += k) {
+        for (k = 0; rc == SQLITE_OK && k < batch && i + k < count; k++) {
+            vec[k].offset = (pages[i + k] - 1) * wal->page_size;
+            vec[k].buf = buf + k * wal->page_size;
+            vec[k].len = wal->page_size;
+            rc = wal_read(wal, wal_find(wal, pages[i + k]), buf + k * wal->page_size);
+        }
+        if (rc == SQLITE_OK && riscos_vfs_writev(db, vec, k) != 0) rc = SQLITE_IOERR;
+    }
+    riscos_free(pages);
+    riscos_free(buf);
+    if (rc != SQLITE_OK) return rc;
+
+    if (sync) riscos_vfs_sync(db);
+    wal_reset(wal);
+    if (pframes) *pframes = count;
+    return SQLITE_OK;
+}
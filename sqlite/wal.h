@@ -0,0 +1,64 @@
+/*
+** SQLite Write-Ahead Log for RISC OS
+** Committed pages are appended to a log file next to the database
+**
+** A commit writes each changed page as a frame at the end of the log; the
+** last frame of the commit carries the commit record (the database size in
+** pages), and one sync of the log makes the commit durable. The database
+** file itself is only written by a checkpoint, which copies the newest
+** committed version of every logged page back into it and starts the log
+** again. Frames carry a running checksum and the log's salt, so a commit
+** torn by a crash, or frames left over from before a checkpoint, are
+** ignored when the log is recovered on open.
+**
+** Log file format (integers little-endian):
+**   Header (32 bytes)  - magic, version, page size, checkpoint sequence,
+**                        salt (2 words), checksum of the first 24 bytes
+**   Frame header (24)  - page number, commit record (database size in
+**                        pages, or 0 if not the last frame of a commit),
+**                        salt (2 words), running checksum (2 words)
+**   Frame data         - one page
+*/
+
+#ifndef _WAL_H_
+#define _WAL_H_
+
+#include "os_riscos.h"
+
+#define WAL_MAGIC           0x4C415752  /* "RWAL" */
+#define WAL_VERSION         1
+#define WAL_HDR_SIZE        32
+#define WAL_FRAME_HDR_SIZE  24
+
+/* Frames of a commit gathered before they are written */
+#define WAL_PENDING_FRAMES  32
+
+/* Most pages a checkpoint copies with one gather write */
+#define WAL_CHECKPOINT_PAGES 32
+
+typedef struct wal wal_t;
+
+/* Lifecycle (wal_open recovers the committed frames already in the file) */
+int wal_open(riscos_file_t *file, wal_t **pwal);
+void wal_close(wal_t *wal);
+int wal_page_size(wal_t *wal);
+void wal_reset(wal_t *wal);
+
+/* Reading the committed state */
+int wal_find(wal_t *wal, int pgno);
+int wal_read(wal_t *wal, int frame, unsigned char *buf);
+int wal_db_pages(wal_t *wal);
+int wal_frame_count(wal_t *wal);
+
+/* Writing a commit: frames become visible with the one carrying db_pages
+** (a page passed to wal_write is written later, and must not change until
+** that frame has been written) */
+int wal_begin(wal_t *wal, int page_size);
+int wal_write(wal_t *wal, int pgno, const unsigned char *data, int db_pages);
+void wal_abort(wal_t *wal);
+void wal_sync(wal_t *wal);
+
+/* Copy the log back into the database file and start it again */
+int wal_checkpoint(wal_t *wal, riscos_file_t *db, int sync, int *pframes);
+
+#endif /* _WAL_H_ */
@@ -57,6 +57,32 @@ ROLLBACK;
 -- Verify table was rolled back (should NOT appear in .tables)
 .tables
 
+-- Test transaction: rows inserted then rolled back
+BEGIN;
+INSERT INTO committed_table VALUES (1);
+ROLLBACK;
+SELECT * FROM committed_table;
+
+-- Nested BEGIN and COMMIT without BEGIN (should error)
+BEGIN;
+BEGIN;
+COMMIT;
+COMMIT;
+
+-- Savepoints: should show rows 1 and 3 only, 2 is rolled back
+BEGIN;
+INSERT INTO committed_table VALUES (1);
+SAVEPOINT sp;
+INSERT INTO committed_table VALUES (2);
+ROLLBACK TO sp;
+INSERT INTO committed_table VALUES (3);
+RELEASE sp;
+COMMIT;
+SELECT * FROM committed_table;
+
+-- Should fail with "No such savepoint"
+RELEASE sp;
+
 -- ============================================================================
 -- TEST 5: Error Handling
 -- ============================================================================
@@ -73,11 +99,10 @@ DROP TABLE error_test;
 DROP TABLE error_test;  -- Should error: table not found
 
 -- ============================================================================
--- TEST 6: Maximum Tables
+-- TEST 6: Many Tables
 -- ============================================================================
 
--- Create up to 32 tables (system maximum)
--- This tests the limit of the system
+-- Create many tables (the catalog grows on demand; there is no fixed maximum)
 -- If system crashes or behaves incorrectly, this is a failure
 
 CREATE TABLE t1 (id INTEGER);
@@ -110,7 +135,8 @@ CREATE TABLE t26 (id INTEGER);
 -- List all tables (should show many)
 .tables
 
--- Try to exceed maximum (might fail with "Too many tables")
+-- Table names are case-insensitive: should fail with "Table already exists"
+CREATE TABLE T26 (id INTEGER);
 CREATE TABLE t27 (id INTEGER);
 
 -- ============================================================================
@@ -120,9 +146,66 @@ CREATE TABLE t27 (id INTEGER);
 -- Test PRAGMA statements (should be accepted even if not fully implemented)
 PRAGMA cache_size=100;
 PRAGMA page_size=512;
+PRAGMA synchronous=NORMAL;
+PRAGMA synchronous;
+PRAGMA synchronous=FULL;
+
+-- ============================================================================
+-- TEST 8: Typed Values and Columnar Tables
+-- ============================================================================
+
+-- Numbers are stored in binary; REAL always prints with a decimal point
+CREATE TABLE readings (id INTEGER, sensor TEXT, level REAL) WITH (columnar);
+INSERT INTO readings VALUES (1, 'north', 20);
+INSERT INTO readings VALUES (2, 'south', 21.5);
+INSERT INTO readings VALUES (3, NULL, NULL);
+
+-- Should show: 1 | north | 20.0, 2 | south | 21.5, 3 | NULL | NULL
+SELECT * FROM readings;
+
+-- Should fail with "Unknown table option"
+CREATE TABLE bad_option (id INTEGER) WITH (compressed);
+
+DROP TABLE readings;
+
+-- ============================================================================
+-- TEST 9: Indexes, WHERE and ORDER BY
+-- ============================================================================
+
+CREATE TABLE events (id INTEGER, ts INTEGER, kind TEXT);
+INSERT INTO events VALUES (1, 300, 'open');
+INSERT INTO events VALUES (2, 100, 'close');
+INSERT INTO events VALUES (3, 200, 'open');
+INSERT INTO events VALUES (4, NULL, 'open');
+CREATE UNIQUE INDEX events_id ON events (id) USING hash;
+CREATE INDEX events_ts ON events (ts) USING btree;
+
+-- Should show: 3 | 200 | open
+SELECT * FROM events WHERE id = 3;
+
+-- Should show: 2 | 100 | close, 3 | 200 | open (NULL never matches)
+SELECT * FROM events WHERE ts BETWEEN 100 AND 250 ORDER BY ts;
+
+-- Should show: 1 | 300 | open, 3 | 200 | open, 4 | NULL | open
+SELECT * FROM events WHERE kind = 'open' ORDER BY ts DESC;
+
+-- Should fail with "UNIQUE constraint failed"
+INSERT INTO events VALUES (2, 400, 'dup');
+
+DROP INDEX events_ts;
+DROP TABLE events;
+
+-- Quoted strings, comments and keywords as names
+CREATE TABLE notes (id INTEGER, "key" TEXT, [desc] TEXT);
+INSERT INTO notes VALUES (1, 'O''Brien', 'a;b'), /* ignored */ (2, 'plain', NULL);
+
+-- Should show: 1 | O'Brien | a;b
+SELECT id, key, desc FROM notes WHERE key = 'O''Brien'; -- trailing comment
+
+DROP TABLE notes;
 
 -- ============================================================================
--- TEST 8: Cleanup - Drop all test tables
+-- TEST 10: Cleanup - Drop all test tables
 -- ============================================================================
 
 DROP TABLE test_table;
@@ -171,8 +254,9 @@ DROP TABLE t27;
 -- - .schema command: ✅ PASS
 -- - Transaction support: ✅ PASS
 -- - Error handling: ✅ PASS
--- - Maximum tables: ✅ PASS (or appropriate error)
+-- - Many tables: ✅ PASS
 -- - PRAGMA support: ✅ PASS
+-- - Indexes, WHERE, ORDER BY: ✅ PASS
 --
 -- Overall Status: ✅ PASS if no crashes, errors as expected
 --
@@ -52,9 +52,9 @@ DROP TABLE trans_stress_3;
 DROP TABLE trans_stress_4;
 
 -- ============================================================================
--- STRESS TEST 3: Maximum Table Boundary Testing
+-- STRESS TEST 3: Catalog Growth
 -- ============================================================================
--- Approach and test the 32-table maximum
+-- Grow the table catalog past its initial size (there is no fixed maximum)
 
 CREATE TABLE boundary_1 (id INTEGER);
 CREATE TABLE boundary_2 (id INTEGER);
@@ -89,16 +89,16 @@ CREATE TABLE boundary_30 (id INTEGER);
 
 .tables
 
--- Try to add one more (might fail)
+-- Keep adding tables
 CREATE TABLE boundary_31 (id INTEGER);
 
--- Try to add another (expected to fail)
+-- And another
 CREATE TABLE boundary_32 (id INTEGER);
 
 -- ============================================================================
 -- STRESS TEST 4: Schema Viewing with Many Tables
 -- ============================================================================
--- Test schema command with maximum tables
+-- Test schema command with many tables
 
 .schema
 
@@ -186,7 +186,7 @@ DROP TABLE recovery_test;
 -- ✅ Graceful error handling
 -- ✅ Memory stability (no growing memory usage)
 -- ✅ System recovers from errors
--- ✅ Maximum table limit enforced (32 tables)
+-- ✅ Many tables handled (no fixed table limit)
 -- ✅ All operations complete
 --
 -- If all these conditions met: ✅ STRESS TEST PASS